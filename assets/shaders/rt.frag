@@ -7,21 +7,67 @@ in vec2 fragPos;
 uniform int u_ScreenWidth;
 uniform int u_ScreenHeight;
 
+#if defined(COMPACT_BVH)
+// 32 byte node in depth first order, the first child of an inner node is
+// the next node. data is the second child, or the primitive offset of a leaf.
+// info = primitiveCount << 3 | firstChildIsPositive << 2 | splitAxis
+struct CompactBVHNode {
+    vec3 minBounds;
+    int data;
+    vec3 maxBounds;
+    int info;
+};
+#elif defined(WIDE_BVH)
+// Four children per node as structure of arrays. For each child,
+// count > 0 is a leaf of count primitives starting at child,
+// count == 0 an inner node with index child and count == -1 an empty slot.
+struct WideBVHNode {
+    vec4 minX;
+    vec4 minY;
+    vec4 minZ;
+    vec4 maxX;
+    vec4 maxY;
+    vec4 maxZ;
+    ivec4 child;
+    ivec4 count;
+};
+#else
 struct BVHNode {
     vec3 minBounds;
     int leftChild;
     vec3 maxBounds;
     int rightChild;
-    int primitiveIndex;
-    float pad[3];
+    int primitiveOffset;
+    int primitiveCount;
+    float pad[2];
 };
+#endif
 
+#if defined(INDEXED_PRIMITIVES)
+// Three indices into vertices. A sphere has v1 == -1, v0 is its center and
+// the w of that vertex its radius.
+struct Primitive {
+    int v0;
+    int v1;
+    int v2;
+    int materialId;
+};
+#elif defined(EDGE_PRIMITIVES)
+// First vertex and the two edges leaving it. v0.w holds the bits of the
+// material id, e1.w is 1 for a sphere centered at v0 with radius e1.x.
+struct Primitive {
+    vec4 v0;
+    vec4 e1;
+    vec4 e2;
+};
+#else
 struct Primitive {
     vec4 vertexData[3];
     int materialId;          
     int type;
     float pad;
 };
+#endif
 
 struct Material {
 	vec4 ambient;
@@ -47,14 +93,44 @@ layout(std140, binding = 1) uniform CameraData {
     vec4 u_PlaneCenter;
 };
 
+#if defined(COMPACT_BVH)
+layout(std430, binding = 2) buffer BVHBuffer {
+    CompactBVHNode BVHNodes[];
+};
+#elif defined(WIDE_BVH)
+layout(std430, binding = 2) buffer BVHBuffer {
+    WideBVHNode BVHNodes[];
+};
+#else
 layout(std430, binding = 2) buffer BVHBuffer {
     BVHNode BVHNodes[];
 };
+#endif
 
 layout(std430, binding = 3) buffer Primitives {
     Primitive primitiveNodes[];
 };
 
+#if defined(INDEXED_PRIMITIVES)
+layout(std430, binding = 8) buffer Vertices {
+    vec4 vertices[];
+};
+#endif
+
+#if defined(SPHERE_BUFFER)
+// Spheres apart from the triangles, see GPU::SpherePrimitive. Leaves hold a
+// single kind, sphere leaves store the complement of their offset in here.
+struct SpherePrimitive {
+    vec4 centerRadius;
+    int materialId;
+    int pad[3];
+};
+
+layout(std430, binding = 9) buffer Spheres {
+    SpherePrimitive spheres[];
+};
+#endif
+
 layout(std430, binding = 4) buffer Materials {
     Material materials[];
 };
@@ -63,6 +139,26 @@ layout(std430, binding = 5) buffer Lights {
     Light lights[];
 };
 
+#if defined(INSTANCING)
+// Placement of a bottom level tree, see GPU::Instance. materialId replaces
+// the material of the primitives unless it is 0.
+struct Instance {
+    mat4 worldToObject;
+    int blasRoot;
+    int materialId;
+    float pad[2];
+};
+
+// Top level tree, its leaves reference ranges of instances.
+layout(std430, binding = 6) buffer TLASBuffer {
+    BVHNode TLASNodes[];
+};
+
+layout(std430, binding = 7) buffer Instances {
+    Instance instances[];
+};
+#endif
+
 
 struct Ray {
     vec3 origin;
@@ -76,57 +172,80 @@ struct HitRecord {
     float t;
 };
 
-bool Hit(Ray ray, Primitive primitive, out HitRecord hitRecord) {
-    // triangle
-    if (primitive.type == 0) {
-        vec3 e1 = primitive.vertexData[1].xyz - primitive.vertexData[0].xyz;
-        vec3 e2 = primitive.vertexData[2].xyz - primitive.vertexData[0].xyz;
-        vec3 h = cross(ray.direction, e2);
-        float a = dot(e1, h);
-        if (a > -0.00001 && a < 0.00001)
-            return false;
-        float f = 1.0 / a;
-        vec3 s = ray.origin - primitive.vertexData[0].xyz;
-        float u = f * dot(s, h);
-        if (u < 0.0 || u > 1.0)
-            return false;
-        vec3 q = cross(s, e1);
-        float v = f * dot(ray.direction, q);
-        if (v < 0.0 || u + v > 1.0)
-            return false;
-        float t = f * dot(e2, q);
-        if (t > 0.00001) {
-            hitRecord.hitPoint = ray.origin + ray.direction * t;
-            hitRecord.normal = normalize(cross(e1, e2));
-            hitRecord.materialId = primitive.materialId;
-            hitRecord.t = t;
-            return true;
-        }
+bool HitTriangle(Ray ray, vec3 v0, vec3 e1, vec3 e2, int materialId, out HitRecord hitRecord) {
+    vec3 h = cross(ray.direction, e2);
+    float a = dot(e1, h);
+    if (a > -0.00001 && a < 0.00001)
+        return false;
+    float f = 1.0 / a;
+    vec3 s = ray.origin - v0;
+    float u = f * dot(s, h);
+    if (u < 0.0 || u > 1.0)
         return false;
+    vec3 q = cross(s, e1);
+    float v = f * dot(ray.direction, q);
+    if (v < 0.0 || u + v > 1.0)
+        return false;
+    float t = f * dot(e2, q);
+    if (t > 0.00001) {
+        hitRecord.hitPoint = ray.origin + ray.direction * t;
+        hitRecord.normal = normalize(cross(e1, e2));
+        hitRecord.materialId = materialId;
+        hitRecord.t = t;
+        return true;
     }
-    // sphere
-    else {
-        vec3 center = primitive.vertexData[0].xyz;
-        float radius = primitive.vertexData[1].x;
-        vec3 oc = ray.origin - center;
-        float a = dot(ray.direction, ray.direction);
-        float b = dot(oc, ray.direction);
-        float c = dot(oc, oc) - radius * radius;
-        float discriminant = b * b - a * c;
-        if (discriminant > 0) {
-            float temp = (-b - sqrt(discriminant)) / a;
-            if (temp < 0.00001)
-                temp = (-b + sqrt(discriminant)) / a;
-            if (temp > 0.00001) {
-                hitRecord.t = temp;
-                hitRecord.hitPoint = ray.origin + ray.direction * temp;
-                hitRecord.normal = normalize(hitRecord.hitPoint - center);
-                hitRecord.materialId = primitive.materialId;
-                return true;
-            }
+    return false;
+}
+
+bool HitSphere(Ray ray, vec3 center, float radius, int materialId, out HitRecord hitRecord) {
+    vec3 oc = ray.origin - center;
+    float a = dot(ray.direction, ray.direction);
+    float b = dot(oc, ray.direction);
+    float c = dot(oc, oc) - radius * radius;
+    float discriminant = b * b - a * c;
+    if (discriminant > 0) {
+        float temp = (-b - sqrt(discriminant)) / a;
+        if (temp < 0.00001)
+            temp = (-b + sqrt(discriminant)) / a;
+        if (temp > 0.00001) {
+            hitRecord.t = temp;
+            hitRecord.hitPoint = ray.origin + ray.direction * temp;
+            hitRecord.normal = normalize(hitRecord.hitPoint - center);
+            hitRecord.materialId = materialId;
+            return true;
         }
-        return false;
     }
+    return false;
+}
+
+bool Hit(Ray ray, int primitiveIndex, out HitRecord hitRecord) {
+    Primitive primitive = primitiveNodes[primitiveIndex];
+#if defined(INDEXED_PRIMITIVES)
+    vec4 v0 = vertices[primitive.v0];
+#if !defined(SPHERE_BUFFER)
+    if (primitive.v1 < 0)
+        return HitSphere(ray, v0.xyz, v0.w, primitive.materialId, hitRecord);
+#endif
+    vec3 e1 = vertices[primitive.v1].xyz - v0.xyz;
+    vec3 e2 = vertices[primitive.v2].xyz - v0.xyz;
+    return HitTriangle(ray, v0.xyz, e1, e2, primitive.materialId, hitRecord);
+#elif defined(EDGE_PRIMITIVES)
+    int materialId = floatBitsToInt(primitive.v0.w);
+#if !defined(SPHERE_BUFFER)
+    if (primitive.e1.w != 0.0)
+        return HitSphere(ray, primitive.v0.xyz, primitive.e1.x, materialId, hitRecord);
+#endif
+    return HitTriangle(ray, primitive.v0.xyz, primitive.e1.xyz, primitive.e2.xyz, materialId, hitRecord);
+#else
+#if !defined(SPHERE_BUFFER)
+    // sphere
+    if (primitive.type != 0)
+        return HitSphere(ray, primitive.vertexData[0].xyz, primitive.vertexData[1].x, primitive.materialId, hitRecord);
+#endif
+    vec3 e1 = primitive.vertexData[1].xyz - primitive.vertexData[0].xyz;
+    vec3 e2 = primitive.vertexData[2].xyz - primitive.vertexData[0].xyz;
+    return HitTriangle(ray, primitive.vertexData[0].xyz, e1, e2, primitive.materialId, hitRecord);
+#endif
 }
 
 bool aabbIntersect(Ray ray, vec3 minBounds, vec3 maxBounds, out float tmin, out float tmax) {
@@ -140,28 +259,113 @@ bool aabbIntersect(Ray ray, vec3 minBounds, vec3 maxBounds, out float tmin, out
     return tmax > max(0.0, tmin);
 }
 
+void HitLeaf(Ray ray, int primitiveOffset, int primitiveCount, inout HitRecord hitRecord)
+{
+#if defined(SPHERE_BUFFER)
+    if (primitiveOffset < 0) {
+        int sphereEnd = ~primitiveOffset + primitiveCount;
+        for (int i = ~primitiveOffset; i < sphereEnd; i++) {
+            SpherePrimitive sphere = spheres[i];
+            HitRecord tempRecord;
+            if (HitSphere(ray, sphere.centerRadius.xyz, sphere.centerRadius.w, sphere.materialId, tempRecord)) {
+                if (tempRecord.t < hitRecord.t) {
+                    hitRecord = tempRecord;
+                }
+            }
+        }
+        return;
+    }
+#endif
+    int primitiveEnd = primitiveOffset + primitiveCount;
+    for (int i = primitiveOffset; i < primitiveEnd; i++) {
+        HitRecord tempRecord;
+        if (Hit(ray, i, tempRecord)) {
+            if (tempRecord.t < hitRecord.t) {
+                hitRecord = tempRecord;
+            }
+        }
+    }
+}
+
+#if defined(COMPACT_BVH)
 void BVHHit(Ray ray, out HitRecord hitRecord)
-{ 
+{
     hitRecord.t = INFINITY;
 
     int stack[128];
     int stackPointer = 0;
     stack[stackPointer++] = 0;
 
+    while (stackPointer > 0) {
+        int nodeIndex = stack[--stackPointer];
+        CompactBVHNode node = BVHNodes[nodeIndex];
+
+        float tmin, tmax;
+        if (!aabbIntersect(ray, node.minBounds, node.maxBounds, tmin, tmax) || tmin > hitRecord.t) continue;
+
+        int primitiveCount = node.info >> 3;
+        if (primitiveCount > 0) {
+            HitLeaf(ray, node.data, primitiveCount, hitRecord);
+        } else {
+            // Push the far child first so that the near one is visited first.
+            int axis = node.info & 3;
+            bool firstIsPositive = (node.info & 4) != 0;
+            bool firstIsNear = (ray.direction[axis] >= 0.0) != firstIsPositive;
+            stack[stackPointer++] = firstIsNear ? node.data : nodeIndex + 1;
+            stack[stackPointer++] = firstIsNear ? nodeIndex + 1 : node.data;
+        }
+    }
+}
+#elif defined(WIDE_BVH)
+void BVHHit(Ray ray, out HitRecord hitRecord)
+{
+    hitRecord.t = INFINITY;
+    vec3 invDir = 1.0 / ray.direction;
+
+    int stack[128];
+    int stackPointer = 0;
+    stack[stackPointer++] = 0;
+
+    while (stackPointer > 0) {
+        WideBVHNode node = BVHNodes[stack[--stackPointer]];
+
+        // All four child boxes at once
+        vec4 t0x = (node.minX - ray.origin.x) * invDir.x;
+        vec4 t1x = (node.maxX - ray.origin.x) * invDir.x;
+        vec4 t0y = (node.minY - ray.origin.y) * invDir.y;
+        vec4 t1y = (node.maxY - ray.origin.y) * invDir.y;
+        vec4 t0z = (node.minZ - ray.origin.z) * invDir.z;
+        vec4 t1z = (node.maxZ - ray.origin.z) * invDir.z;
+        vec4 tmin = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), vec4(0.0)));
+        vec4 tmax = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), vec4(hitRecord.t)));
+        bvec4 hit = lessThanEqual(tmin, tmax);
+
+        for (int i = 0; i < 4; i++) {
+            if (!hit[i] || node.count[i] < 0) continue;
+
+            if (node.count[i] > 0) {
+                HitLeaf(ray, node.child[i], node.count[i], hitRecord);
+            } else {
+                stack[stackPointer++] = node.child[i];
+            }
+        }
+    }
+}
+#else
+void TraverseBVH(Ray ray, int rootIndex, inout HitRecord hitRecord)
+{
+    int stack[128];
+    int stackPointer = 0;
+    stack[stackPointer++] = rootIndex;
+
     while (stackPointer > 0) {
         int nodeIndex = stack[--stackPointer];
         BVHNode node = BVHNodes[nodeIndex];
 
         float tmin, tmax;
         if(aabbIntersect(ray, node.minBounds, node.maxBounds, tmin, tmax)) {
-            if (node.primitiveIndex >= 0) {
-                Primitive primitive = primitiveNodes[node.primitiveIndex];
-                HitRecord tempRecord;
-                if (Hit(ray, primitive, tempRecord)) {
-                    if (tempRecord.t < hitRecord.t) {
-                        hitRecord = tempRecord;
-                    }
-                }
+            if (node.primitiveCount > 0) {
+                HitLeaf(ray, node.primitiveOffset, node.primitiveCount, hitRecord);
             } else {
                 if (node.leftChild >= 0) {
                     stack[stackPointer++] = node.leftChild;
@@ -174,6 +378,56 @@ void BVHHit(Ray ray, out HitRecord hitRecord)
     }
 }
 
+#if defined(INSTANCING)
+void BVHHit(Ray ray, out HitRecord hitRecord)
+{
+    hitRecord.t = INFINITY;
+
+    int stack[64];
+    int stackPointer = 0;
+    stack[stackPointer++] = 0;
+
+    while (stackPointer > 0) {
+        BVHNode node = TLASNodes[stack[--stackPointer]];
+
+        float tmin, tmax;
+        if (!aabbIntersect(ray, node.minBounds, node.maxBounds, tmin, tmax) || tmin > hitRecord.t) continue;
+
+        if (node.primitiveCount == 0) {
+            stack[stackPointer++] = node.leftChild;
+            stack[stackPointer++] = node.rightChild;
+            continue;
+        }
+
+        for (int i = node.primitiveOffset; i < node.primitiveOffset + node.primitiveCount; i++) {
+            // The object space direction is not normalized, so distances
+            // along it are the same as in world space.
+            Instance instance = instances[i];
+            Ray localRay;
+            localRay.origin = (instance.worldToObject * vec4(ray.origin, 1.0)).xyz;
+            localRay.direction = mat3(instance.worldToObject) * ray.direction;
+
+            float closest = hitRecord.t;
+            TraverseBVH(localRay, instance.blasRoot, hitRecord);
+            if (hitRecord.t < closest) {
+                hitRecord.hitPoint = ray.origin + ray.direction * hitRecord.t;
+                hitRecord.normal = normalize(transpose(mat3(instance.worldToObject)) * hitRecord.normal);
+                if (instance.materialId != 0) {
+                    hitRecord.materialId = instance.materialId;
+                }
+            }
+        }
+    }
+}
+#else
+void BVHHit(Ray ray, out HitRecord hitRecord)
+{ 
+    hitRecord.t = INFINITY;
+    TraverseBVH(ray, 0, hitRecord);
+}
+#endif
+#endif
+
 struct ShadingStackElement {
     Ray ray;
     HitRecord hitRecord;
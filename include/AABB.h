@@ -6,23 +6,28 @@
 #include "ray.h"
 #include <glm/glm.hpp>
 
-class AABB {
+template <typename Real>
+class BasicAABB {
 public:
-	Interval x, y, z;
+	BasicInterval<Real> x, y, z;
 	
-	AABB() {};
-	AABB(const Vec3& p1, const Vec3& p2);
-	AABB(const AABB& box1, const AABB& box2);
+	BasicAABB() {};
+	BasicAABB(const BasicVec3<Real>& p1, const BasicVec3<Real>& p2);
+	BasicAABB(const BasicAABB& box1, const BasicAABB& box2);
 	
 	glm::vec3 getMinBounds();
 	glm::vec3 getMaxBounds();
 
 	const void thicken();
-	const Interval& axis(int i) const;
-	bool hit(const Ray& ray, Interval ray_t) const;
+	void grow(const BasicAABB& box);
+	Real surfaceArea() const;
+	const BasicInterval<Real>& axis(int i) const;
+	bool hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t) const;
 	
-	const Interval& operator[](int axis) const;
+	const BasicInterval<Real>& operator[](int axis) const;
 };
 
+using AABB = BasicAABB<float>;
+
 
 #endif // !AABBH_H
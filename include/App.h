@@ -17,6 +17,12 @@
 #include "Camera.h"
 #include "Shader.h"
 #include "SSBO.h"
+#include "ThreadPool.h"
+#include "GPUStructs.h"
+#include "BVHRefit.h"
+#include "TwoLevelBVH.h"
+#include "CacheLayout.h"
+#include "SceneCache.h"
 
 static struct WindowState
 {
@@ -29,10 +35,49 @@ static struct WindowState
 	GLFWwindow* window;
 } s_WindowState;
 
+enum class BVHBuilderType
+{
+	SAH,  // binned SAH over BVHNode, best tree quality
+	LBVH, // Morton code linear BVH, fastest build
+	SBVH  // SAH with spatial splits, fewer overlapping nodes around long thin triangles
+};
+
+enum class BVHLayout
+{
+	Binary,  // 48 byte GPU::BVHNode
+	Compact, // 32 byte GPU::CompactBVHNode, near child first
+	Wide     // 4-wide GPU::WideBVHNode
+};
+
+enum class PrimitiveFormat
+{
+	Inline,  // 64 byte GPU::Primitive holding its vertices
+	Indexed, // 16 byte GPU::IndexedPrimitive over a shared vertex buffer
+	Edges    // 48 byte GPU::EdgePrimitive with precomputed edges
+};
+
+struct AppSettings
+{
+	std::string scenePath = "./assets/scenes/monkey.xml";
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	BVHBuilderType builder = BVHBuilderType::SAH;
+	BVHLayout layout = BVHLayout::Binary;
+	bool instancing = false; // one BVH per unique mesh under a top level BVH of instances
+	bool animate = false;    // deform the scene and refit the BVH every frame, or move the instances
+	NodeOrder nodeOrder = NodeOrder::DepthFirst; // memory order of the binary BVH nodes
+	int layoutBlockBytes = 256;                  // treelet size for NodeOrder::Treelet
+	bool cacheReport = false;                    // simulate traversal cache misses before and after reordering
+	int cacheReportBytes = 32 * 1024;            // size of the simulated cache, 64 byte lines and 8 ways
+	std::string cacheDirectory;                  // where built scene buffers are cached, empty to always rebuild
+	bool streamParse = false;                    // load the scene with the streaming reader instead of the XML DOM
+	PrimitiveFormat primitiveFormat = PrimitiveFormat::Inline; // how primitives are stored on the GPU
+	bool sphereBuffer = false;                   // spheres in their own buffer, leaves hold a single kind
+};
+
 class App
 {
 public:
-	App();
+	App(const AppSettings& settings = AppSettings());
 	~App();
 
 	void Init();
@@ -42,6 +87,31 @@ public:
 	void ProcessInput();
 
 private:
+	void LoadScene();
+	bool ComputeSceneCacheKey(uint64_t& key) const;
+	bool LoadSceneCache(uint64_t key);
+	void UploadBuffer(const std::string& name, GLuint bindingPoint, size_t size, const void* data);
+	void BuildBVH();
+	void UploadBVH();
+	void UploadPrimitives(const std::vector<GPU::Primitive>& scenePrimitives, std::vector<GPU::BVHNode>* nodes = nullptr);
+	void AnimateGeometry(float time);
+	void BuildTwoLevelBVH();
+	void UploadTwoLevelBVH();
+	void UploadTLAS();
+	void AnimateInstances(float time);
+	void ReportCacheMisses(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives, const char* label);
+
+	AppSettings m_Settings;
+	std::unique_ptr<ThreadPool> m_ThreadPool;
+	std::vector<GPU::BVHNode> m_FlatBVH;
+	std::vector<GPU::Primitive> m_Primitives;
+	std::vector<int> m_PrimitiveIndices;
+	BVHRefitter m_Refitter;
+	std::vector<parser::Vec3f> m_RestVertices;
+	TwoLevelBVH m_TwoLevelBVH;
+	std::vector<glm::mat4> m_RestTransforms;
+	float m_AnimationExtent; // diagonal of the scene bounds, scales the ripple
+	SceneCache m_SceneCache;
 	GLuint m_QuadVAO;
 	std::shared_ptr<Shader> m_RayTracingShader;
 	std::unique_ptr<Camera> m_Camera;
@@ -3,22 +3,41 @@
 
 #include "Hittable.h"
 #include "Parser.h"
+#include "BVHBuilder.h"
 #include <memory>
 #include <vector>
 #include <algorithm>
 #include <random>
 
-class BVHNode : public Hittable{
+// Hittable view of a BVH. The tree is built by BVHBuilder, the objects are
+// reordered so that every leaf covers a contiguous range of them.
+template <typename Real>
+class BasicBVHNode : public BasicHittable<Real>{
 public:
-	BVHNode(std::vector<std::shared_ptr<Hittable>>& objects, int begin, int end);
+	using Hittable = BasicHittable<Real>;
 
-	bool hit(const Ray& ray, Interval ray_t, HitRecord& rec) const override;
+	BasicBVHNode(std::vector<std::shared_ptr<Hittable>>& objects, int begin, int end,
+				 const BVHBuildOptions& options = BVHBuildOptions());
 
-	AABB getAABB() const override;
+	bool hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec) const override;
 
-	AABB bounding_box;
+	BasicAABB<Real> getAABB() const override;
+
+	BasicAABB<Real> bounding_box;
 	std::shared_ptr<Hittable> left;
 	std::shared_ptr<Hittable> right;
+
+	// Non-empty for leaves, which have no children.
+	std::vector<std::shared_ptr<Hittable>> primitives;
+
+private:
+	BasicBVHNode(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex,
+				 const std::vector<std::shared_ptr<Hittable>>& objects, int begin);
+
+	static std::shared_ptr<Hittable> makeChild(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex,
+											   const std::vector<std::shared_ptr<Hittable>>& objects, int begin);
 };
 
+using BVHNode = BasicBVHNode<float>;
+
 #endif // !BVH_H
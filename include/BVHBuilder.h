@@ -0,0 +1,59 @@
+#ifndef BVH_BUILDER_H
+#define BVH_BUILDER_H
+
+#include "GPUStructs.h"
+#include <vector>
+
+class ThreadPool;
+
+// Parameters of the binned surface area heuristic used to split BVH nodes,
+// and of the parallel build. The resulting tree does not depend on the pool.
+struct BVHBuildOptions
+{
+	int binCount = 12;          // centroid bins evaluated along the split axis
+	float traversalCost = 1.0f; // cost of visiting an internal node
+	float leafCost = 1.0f;      // cost of intersecting a single primitive
+	int maxLeafSize = 4;        // ranges up to this size may become a single leaf
+	int leafBlockWidth = 1;     // primitives tested together, a leaf costs leafCost per started block
+
+	ThreadPool* threadPool = nullptr; // builds serially when null
+	int taskGrainSize = 1024;         // ranges this large build their subtrees as separate tasks
+	int parallelGrainSize = 8192;     // ranges this large are binned and partitioned in parallel
+};
+
+// What the builder sees of a primitive: its bounds and where it came from.
+struct PrimitiveRef
+{
+	glm::vec3 minBounds;
+	int index;
+	glm::vec3 maxBounds;
+	int pad;
+};
+
+// Binned SAH builder over a contiguous array of primitive references. Nodes
+// live in one preallocated array: a range of n references owns the 2n - 1
+// slots following its node, so every subtree writes to a fixed place no
+// matter which thread builds it. Slots left unused by leaves with several
+// primitives are squeezed out at the end, which leaves the nodes in depth
+// first order.
+class BVHBuilder
+{
+public:
+	explicit BVHBuilder(const BVHBuildOptions& options = BVHBuildOptions());
+
+	// Reorders refs so that every leaf covers a contiguous range of them.
+	void Build(std::vector<PrimitiveRef>& refs, std::vector<GPU::BVHNode>& flatBVH);
+
+	// Builds over GPU primitives and writes them out in leaf order. When
+	// primitiveIndices is given it receives the input index of every output primitive.
+	void Build(const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& flatBVH,
+			   std::vector<GPU::Primitive>& primitives, std::vector<int>* primitiveIndices = nullptr);
+
+private:
+	void Build(std::vector<PrimitiveRef>& refs, std::vector<GPU::BVHNode>& flatBVH,
+			   const std::vector<GPU::Primitive>* input, std::vector<GPU::Primitive>* primitives);
+
+	BVHBuildOptions m_Options;
+};
+
+#endif // !BVH_BUILDER_H
@@ -0,0 +1,69 @@
+#ifndef BVH_REFIT_H
+#define BVH_REFIT_H
+
+#include "GPUStructs.h"
+#include "Parser.h"
+#include <vector>
+
+class ThreadPool;
+
+struct BVHRefitOptions
+{
+	float rebuildThreshold = 1.5f;    // SAH cost, relative to the freshly built tree, that asks for a rebuild
+	int mergeGap = 8;                 // changed ranges closer than this many elements are uploaded as one
+	ThreadPool* threadPool = nullptr; // refits serially when null
+	int grainSize = 2048;             // primitives or nodes per parallel chunk
+};
+
+// Range of elements [first, first + count) that changed during a refit.
+struct BVHRefitRange
+{
+	int first;
+	int count;
+};
+
+// Keeps a flat BVH valid while scene.vertex_data moves. Topology is kept as
+// built: primitives are reloaded from their vertices, and node bounds are
+// recomputed bottom up, one tree level at a time so that each level can be
+// spread over the pool. Only elements whose data actually changed are
+// reported, so the GPU copies can be patched instead of uploaded again.
+//
+// Bounds of a refitted tree stay tight, but its splits no longer match the
+// geometry. The SAH cost is compared with the one measured right after the
+// build, and NeedsRebuild() turns true once it grows past the threshold.
+class BVHRefitter
+{
+public:
+	explicit BVHRefitter(const BVHRefitOptions& options = BVHRefitOptions());
+
+	// Starts tracking a freshly built tree. primitiveIndices maps every leaf
+	// ordered primitive to its position in ExtractPrimitives order.
+	void Reset(const parser::Scene& scene, const std::vector<GPU::BVHNode>& flatBVH,
+			   const std::vector<int>& primitiveIndices);
+
+	// Reloads primitives from scene.vertex_data and refits the nodes above
+	// them. Returns the number of nodes whose bounds changed.
+	int Refit(const parser::Scene& scene, std::vector<GPU::BVHNode>& flatBVH,
+			  std::vector<GPU::Primitive>& primitives);
+
+	const std::vector<BVHRefitRange>& GetChangedNodes() const { return m_ChangedNodeRanges; }
+	const std::vector<BVHRefitRange>& GetChangedPrimitives() const { return m_ChangedPrimitiveRanges; }
+
+	// SAH cost of the current tree divided by the cost right after the build.
+	float GetDegradation() const { return m_Degradation; }
+	bool NeedsRebuild() const { return m_Degradation > m_Options.rebuildThreshold; }
+
+private:
+	BVHRefitOptions m_Options;
+
+	std::vector<glm::ivec3> m_VertexIds;        // leaf ordered, 1 based ids, y and z unused for spheres
+	std::vector<std::vector<int>> m_Levels;     // node indices grouped by depth
+	std::vector<uint8_t> m_NodeChanged;
+	std::vector<uint8_t> m_PrimitiveChanged;
+	std::vector<BVHRefitRange> m_ChangedNodeRanges;
+	std::vector<BVHRefitRange> m_ChangedPrimitiveRanges;
+	float m_BuildCost;
+	float m_Degradation;
+};
+
+#endif // !BVH_REFIT_H
@@ -0,0 +1,96 @@
+#ifndef BINARY_SCENE_H
+#define BINARY_SCENE_H
+
+#include "MappedFile.h"
+#include "Parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// .rtscene files hold a parser::Scene as fixed size records in 64 byte
+// aligned sections, so a mapped file can be read in place. A table at the
+// end lists the sections by kind with their record size and count; readers
+// skip kinds they do not know, so new sections do not need a new version.
+namespace parser
+{
+	enum class BinarySection : uint32_t
+	{
+		Globals = 1,     // one BinaryGlobals
+		Vertices = 2,    // Vec3f
+		Materials = 3,   // BinaryMaterial
+		PointLights = 4, // PointLight
+		Meshes = 5,      // BinaryMesh, faces in the Faces section
+		Faces = 6,       // Face, the faces of all meshes one after the other
+		Triangles = 7,   // Triangle
+		Spheres = 8,     // Sphere
+		Cameras = 9,     // BinaryCamera, names in the CameraNames section
+		CameraNames = 10 // char, the image names of all cameras one after the other
+	};
+
+	struct BinaryGlobals
+	{
+		Vec3i background_color;
+		float shadow_ray_epsilon;
+		int max_recursion_depth;
+		Vec3f ambient_light;
+	};
+
+	struct BinaryMaterial
+	{
+		int is_mirror;
+		Vec3f ambient;
+		Vec3f diffuse;
+		Vec3f specular;
+		Vec3f mirror;
+		float phong_exponent;
+	};
+
+	struct BinaryCamera
+	{
+		Vec3f position;
+		Vec3f gaze;
+		Vec3f up;
+		Vec4f near_plane;
+		float near_distance;
+		int image_width;
+		int image_height;
+		uint32_t name_offset;
+		uint32_t name_length;
+	};
+
+	struct BinaryMesh
+	{
+		int material_id;
+		uint32_t pad;
+		uint64_t first_face;
+		uint64_t face_count;
+	};
+
+	// Read only view of a mapped .rtscene file.
+	class BinarySceneFile
+	{
+	public:
+		// Maps and validates the file, throws std::runtime_error if it is not a
+		// readable .rtscene file.
+		explicit BinarySceneFile(const std::string& filepath);
+
+		// Records of a section, or null with count 0 if the file has none.
+		template <typename T>
+		const T* Get(BinarySection kind, size_t& count) const
+		{
+			return static_cast<const T*>(find(kind, sizeof(T), count));
+		}
+
+	private:
+		const void* find(BinarySection kind, size_t recordSize, size_t& count) const;
+
+		MappedFile m_File;
+		const uint8_t* m_Table;
+		uint32_t m_SectionCount;
+	};
+
+	// True if the file starts with the .rtscene magic.
+	bool IsBinaryScene(const std::string& filepath);
+}
+
+#endif // !BINARY_SCENE_H
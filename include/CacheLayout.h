@@ -0,0 +1,72 @@
+#ifndef CACHE_LAYOUT_H
+#define CACHE_LAYOUT_H
+
+#include "GPUStructs.h"
+#include "Parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class NodeOrder
+{
+	DepthFirst, // as built
+	Treelet,    // subtrees clustered into blocks of blockBytes
+	VanEmdeBoas // recursive top/bottom split, cache size oblivious
+};
+
+struct CacheLayoutOptions
+{
+	NodeOrder order = NodeOrder::Treelet;
+	int blockBytes = 256; // treelet size, a few cache lines or a page
+};
+
+// Reorders the nodes of a flat BVH so that nodes visited together share cache
+// lines or pages. Parents stay in front of their children. Primitives are then
+// rewritten leaf by leaf in the new node order, sorted along a Morton curve
+// inside each leaf, and primitiveIndices is permuted to match when given.
+void ReorderBVH(std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::Primitive>& primitives,
+				const CacheLayoutOptions& options = CacheLayoutOptions(), std::vector<int>* primitiveIndices = nullptr);
+
+// Sorts scene.vertex_data along a Morton curve and renumbers every face,
+// triangle and sphere, so that vertices of nearby primitives are close in memory.
+void ReorderVertices(parser::Scene& scene);
+
+// Set associative LRU cache that counts the misses of a stream of reads.
+class CacheSimulator
+{
+public:
+	CacheSimulator(size_t cacheBytes = 32 * 1024, int lineBytes = 64, int ways = 8);
+
+	// Reads bytes starting at address, touching every line they span.
+	void Access(uint64_t address, size_t bytes);
+	void Reset();
+
+	uint64_t GetAccesses() const { return m_Accesses; }
+	uint64_t GetMisses() const { return m_Misses; }
+
+private:
+	int m_LineShift;
+	int m_SetCount;
+	int m_Ways;
+	std::vector<uint64_t> m_Tags;     // per set, most recently used first
+	std::vector<int> m_Valid;         // valid ways per set
+	uint64_t m_Accesses;
+	uint64_t m_Misses;
+};
+
+struct CacheReport
+{
+	uint64_t rays;
+	uint64_t nodeVisits;
+	uint64_t nodeMisses;
+	uint64_t primitiveVisits;
+	uint64_t primitiveMisses;
+};
+
+// Traces a rayGridSize x rayGridSize grid of coherent rays looking at the scene
+// from outside its bounds, across its thinnest side, the way rt.frag walks the binary layout, and counts
+// the cache misses on the node and primitive arrays.
+CacheReport SimulateTraversalCache(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+								   CacheSimulator& cache, int rayGridSize = 256);
+
+#endif // !CACHE_LAYOUT_H
@@ -0,0 +1,103 @@
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include "CpuScene.h"
+#include "GPUStructs.h"
+#include "ImageWriter.h"
+#include "Parser.h"
+#include "TileScheduler.h"
+#include "TriangleBlock.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+extern parser::Scene scene;
+
+struct CpuRenderOptions
+{
+	ThreadPool* threadPool = nullptr; // renders tiles in parallel when given
+	int tileSize = 32;                // width and height of a tile in pixels
+	TileOrder tileOrder = TileOrder::Hilbert; // order the tiles are handed out in
+	int progressivePasses = 0;        // coarse passes before the full one, as many as divide the tile size
+	int packetSize = 0;               // 4, 8 or 16 to trace primary rays in packets, 0 for one at a time
+	bool doublePrecision = false;     // trace the CpuScene in double, to validate the float results
+};
+
+struct CpuRenderStats
+{
+	double seconds = 0.0;
+	uint64_t rayCount = 0;                // primary, shadow and mirror rays
+	double tileSeconds = 0.0;             // wall time of the passes, without the pass callbacks
+	std::vector<TileThreadStats> threads; // summed over the passes
+};
+
+// Ray traces the global scene through a CpuScene, without a GPU. The
+// shading follows rt.frag: Blinn-Phong from every unshadowed point light and
+// mirror reflections, plus the ambient light and background color of the
+// scene, and mirror bounces limited to its MaxRecursionDepth. The frame is
+// split into square tiles, ordered along a curve and handed out to the
+// threads by a TileScheduler.
+//
+// Progressive passes trace every pixel once over all of them: the first pass
+// one pixel in every 2^n x 2^n square, filling the whole square with it, and
+// every later pass the pixels of a grid twice as fine that are not on the
+// coarser one, down to single pixels.
+//
+// With a packet size the scene is instead traced through a flattened BVH of
+// GPU primitives: primary rays of neighbouring pixels go through it together
+// as a RayPacket, shadow and mirror rays one at a time against the triangle
+// blocks of the leaves.
+//
+// Real is the precision of the CpuScene and the shading: float to render,
+// double to check float against.
+template <typename Real>
+class BasicCpuRenderer
+{
+public:
+	using Vec3 = BasicVec3<Real>;
+	using Ray = BasicRay<Real>;
+	using HitRecord = BasicHitRecord<Real>;
+
+	explicit BasicCpuRenderer(const CpuRenderOptions& options = CpuRenderOptions());
+
+	// onPass is called after every pass but the last one with the image so far.
+	CpuRenderStats Render(const parser::Camera& camera, Image& image,
+						  const std::function<void(const Image&, int)>& onPass = nullptr) const;
+
+private:
+	template <int Size>
+	void TracePrimary(const Ray* rays, int count, HitRecord* recs, bool* hits) const;
+
+	bool Hit(const Ray& ray, HitRecord& rec) const;
+	void FillHitRecord(const Ray& ray, float t, int primitiveIndex, HitRecord& rec) const;
+	Vec3 Shade(const Ray& ray, const HitRecord& rec, int depth, uint64_t& rayCount) const;
+
+	CpuRenderOptions m_Options;
+	BasicCpuScene<Real> m_Scene;
+	std::vector<GPU::BVHNode> m_FlatBVH;
+	std::vector<GPU::Primitive> m_Primitives;
+	LeafBlocks<kTriangleBlockWidth> m_LeafBlocks;
+};
+
+using CpuRenderer = BasicCpuRenderer<float>;
+
+// Renders every camera of the global scene to its ImageName and prints the
+// time and ray throughput of each, and how busy every thread was. With
+// progressive passes the image is also written after each coarse pass.
+void RenderSceneCameras(const CpuRenderOptions& options = CpuRenderOptions());
+
+// Traces the primary rays of every camera of the global scene through the
+// same BVH one at a time, one at a time with triangle blocks, one at a time
+// through 4 and 8-wide nodes, and in packets of 4, 8 and 16 on one thread,
+// and prints the throughput of each along with the rays whose hits differ
+// from the single ray ones.
+void BenchmarkPacketTracing(int iterations);
+
+// Renders every camera of the global scene in float and in double precision
+// and prints the time of each and how far apart the images are.
+void ComparePrecision(const CpuRenderOptions& options = CpuRenderOptions());
+
+#endif // !CPU_RENDERER_H
@@ -0,0 +1,85 @@
+#ifndef CPU_SCENE_H
+#define CPU_SCENE_H
+
+#include "BVHBuilder.h"
+#include "GPUStructs.h"
+#include "Hittable.h"
+#include "Parser.h"
+#include <memory>
+#include <vector>
+
+template <typename Real>
+struct SphereData
+{
+	BasicVec3<Real> center;
+	Real radius;
+	int materialId;
+};
+
+template <typename Real>
+struct TriangleData
+{
+	BasicVec3<Real> vertices[3];
+	int materialId;
+};
+
+// The CPU side of a scene as plain arrays: one per primitive type, and a
+// flattened BVH whose leaves cover ranges of primitive handles. A handle is
+// the index into the array of its type shifted left once, with the type in
+// the low bit, so a leaf dispatches on the tag instead of a virtual call.
+// Hits are the same as those of the Hittable classes over the same scene.
+template <typename Real>
+class BasicCpuScene
+{
+public:
+	enum PrimitiveType
+	{
+		SphereType = 0,
+		TriangleType = 1
+	};
+
+	BasicCpuScene() = default;
+
+	// Copies the spheres, triangles and mesh faces of the scene, in the
+	// order of ExtractPrimitives, and builds the BVH over them.
+	explicit BasicCpuScene(const parser::Scene& scene, const BVHBuildOptions& options = BVHBuildOptions());
+
+	// Closest hit within ray_t, visiting the nearer child of every node
+	// first and skipping nodes behind the closest hit so far.
+	bool Hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec) const;
+
+	BasicAABB<Real> GetBounds() const;
+	bool Empty() const { return m_Nodes.empty(); }
+
+	const std::vector<SphereData<Real>>& GetSpheres() const { return m_Spheres; }
+	const std::vector<TriangleData<Real>>& GetTriangles() const { return m_Triangles; }
+
+private:
+	std::vector<SphereData<Real>> m_Spheres;
+	std::vector<TriangleData<Real>> m_Triangles;
+	std::vector<int> m_Handles;
+	std::vector<GPU::BVHNode> m_Nodes;
+};
+
+// Hittable view of a CpuScene, for code written against the Hittable API.
+template <typename Real>
+class BasicSceneHittable : public BasicHittable<Real>
+{
+public:
+	explicit BasicSceneHittable(std::shared_ptr<const BasicCpuScene<Real>> scene) : m_Scene(std::move(scene)) {}
+
+	bool hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec) const override
+	{
+		return m_Scene->Hit(ray, ray_t, rec);
+	}
+
+	BasicAABB<Real> getAABB() const override { return m_Scene->GetBounds(); }
+
+private:
+	std::shared_ptr<const BasicCpuScene<Real>> m_Scene;
+};
+
+using CpuScene = BasicCpuScene<float>;
+using SceneHittable = BasicSceneHittable<float>;
+
+#endif // !CPU_SCENE_H
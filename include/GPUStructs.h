@@ -2,14 +2,61 @@
 #include <glm/glm.hpp>
 
 namespace GPU {
+//	Leaves have primitiveCount > 0 and reference the primitives
+//	[primitiveOffset, primitiveOffset + primitiveCount), internal nodes have
+//	primitiveCount == 0.
 struct BVHNode
 {
 	glm::vec3 minBounds;
 	int leftChild;
 	glm::vec3 maxBounds;
 	int rightChild;
-	int primitiveIndex;
-	float pad[3];
+	int primitiveOffset;
+	int primitiveCount;
+	float pad[2];
+};
+
+//	32 byte node for depth first ordered trees. The first child of an inner
+//	node is the next node, data holds the index of the second child. For
+//	leaves data is the primitive offset. info packs the primitive count
+//	(bits 3..31, 0 for inner nodes), the split axis (bits 0..1) and whether
+//	the first child lies on the positive side of it (bit 2), which tells the
+//	traversal which child is nearer along the ray.
+struct CompactBVHNode
+{
+	glm::vec3 minBounds;
+	int data;
+	glm::vec3 maxBounds;
+	int info;
+};
+
+//	Node of a 4 or 8 wide BVH, children stored as structure of arrays so that
+//	all child boxes are tested in one SIMD pass. For every child slot,
+//	count > 0 marks a leaf of count primitives starting at child, count == 0
+//	an inner node with index child and count == -1 an empty slot.
+template <int Width>
+struct alignas(16) WideBVHNode
+{
+	float minX[Width];
+	float minY[Width];
+	float minZ[Width];
+	float maxX[Width];
+	float maxY[Width];
+	float maxZ[Width];
+	int child[Width];
+	int count[Width];
+};
+
+//	Placement of a bottom level BVH in the scene. Rays are moved into object
+//	space with worldToObject and normals are brought back with its transpose.
+//	blasRoot is the root node of the bottom level tree, materialId replaces
+//	the material of its primitives unless it is 0.
+struct Instance
+{
+	glm::mat4 worldToObject;
+	int blasRoot;
+	int materialId;
+	float pad[2];
 };
 
 //	For Triangle:
@@ -28,6 +75,35 @@ struct Primitive
 	float pad[2];
 };
 
+//	Primitive as three indices into a vec4 vertex buffer shared by all
+//	triangles, 16 bytes instead of the 64 of Primitive. A sphere has
+//	v1 == -1, v0 is its center and the w of that vertex its radius.
+struct IndexedPrimitive
+{
+	int v0;
+	int v1;
+	int v2;
+	int materialId;
+};
+
+//	Triangle with the two edges of Moller-Trumbore precomputed, so the shader
+//	subtracts nothing. v0.w holds the bits of the material id, e1.w is 1 for
+//	a sphere centered at v0 with radius e1.x.
+struct EdgePrimitive
+{
+	glm::vec4 v0;
+	glm::vec4 e1;
+	glm::vec4 e2;
+};
+
+//	Sphere kept apart from the triangles, half the size of a Primitive.
+//	centerRadius.xyz is the center and centerRadius.w the radius.
+struct SpherePrimitive
+{
+	glm::vec4 centerRadius;
+	int materialId;
+	int pad[3];
+};
 
 struct Material
 {
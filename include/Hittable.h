@@ -5,21 +5,26 @@
 #include "interval.h"
 #include "aabb.h"
 
-struct HitRecord
+template <typename Real>
+struct BasicHitRecord
 {
-	Vec3 p;
-	Vec3 normal;
-	double t;
+	BasicVec3<Real> p;
+	BasicVec3<Real> normal;
+	Real t;
 	int material_id;
 };
 
-class Hittable {
+template <typename Real>
+class BasicHittable {
 public:
 
-	virtual ~Hittable() = default;
+	virtual ~BasicHittable() = default;
 
-	virtual bool hit(const Ray& ray, Interval ray_t, HitRecord& rec) const = 0;
-	virtual AABB getAABB() const = 0;
+	virtual bool hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec) const = 0;
+	virtual BasicAABB<Real> getAABB() const = 0;
 
 };
+
+using HitRecord = BasicHitRecord<float>;
+using Hittable = BasicHittable<float>;
 #endif // !HITTABLE_H
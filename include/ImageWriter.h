@@ -0,0 +1,25 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8 bit RGB image, rows from top to bottom.
+struct Image
+{
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+// Binary PPM (P6).
+bool WritePPM(const std::string& filepath, const Image& image);
+
+// PNG with stored deflate blocks, so no compression library is needed.
+bool WritePNG(const std::string& filepath, const Image& image);
+
+// PNG for a .png extension, PPM otherwise. Returns false if the file could not be written.
+bool WriteImage(const std::string& filepath, const Image& image);
+
+#endif // !IMAGE_WRITER_H
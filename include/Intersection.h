@@ -0,0 +1,98 @@
+#ifndef INTERSECTION_H
+#define INTERSECTION_H
+
+#include "Hittable.h"
+#include <cmath>
+
+// Ray tests of the CPU primitives, shared by the Hittable classes and the
+// flat CpuScene so that both find exactly the same hits.
+
+template <typename Real>
+inline Real Determinant(const BasicVec3<Real>& c0, const BasicVec3<Real>& c1, const BasicVec3<Real>& c2)
+{
+	Real temp1 = c0.x *
+		(c1.y * c2.z - c1.z * c2.y);
+
+	Real temp2 = c1.x *
+		(c0.y * c2.z - c0.z * c2.y);
+
+	Real temp3 = c2.x *
+		(c0.y * c1.z - c0.z * c1.y);
+
+	return temp1 - temp2 + temp3;
+}
+
+// Nearest hit in front of the origin, regardless of ray_t.
+template <typename Real>
+inline bool HitSphere(const BasicVec3<Real>& center, Real radius, int materialId, const BasicRay<Real>& ray,
+					  BasicHitRecord<Real>& rec)
+{
+	BasicVec3<Real> oc = ray.origin - center;
+	Real a = ray.direction.dot(ray.direction);
+	Real b = oc.dot(ray.direction);
+	Real c = oc.dot(oc) - radius * radius;
+	Real discriminant = b * b - a * c;
+
+	// Intersection occurs
+	if (discriminant >= 0) {
+		Real t1 = (-b - std::sqrt(discriminant)) / a;
+		Real t2 = (-b + std::sqrt(discriminant)) / a;
+
+		if (t1 >= 0 || t2 >= 0) {
+			Real t = (t1 >= 0) ? t1 : t2;
+
+			BasicVec3<Real> hitPoint = ray.origin + ray.direction * t;
+			BasicVec3<Real> normal = (hitPoint - center).normalize();
+
+			rec.t = t;
+			rec.p = hitPoint;
+			rec.normal = normal;
+			rec.material_id = materialId;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Cramer's rule on the barycentric system, hits within 0.0001 of either end
+// of ray_t are rejected.
+template <typename Real>
+inline bool HitTriangle(const BasicVec3<Real> vertices[3], int materialId, const BasicRay<Real>& ray,
+						BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec)
+{
+	BasicVec3<Real> c1 = vertices[0] - vertices[1];
+	BasicVec3<Real> c2 = vertices[0] - vertices[2];
+	BasicVec3<Real> c3 = ray.direction;
+	Real detA = Determinant(c1, c2, c3);
+	if (detA == 0) return false;
+
+	c1 = vertices[0] - ray.origin;
+	Real beta = Determinant(c1, c2, c3) / detA;
+
+	c2 = c1;
+	c1 = vertices[0] - vertices[1];
+	Real gamma = Determinant(c1, c2, c3) / detA;
+
+	c3 = c2;
+	c2 = vertices[0] - vertices[2];
+	Real t = Determinant(c1, c2, c3) / detA;
+
+	if (t < ray_t.min + 0.0001|| 0.0001 + t > ray_t.max) return false;
+
+	if (beta + gamma <= 1 && beta + 0.00001 >= 0 && gamma + 0.00001 >= 0)
+	{
+		BasicVec3<Real> vec1 = vertices[1] - vertices[0];
+		BasicVec3<Real> vec2 = vertices[2] - vertices[0];
+		vec1 = vec1.cross(vec2);
+		vec1.normalize();
+
+		rec.t = t;
+		rec.normal = vec1;
+		rec.p = ray.origin + ray.direction * t;
+		rec.material_id = materialId;
+		return true;
+	}
+	return false;
+}
+
+#endif // !INTERSECTION_H
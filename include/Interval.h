@@ -2,18 +2,20 @@
 #include <cmath>
 #include <algorithm>
 
-class Interval {
+template <typename Real>
+class BasicInterval {
 public:
-	double min, max;
+	Real min, max;
 
-	Interval() : min(INFINITY), max(-INFINITY) {};
-	Interval(double _min, double _max) : min(_min), max(_max) {}
-	Interval(Interval _i0, Interval _i1) : min(std::min(_i0.min, _i1.min)), max(std::max(_i0.max, _i1.max)) {}
+	BasicInterval() : min(INFINITY), max(-INFINITY) {};
+	BasicInterval(Real _min, Real _max) : min(_min), max(_max) {}
+	BasicInterval(BasicInterval _i0, BasicInterval _i1) : min(std::min(_i0.min, _i1.min)), max(std::max(_i0.max, _i1.max)) {}
 
 	const void thicken();
-	inline Interval merge(const Interval& _other) const;
-	inline bool overlap(const Interval& _other) const;
-	inline bool consists(const double& point) const;
-	inline double getLength() const;
+	BasicInterval merge(const BasicInterval& _other) const;
+	bool overlap(const BasicInterval& _other) const;
+	bool consists(const Real& point) const;
+	Real getLength() const;
 };
 
+using Interval = BasicInterval<float>;
@@ -0,0 +1,31 @@
+#ifndef LBVH_H
+#define LBVH_H
+
+#include "GPUStructs.h"
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Linear BVH: primitives are sorted along a Morton curve over their centroids
+// and the hierarchy is read off the sorted codes. Much faster to build than the
+// SAH BVHNode tree, at the cost of tree quality.
+struct LBVHBuildOptions
+{
+	bool use64BitCodes = false;       // 63-bit codes (21 bits per axis) instead of 30-bit
+	int maxLeafSize = 4;              // ranges up to this size become a single leaf
+	ThreadPool* threadPool = nullptr; // builds serially when null
+	int grainSize = 4096;             // primitives per parallel chunk or subtree task
+};
+
+// Builds the tree straight into the flat GPU layout. Output nodes are in depth
+// first order and primitives are reordered so that leaves follow the curve.
+// When primitiveIndices is given it receives the input index of every output primitive.
+void BuildLBVH(const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& flatBVH,
+			   std::vector<GPU::Primitive>& primitives, const LBVHBuildOptions& options = LBVHBuildOptions(),
+			   std::vector<int>* primitiveIndices = nullptr);
+
+// Interleaves the bits of a point normalized to [0, 1], 30 bits or 63 bits.
+uint64_t MortonCode(const glm::vec3& p, bool use64BitCodes = false);
+
+#endif // !LBVH_H
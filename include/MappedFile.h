@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read only memory mapping of a whole file. The pages are loaded by the OS on
+// first access, so opening a large file costs nothing until it is read.
+class MappedFile
+{
+public:
+	MappedFile();
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	// Maps path, closing any previous mapping. Returns false if the file
+	// cannot be opened; an empty file opens with a null data pointer.
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return m_Open; }
+	const uint8_t* GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8_t* m_Data;
+	size_t m_Size;
+	bool m_Open;
+#ifdef _WIN32
+	void* m_File;
+	void* m_Mapping;
+#endif
+};
+
+#endif // !MAPPED_FILE_H
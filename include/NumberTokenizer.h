@@ -0,0 +1,37 @@
+#ifndef NUMBER_TOKENIZER_H
+#define NUMBER_TOKENIZER_H
+
+#include <cstddef>
+
+// Counts the whitespace separated tokens in [begin, end), sixteen bytes at a
+// time where SSE2 is available. Any byte up to ' ' counts as whitespace.
+size_t CountTokens(const char* begin, const char* end);
+
+// Reads whitespace separated numbers straight out of a text buffer with
+// std::from_chars, without copying it. Meant for the text of XML elements,
+// which tinyxml2 already holds in memory; a null text reads as empty.
+class NumberTokenizer
+{
+public:
+	explicit NumberTokenizer(const char* text);
+	NumberTokenizer(const char* begin, const char* end);
+
+	// Parse the next token. They return false at the end of the text and on
+	// a token that is not a number, leaving value untouched.
+	bool Next(float& value);
+	bool Next(int& value);
+
+	// True once only whitespace is left.
+	bool AtEnd();
+
+	// Tokens left, used to size the output before parsing.
+	size_t CountRemaining() const { return CountTokens(m_Cursor, m_End); }
+
+private:
+	const char* skipWhitespace();
+
+	const char* m_Cursor;
+	const char* m_End;
+};
+
+#endif // !NUMBER_TOKENIZER_H
@@ -5,6 +5,8 @@
 #include <vector>
 #include "GPUStructs.h"
 
+class ThreadPool;
+
 namespace parser
 {
     struct Vec3f
@@ -22,6 +24,17 @@ namespace parser
         float x, y, z, w;
     };
 
+    struct Camera
+    {
+        Vec3f position;
+        Vec3f gaze;
+        Vec3f up;
+        Vec4f near_plane; // left, right, bottom, top
+        float near_distance;
+        int image_width, image_height;
+        std::string image_name;
+    };
+
     struct PointLight
     {
         Vec3f position;
@@ -66,10 +79,21 @@ namespace parser
 
     struct Scene
     {
-        void loadFromXml(const std::string &filepath);
+        // Loads an .rtscene file, or an XML scene with either XML loader.
+        void load(const std::string &filepath, bool streamXml = false, ThreadPool* threadPool = nullptr);
+        // A Mesh may take its faces from <Faces plyFile="path"/>, a PLY file
+        // relative to the scene. These files are loaded on threadPool when given.
+        void loadFromXml(const std::string &filepath, ThreadPool* threadPool = nullptr);
+        // Reads the same schema without building an XML DOM, so that peak
+        // memory follows the size of the scene arrays rather than of the file.
+        void loadFromXmlStream(const std::string &filepath, ThreadPool* threadPool = nullptr);
+        // Binary .rtscene files, see BinaryScene.h.
+        void loadFromBinary(const std::string &filepath);
+        void saveToBinary(const std::string &filepath) const;
         Vec3i background_color;
         float shadow_ray_epsilon;
         int max_recursion_depth;
+        std::vector<Camera> cameras;
         Vec3f ambient_light;
         std::vector<PointLight> point_lights;
         std::vector<Material> materials;
@@ -0,0 +1,38 @@
+#ifndef PLY_LOADER_H
+#define PLY_LOADER_H
+
+#include "Parser.h"
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Triangle mesh read from a PLY file, face indices are zero based.
+struct PlyMesh
+{
+	std::vector<parser::Vec3f> vertices;
+	std::vector<parser::Face> faces;
+};
+
+// Reads an ascii, binary_little_endian or binary_big_endian PLY file through
+// a memory mapping. Only x, y and z of the vertex element and the
+// vertex_indices (or vertex_index) list of the face element are kept,
+// polygons are split into triangle fans. Throws std::runtime_error.
+void LoadPly(const std::string& filepath, PlyMesh& mesh);
+
+// Mesh of the scene whose faces come from a PLY file.
+struct PlyReference
+{
+	size_t meshIndex;
+	std::string filepath;
+};
+
+// Loads the referenced files, one task each when a pool is given, then
+// appends them in order: vertices at the end of scene.vertex_data and faces
+// to their mesh, renumbered to the one based ids of the scene.
+void LoadPlyMeshes(parser::Scene& scene, const std::vector<PlyReference>& references, ThreadPool* threadPool = nullptr);
+
+// Path of a file referenced by a scene, relative to the scene file.
+std::string ResolveScenePath(const std::string& scenePath, const std::string& reference);
+
+#endif // !PLY_LOADER_H
@@ -3,15 +3,18 @@
 
 #include "vec3.h"
 
-class Ray {
+template <typename Real>
+class BasicRay {
 public:
-	Vec3 origin;
-	Vec3 direction;
+	BasicVec3<Real> origin;
+	BasicVec3<Real> direction;
 
-	Ray() {}
-	Ray(const Vec3& _origin, const Vec3& _direction) : origin(_origin), direction(_direction) 
+	BasicRay() {}
+	BasicRay(const BasicVec3<Real>& _origin, const BasicVec3<Real>& _direction) : origin(_origin), direction(_direction) 
 	{
 		direction.normalize();
 	}
 };
+
+using Ray = BasicRay<float>;
 #endif // !RAY_H
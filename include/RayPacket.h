@@ -0,0 +1,47 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "GPUStructs.h"
+#include "TriangleBlock.h"
+#include "WideBVH.h"
+#include <vector>
+
+// Size rays stored as structure of arrays, directions normalized. On input
+// t holds the farthest distance each ray may hit; lanes with a negative t are
+// unused. On output t and primitiveIndex hold the closest hit, primitiveIndex
+// is -1 for rays that hit nothing.
+template <int Size>
+struct alignas(32) RayPacket
+{
+	float originX[Size];
+	float originY[Size];
+	float originZ[Size];
+	float directionX[Size];
+	float directionY[Size];
+	float directionZ[Size];
+	float t[Size];
+	int primitiveIndex[Size];
+};
+
+// Traces a packet of 4, 8 or 16 coherent rays through a flattened binary BVH,
+// visiting every node once for all of them. When the directions of the packet
+// agree in sign, its rays are bounded by a frustum that culls whole nodes
+// with one interval test; otherwise, and for nodes the frustum does not cull,
+// the rays still active are tested in SSE or AVX steps and only those that
+// hit go on to the children.
+template <int Size>
+void TracePacket(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+				 RayPacket<Size>& packet);
+
+// Single ray version over the same tree, for rays that share no path with
+// their neighbours such as shadow and mirror rays.
+bool TraceBVH(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+			  const glm::vec3& origin, const glm::vec3& direction, TraceResult& result, float tMax = INFINITY);
+
+// Same traversal with the triangles of every leaf tested a block at a time.
+template <int Width>
+bool TraceBVH(const std::vector<GPU::BVHNode>& flatBVH, const LeafBlocks<Width>& leafBlocks,
+			  const std::vector<GPU::Primitive>& primitives, const glm::vec3& origin, const glm::vec3& direction,
+			  TraceResult& result, float tMax = INFINITY);
+
+#endif // !RAY_PACKET_H
@@ -0,0 +1,29 @@
+#ifndef SBVH_H
+#define SBVH_H
+
+#include "BVHBuilder.h"
+#include "GPUStructs.h"
+#include <vector>
+
+// Spatial split BVH (Stich et al. 2009). Besides the binned object splits of
+// BVHBuilder, a node may be cut by a plane that also cuts primitives: those
+// are referenced from both children with their bounds clipped to each side.
+// Long thin triangles then stop inflating every node they pass through, at
+// the cost of some duplicated references.
+struct SBVHBuildOptions
+{
+	BVHBuildOptions sah;            // bins, costs and leaf size; the build itself is serial
+	int spatialBinCount = 32;       // slabs evaluated along each axis for spatial splits
+	float splitAlpha = 1e-5f;       // overlap of the object split children, relative to the root area, that makes spatial splits worth trying
+	float referenceBudget = 0.3f;   // extra references allowed, as a fraction of the input primitives
+	int maxSpatialDepth = 48;       // no spatial splits below this depth
+};
+
+// Builds straight into the flat GPU layout like BuildLBVH. A primitive split
+// across several leaves is written once per leaf, so primitives may be longer
+// than input. Returns the number of extra references that were created.
+int BuildSBVH(const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& flatBVH,
+			  std::vector<GPU::Primitive>& primitives, const SBVHBuildOptions& options = SBVHBuildOptions(),
+			  std::vector<int>* primitiveIndices = nullptr);
+
+#endif // !SBVH_H
@@ -9,7 +9,11 @@ enum SSBOBindingPoints
 	BVHNodes = 2,
 	Primitives = 3,
 	Materials = 4,
-	Lights = 5
+	Lights = 5,
+	TLASNodes = 6,
+	Instances = 7,
+	Vertices = 8,
+	Spheres = 9
 };
 
 class SSBO
@@ -0,0 +1,68 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 64 bit FNV-1a style hash, eight bytes per step. Chain calls through seed.
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+// Hashes the contents of a file, returns false if it cannot be read.
+bool HashFile(const std::string& path, uint64_t& hash);
+
+// Hashes a scene file together with the PLY files its meshes reference.
+bool HashSceneFiles(const std::string& scenePath, uint64_t& hash);
+
+// Buffer stored in a cache entry, pointing into the mapped file when loaded.
+struct SceneCacheBuffer
+{
+	std::string name;
+	uint32_t bindingPoint;
+	const void* data;
+	size_t size;
+};
+
+// On disk cache of the buffers uploaded for a scene, so that a later launch
+// with the same scene and settings skips parsing and building. Each entry is
+// one file named after its key, holding a versioned header, the raw buffer
+// contents 64 byte aligned and a table of them at the end. Entries that do
+// not match the version, the key or their own size are ignored.
+class SceneCache
+{
+public:
+	// An empty directory disables the cache.
+	explicit SceneCache(const std::string& directory = "");
+
+	bool IsEnabled() const { return !m_Directory.empty(); }
+
+	// Maps the entry for key. On success the buffers stay valid until Close.
+	bool Load(uint64_t key);
+	const std::vector<SceneCacheBuffer>& GetBuffers() const { return m_Buffers; }
+	void Close();
+
+	// Writes an entry buffer by buffer: Begin, Add for each buffer, then End.
+	// The entry is written to a temporary file and only renamed into place
+	// by End, so a launch running at the same time never maps half of it.
+	bool BeginStore(uint64_t key);
+	void AddBuffer(const std::string& name, uint32_t bindingPoint, const void* data, size_t size);
+	bool EndStore();
+
+	std::string GetPath(uint64_t key) const;
+
+private:
+	std::string m_Directory;
+	MappedFile m_File;
+	std::vector<SceneCacheBuffer> m_Buffers;
+
+	std::ofstream m_Output;
+	std::string m_OutputPath;
+	uint64_t m_OutputKey;
+	std::vector<SceneCacheBuffer> m_Written; // data is not kept, offsets are in m_WrittenOffsets
+	std::vector<uint64_t> m_WrittenOffsets;
+};
+
+#endif // !SCENE_CACHE_H
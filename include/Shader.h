@@ -3,6 +3,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 #include <GL/glew.h>
 #include "glm/glm.hpp"
 
@@ -13,6 +14,7 @@ public:
 
 	Shader();
 	Shader(const char* vertexPath, const char* fragmentPath);
+	Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines);
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath);
 	Shader(const Shader&) = delete;
 	Shader(Shader&&) = delete;
@@ -20,7 +22,7 @@ public:
 	Shader& operator=(Shader&&) = delete;
 	~Shader();
 	void Use();
-	void Load(const char* vertexPath, const char* fragmentPath);
+	void Load(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
 
 
 	// Uniform setters
@@ -33,4 +35,5 @@ public:
 
 private:
 	void checkCompileErrors(GLuint shader, std::string type);
+	static void injectDefines(std::string& code, const std::vector<std::string>& defines);
 };
\ No newline at end of file
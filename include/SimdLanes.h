@@ -0,0 +1,109 @@
+#ifndef SIMD_LANES_H
+#define SIMD_LANES_H
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_LANES_SSE
+#include <immintrin.h>
+#endif
+
+// The handful of operations the kernels need over Width lanes at once, with
+// Mask the result of a comparison. Width 1 is the scalar fallback.
+template <int Width>
+struct Lanes;
+
+template <>
+struct Lanes<1>
+{
+	using Float = float;
+	using Mask = bool;
+	static Float Load(const float* p) { return *p; }
+	static void Store(float* p, Float v) { *p = v; }
+	static Float Set(float v) { return v; }
+	static Float Add(Float a, Float b) { return a + b; }
+	static Float Sub(Float a, Float b) { return a - b; }
+	static Float Mul(Float a, Float b) { return a * b; }
+	static Float Div(Float a, Float b) { return a / b; }
+	static Float Min(Float a, Float b) { return std::min(a, b); }
+	static Float Max(Float a, Float b) { return std::max(a, b); }
+	static Float Sqrt(Float a) { return std::sqrt(a); }
+	static Mask Less(Float a, Float b) { return a < b; }
+	static Mask LessEqual(Float a, Float b) { return a <= b; }
+	static Mask Equal(Float a, Float b) { return a == b; }
+	static Mask And(Mask a, Mask b) { return a && b; }
+	static Mask Or(Mask a, Mask b) { return a || b; }
+	static Float Select(Mask m, Float a, Float b) { return m ? a : b; }
+	static int MoveMask(Mask m) { return m ? 1 : 0; }
+	static float HorizontalMin(Float a) { return a; }
+};
+
+#ifdef SIMD_LANES_SSE
+template <>
+struct Lanes<4>
+{
+	using Float = __m128;
+	using Mask = __m128;
+	static Float Load(const float* p) { return _mm_loadu_ps(p); }
+	static void Store(float* p, Float v) { _mm_storeu_ps(p, v); }
+	static Float Set(float v) { return _mm_set1_ps(v); }
+	static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+	static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+	static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+	static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+	static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+	static Mask Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+	static Mask LessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+	static Mask Equal(Float a, Float b) { return _mm_cmpeq_ps(a, b); }
+	static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+	static Mask Or(Mask a, Mask b) { return _mm_or_ps(a, b); }
+	static Float Select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	static int MoveMask(Mask m) { return _mm_movemask_ps(m); }
+	static float HorizontalMin(Float a)
+	{
+		a = _mm_min_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)));
+		a = _mm_min_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(a);
+	}
+};
+#endif
+
+#ifdef __AVX__
+template <>
+struct Lanes<8>
+{
+	using Float = __m256;
+	using Mask = __m256;
+	static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+	static void Store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+	static Float Set(float v) { return _mm256_set1_ps(v); }
+	static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+	static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+	static Mask Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static Mask LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static Mask Equal(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+	static Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+	static Float Select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); }
+	static int MoveMask(Mask m) { return _mm256_movemask_ps(m); }
+	static float HorizontalMin(Float a)
+	{
+		return Lanes<4>::HorizontalMin(_mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+	}
+};
+constexpr int kMaxLaneWidth = 8;
+#elif defined(SIMD_LANES_SSE)
+constexpr int kMaxLaneWidth = 4;
+#else
+constexpr int kMaxLaneWidth = 1;
+#endif
+
+#endif // !SIMD_LANES_H
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back and steals from the front of the others' deques.
+// The thread count includes the calling thread, which takes part in the work
+// while it waits on a TaskGroup, so a pool of one thread runs everything inline.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_Workers.size()) + 1; }
+
+    void Submit(std::function<void()> task);
+
+    // Runs one queued task on the calling thread, returns false if none was found.
+    bool RunPendingTask();
+
+    // Splits [begin, end) into chunks of grainSize and calls body(chunkBegin, chunkEnd)
+    // for each of them, returning once every chunk is done.
+    void ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body);
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void WorkerLoop(unsigned int index);
+    bool PopTask(unsigned int index, std::function<void()>& task);
+
+    std::vector<std::thread> m_Workers;
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+    std::atomic<unsigned int> m_NextQueue;
+    std::atomic<int> m_QueuedTasks;
+    std::atomic<bool> m_Stop;
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeCondition;
+};
+
+// Fork-join helper: tasks started with Run() are tracked until Wait() returns.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool* pool) : m_Pool(pool), m_Pending(0) {}
+    ~TaskGroup() { Wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void Run(std::function<void()> task);
+    void Wait();
+
+private:
+    ThreadPool* m_Pool;
+    std::atomic<int> m_Pending;
+};
@@ -0,0 +1,70 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+enum class TileOrder
+{
+	Scanline, // row by row
+	Morton,   // Z curve, bits of x and y interleaved
+	Hilbert   // no jumps between consecutive tiles
+};
+
+struct Tile
+{
+	int x0, y0, x1, y1; // pixel bounds, the upper ones exclusive
+};
+
+// Splits a width x height frame into square tiles of tileSize pixels, clipped
+// to the frame, listed in the given order.
+std::vector<Tile> OrderTiles(int width, int height, int tileSize, TileOrder order = TileOrder::Hilbert);
+
+// What one thread of a TileScheduler run did.
+struct TileThreadStats
+{
+	int tiles = 0;            // tiles rendered, stolen ones included
+	int steals = 0;           // times it took half of the deque of another thread
+	double busySeconds = 0.0; // time spent inside the body
+};
+
+// Runs a body over a list of tiles on every thread of a pool. Each thread owns
+// a deque holding a contiguous run of the list, so consecutive tiles of a curve
+// order stay on one thread. The owner takes tiles from the front of its deque,
+// and a thread whose deque is empty steals the back half of the fullest one,
+// the tiles furthest from where its owner is working.
+class TileScheduler
+{
+public:
+	// Without a pool the tiles are rendered in order on the calling thread.
+	explicit TileScheduler(ThreadPool* pool) : m_Pool(pool) {}
+
+	// Calls body(tile, thread) once for every tile in [0, tileCount), thread
+	// being in [0, GetThreadCount()), and returns once all are done along with
+	// the work of each thread. Busy time over the wall time of the run is the
+	// utilization of a thread.
+	std::vector<TileThreadStats> Run(int tileCount, const std::function<void(int, int)>& body);
+
+	unsigned int GetThreadCount() const;
+
+private:
+	// Tiles [front, back) of the list still to be rendered.
+	struct TileDeque
+	{
+		std::mutex mutex;
+		int front = 0;
+		int back = 0;
+	};
+
+	bool TakeOwn(TileDeque& deque, int& tile);
+	bool Steal(unsigned int thief, int& tile);
+
+	ThreadPool* m_Pool;
+	std::vector<std::unique_ptr<TileDeque>> m_Deques;
+};
+
+#endif // !TILE_SCHEDULER_H
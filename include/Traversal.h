@@ -0,0 +1,59 @@
+#ifndef TRAVERSAL_H
+#define TRAVERSAL_H
+
+#include "GPUStructs.h"
+#include <vector>
+
+// Pieces shared by the CPU traversals of flattened binary BVHs.
+
+// Whether to visit the left child first: it is on the side of the split the
+// ray starts from, with the split axis taken as the one along which the child
+// centers are furthest apart. Direction is anything indexable by axis.
+template <typename Direction>
+inline bool LeftChildIsNear(const GPU::BVHNode& left, const GPU::BVHNode& right, const Direction& direction)
+{
+	glm::vec3 offset = (right.minBounds + right.maxBounds) - (left.minBounds + left.maxBounds);
+	glm::vec3 d = glm::abs(offset);
+	int axis = d.x >= d.y && d.x >= d.z ? 0 : (d.y >= d.z ? 1 : 2);
+	return (offset[axis] >= 0.0f) == (direction[axis] >= 0);
+}
+
+// Depth first traversal stack. Entries live in a fixed array, which holds
+// any tree the SAH builders produce, and only those of deeper trees, such as
+// degenerate LBVH or SBVH ones, go to the heap.
+template <typename T, int Capacity = 128>
+class TraversalStack
+{
+public:
+	bool Empty() const { return m_Size == 0; }
+
+	void Push(const T& value)
+	{
+		if (m_Size < Capacity)
+		{
+			m_Fixed[m_Size] = value;
+		}
+		else
+		{
+			m_Overflow.push_back(value);
+		}
+		m_Size++;
+	}
+
+	T Pop()
+	{
+		m_Size--;
+		if (m_Size < Capacity) return m_Fixed[m_Size];
+
+		T value = m_Overflow.back();
+		m_Overflow.pop_back();
+		return value;
+	}
+
+private:
+	T m_Fixed[Capacity];
+	std::vector<T> m_Overflow;
+	int m_Size = 0;
+};
+
+#endif // !TRAVERSAL_H
@@ -0,0 +1,58 @@
+#ifndef TRIANGLE_BLOCK_H
+#define TRIANGLE_BLOCK_H
+
+#include "GPUStructs.h"
+#include "WideBVH.h"
+#include <vector>
+
+// Block width of the CPU kernels: one AVX register, or two SSE ones.
+#ifdef __AVX__
+constexpr int kTriangleBlockWidth = 8;
+#else
+constexpr int kTriangleBlockWidth = 4;
+#endif
+
+// Width triangles of a leaf as structure of arrays, in the form the
+// Moller-Trumbore test uses: the first vertex and the two edges leaving it.
+// Unused slots have zero edges and primitiveIndex -1, which the test rejects.
+template <int Width>
+struct alignas(32) TriangleBlock
+{
+	float v0[3][Width];
+	float e1[3][Width];
+	float e2[3][Width];
+	int primitiveIndex[Width];
+};
+
+// Where the triangles and spheres of a leaf live in LeafBlocks.
+struct LeafBlockRange
+{
+	int firstBlock;
+	int blockCount;
+	int firstSphere;
+	int sphereCount;
+};
+
+// The triangles of every leaf of a flattened BVH packed into blocks, with
+// the spheres left to the single primitive test. Ranges are indexed like the
+// nodes; inner nodes have empty ones.
+template <int Width>
+struct LeafBlocks
+{
+	std::vector<TriangleBlock<Width>> blocks;
+	std::vector<LeafBlockRange> ranges;
+	std::vector<int> sphereIndices;
+};
+
+template <int Width>
+void BuildLeafBlocks(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+					 LeafBlocks<Width>& leafBlocks);
+
+// Intersects a normalized ray with all triangles of a block in one pass and
+// keeps the closest hit nearer than result.t, the lowest slot winning ties so
+// that hits match IntersectPrimitive over the same triangles in order.
+template <int Width>
+bool IntersectTriangleBlock(const TriangleBlock<Width>& block, const glm::vec3& origin, const glm::vec3& direction,
+							TraceResult& result);
+
+#endif // !TRIANGLE_BLOCK_H
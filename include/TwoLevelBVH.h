@@ -0,0 +1,70 @@
+#ifndef TWO_LEVEL_BVH_H
+#define TWO_LEVEL_BVH_H
+
+#include "BVHBuilder.h"
+#include "GPUStructs.h"
+#include "Parser.h"
+#include "WideBVH.h"
+#include <vector>
+
+struct TwoLevelBVHOptions
+{
+	BVHBuildOptions blasOptions;    // per unique mesh
+	BVHBuildOptions tlasOptions;    // over instance bounds
+	float instanceTolerance = 1e-4f; // largest vertex error, relative to the mesh size, of an instance transform
+};
+
+// Two level acceleration structure. Meshes with the same faces whose vertices
+// are an affine transform of an earlier mesh become instances of it, so each
+// unique mesh gets one bottom level BVH (BLAS). Spheres and loose triangles
+// share one more BLAS placed with the identity. A top level BVH (TLAS) over
+// the world bounds of all instances ties them together.
+//
+// All BLAS nodes and primitives live in one node and one primitive array, in
+// the same layout FlattenBVH produces, and every GPU::Instance points at the
+// root of its BLAS. Moving an instance only needs BuildTLAS(), which is linear
+// in the number of instances.
+class TwoLevelBVH
+{
+public:
+	explicit TwoLevelBVH(const TwoLevelBVHOptions& options = TwoLevelBVHOptions());
+
+	void Build(const parser::Scene& scene);
+
+	// Moves an instance, indices follow scene.meshes with the loose primitives last.
+	void SetTransform(int instance, const glm::mat4& objectToWorld);
+	const glm::mat4& GetTransform(int instance) const { return m_ObjectToWorld[instance]; }
+
+	// Rebuilds the top level tree after instances moved.
+	void BuildTLAS();
+
+	// Closest hit along a normalized world space ray. instanceIndex receives the
+	// position of the hit instance in GetInstances() when given.
+	bool Trace(const glm::vec3& origin, const glm::vec3& direction, TraceResult& result, int* instanceIndex = nullptr) const;
+
+	const std::vector<GPU::BVHNode>& GetBLASNodes() const { return m_BLASNodes; }
+	const std::vector<GPU::Primitive>& GetPrimitives() const { return m_Primitives; }
+	const std::vector<GPU::BVHNode>& GetTLASNodes() const { return m_TLASNodes; }
+	const std::vector<GPU::Instance>& GetInstances() const { return m_Instances; }
+
+	int GetInstanceCount() const { return static_cast<int>(m_ObjectToWorld.size()); }
+	int GetBLASCount() const { return static_cast<int>(m_BLASRoots.size()); }
+
+private:
+	TwoLevelBVHOptions m_Options;
+
+	std::vector<GPU::BVHNode> m_BLASNodes;
+	std::vector<GPU::Primitive> m_Primitives;
+	std::vector<int> m_BLASRoots;
+
+	// Per instance, in scene order
+	std::vector<int> m_InstanceBLAS;
+	std::vector<int> m_InstanceMaterial;
+	std::vector<glm::mat4> m_ObjectToWorld;
+
+	// Per instance, in TLAS leaf order
+	std::vector<GPU::BVHNode> m_TLASNodes;
+	std::vector<GPU::Instance> m_Instances;
+};
+
+#endif // !TWO_LEVEL_BVH_H
@@ -7,6 +7,43 @@
 void FlattenBVH(std::shared_ptr<Hittable> root, std::vector<GPU::BVHNode>& flatBVH, 
 				std::vector<GPU::Primitive>& primitives);
 
+// Same as above, emitting 32 byte nodes in depth first order.
+void FlattenBVH(std::shared_ptr<Hittable> root, std::vector<GPU::CompactBVHNode>& compactBVH,
+				std::vector<GPU::Primitive>& primitives);
+
+// Converts primitives, keeping their order, into index triples over a vertex
+// buffer in which every distinct vertex is stored once.
+void IndexPrimitives(const std::vector<GPU::Primitive>& primitives, std::vector<glm::vec4>& vertices,
+					 std::vector<GPU::IndexedPrimitive>& indexed);
+
+// Converts primitives, keeping their order, into the precomputed edge format.
+void EdgePrimitives(const std::vector<GPU::Primitive>& primitives, std::vector<GPU::EdgePrimitive>& edges);
+
+// Moves the spheres of a flattened tree into their own buffer, keeping the
+// triangles in the order of the leaves. Every leaf afterwards holds a single
+// kind: leaves mixing both become an inner node over two leaves appended at
+// the end of flatBVH, and sphere leaves store the bitwise complement of their
+// offset into spheres, which is always negative.
+void SegregateSpheres(std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+					  std::vector<GPU::Primitive>& triangles, std::vector<GPU::SpherePrimitive>& spheres);
+
+// Converts a flattened tree into 32 byte nodes in depth first order. The split
+// axis of a node is the axis along which its children's centers are furthest apart.
+void CompactBVH(const std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::CompactBVHNode>& compactBVH);
+
+// Converts scene spheres, triangles and mesh faces into GPU primitives, in the
+// same order App::Run builds its Hittable objects.
+void ExtractPrimitives(std::vector<GPU::Primitive>& primitives, parser::Scene& scene);
+
+// Bounds of a single GPU primitive, thickened like AABB so flat triangles stay hittable.
+void GetPrimitiveBounds(const GPU::Primitive& primitive, glm::vec3& minBounds, glm::vec3& maxBounds);
+
+// CPU version of Hit in rt.frag, returns the distance along a normalized direction.
+bool IntersectPrimitive(const GPU::Primitive& primitive, const glm::vec3& origin, const glm::vec3& direction, float& t);
+
+// Expected cost of a ray traversing the flattened tree, following the surface area heuristic.
+float ComputeSAHCost(const std::vector<GPU::BVHNode>& flatBVH, float traversalCost = 1.0f, float leafCost = 1.0f);
+
 void ExtractMaterials(std::vector<GPU::Material>& materials, parser::Scene& scene);
 
 void ExtractLights(std::vector<GPU::Light>& lights, parser::Scene& scene);
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "GPUStructs.h"
+#include <vector>
+
+// Closest hit found by the CPU traversal kernels.
+struct TraceResult
+{
+	float t;
+	int primitiveIndex;
+};
+
+// Collapses a flattened binary BVH into a Width-ary one by repeatedly opening
+// the child with the largest surface area. Primitive ranges are kept, so the
+// wide tree uses the same primitive array. Width is 4 or 8.
+template <int Width>
+void CollapseBVH(const std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::WideBVHNode<Width>>& wideBVH);
+
+// Finds the closest hit along a normalized ray. All child boxes of a node are
+// tested in one SSE (Width 4) or AVX (Width 8) pass when the target supports it.
+template <int Width>
+bool TraceWideBVH(const std::vector<GPU::WideBVHNode<Width>>& wideBVH, const std::vector<GPU::Primitive>& primitives,
+				  const glm::vec3& origin, const glm::vec3& direction, TraceResult& result);
+
+#endif // !WIDE_BVH_H
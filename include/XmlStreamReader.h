@@ -0,0 +1,67 @@
+#ifndef XML_STREAM_READER_H
+#define XML_STREAM_READER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Pull parser that reads an XML file through a fixed size window instead of
+// loading it into a DOM. Only what the scene files need is supported:
+// elements, attributes, text, and skipped comments, declarations and CDATA.
+// Entities are passed through undecoded.
+class XmlStreamReader
+{
+public:
+	enum class Event
+	{
+		StartElement,
+		EndElement,  // also sent right after the start of a self closing element
+		Text,        // one piece of the text of an element, see GetText
+		EndOfFile
+	};
+
+	explicit XmlStreamReader(const std::string& path, size_t windowSize = 64 * 1024);
+	~XmlStreamReader();
+
+	XmlStreamReader(const XmlStreamReader&) = delete;
+	XmlStreamReader& operator=(const XmlStreamReader&) = delete;
+
+	bool IsOpen() const { return m_File != nullptr; }
+
+	// Advances to the next event. Throws std::runtime_error on malformed markup.
+	Event Next();
+
+	// Name of the element of the last StartElement or EndElement.
+	const std::string& GetName() const { return m_Name; }
+
+	// Attribute of the element of the last StartElement, null if it has none by that name.
+	const char* GetAttribute(const char* name) const;
+
+	// Text of the last Text event, valid until the next call to Next. A long
+	// text arrives in several pieces that are only ever cut at whitespace, so
+	// no token is split between two of them. Whitespace only text is skipped.
+	const char* GetTextBegin() const { return m_TextBegin; }
+	const char* GetTextEnd() const { return m_TextEnd; }
+
+private:
+	bool fill();
+	bool ensure(size_t count);
+	size_t find(const char* pattern);
+	void readTag();
+
+	FILE* m_File;
+	std::vector<char> m_Window;
+	size_t m_Begin;  // first unconsumed byte
+	size_t m_End;    // end of the bytes read so far
+	bool m_FileDone;
+
+	std::string m_Name;
+	std::vector<std::pair<std::string, std::string>> m_Attributes;
+	bool m_PendingEnd;
+	const char* m_TextBegin;
+	const char* m_TextEnd;
+};
+
+#endif // !XML_STREAM_READER_H
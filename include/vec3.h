@@ -5,66 +5,72 @@
 #include <cmath>
 #include <glm/glm.hpp>
 
-class Vec3 {
+// Real is float for tracing, the precision of the scene data and the GPU, or
+// double to validate float results against.
+template <typename Real>
+class BasicVec3 {
 public:
-	double x, y, z;
+	Real x, y, z;
 
-	Vec3() : x(0), y(0), z(0) {}
-	Vec3(double _x, double _y, double _z) : x(_x), y(_y), z(_z) {}
-	Vec3(parser::Vec3f _other)
+	BasicVec3() : x(0), y(0), z(0) {}
+	BasicVec3(Real _x, Real _y, Real _z) : x(_x), y(_y), z(_z) {}
+	BasicVec3(parser::Vec3f _other)
 		: x(_other.x), y(_other.y), z(_other.z) {}
-	Vec3(parser::Vec3i _other)
+	BasicVec3(parser::Vec3i _other)
 		: x(_other.x), y(_other.y), z(_other.z) {}
+	template <typename Other>
+	explicit BasicVec3(const BasicVec3<Other>& _other)
+		: x(static_cast<Real>(_other.x)), y(static_cast<Real>(_other.y)), z(static_cast<Real>(_other.z)) {}
 
-	inline Vec3 normalize() {
-		double len = length();
+	inline BasicVec3 normalize() {
+		Real len = length();
 		x /= len;
 		y /= len;
 		z /= len;
 		return *this;
 	}
 
-	inline Vec3 reverse() {
+	inline BasicVec3 reverse() {
 		x *= -1;
 		y *= -1;
 		z *= -1;
 		return *this;
 	}
 	
-	inline Vec3 cross(const Vec3& _other) const{
-		return Vec3(
+	inline BasicVec3 cross(const BasicVec3& _other) const{
+		return BasicVec3(
 			y * _other.z - z * _other.y,
 			z * _other.x - x * _other.z,
 			x * _other.y - y * _other.x);
 	}
 
-	inline double dot(const Vec3& _other) const {
+	inline Real dot(const BasicVec3& _other) const {
 		return x * _other.x + y * _other.y + z * _other.z;
 	}
 
-	inline double length() const {
-		return sqrt(x * x + y * y + z * z);
+	inline Real length() const {
+		return std::sqrt(x * x + y * y + z * z);
 	}
 
 	// Overloads
-	inline Vec3 operator+(const Vec3& other) const {
-		return Vec3(x + other.x, y + other.y, z + other.z);
+	inline BasicVec3 operator+(const BasicVec3& other) const {
+		return BasicVec3(x + other.x, y + other.y, z + other.z);
 	}
 
-	inline Vec3 operator-(const Vec3& other) const {
-		return Vec3(x - other.x, y - other.y, z - other.z);
+	inline BasicVec3 operator-(const BasicVec3& other) const {
+		return BasicVec3(x - other.x, y - other.y, z - other.z);
 	}
 
-	inline Vec3 operator*(const Vec3& other) const {
-		return Vec3(x * other.x, y * other.y, z * other.z);
+	inline BasicVec3 operator*(const BasicVec3& other) const {
+		return BasicVec3(x * other.x, y * other.y, z * other.z);
 	}
 
-	inline Vec3 operator*(const double& other) const {
-		return Vec3(x * other, y * other, z * other);
+	inline BasicVec3 operator*(const Real& other) const {
+		return BasicVec3(x * other, y * other, z * other);
 	}
 
-	inline Vec3 operator/(const double& other) const {
-		return Vec3(x / other, y / other, z / other);
+	inline BasicVec3 operator/(const Real& other) const {
+		return BasicVec3(x / other, y / other, z / other);
 	}
 	
 	inline operator glm::vec3() const {
@@ -75,7 +81,7 @@ public:
 		return glm::vec4(x, y, z, 0);
 	}
 
-	inline double operator[](int i) const {
+	inline Real operator[](int i) const {
 		if (i == 0) return x;
 		if (i == 1) return y;
 		if (i == 2) return z;
@@ -83,4 +89,6 @@ public:
 	}
 };
 
+using Vec3 = BasicVec3<float>;
+
 #endif // !VEC3_H
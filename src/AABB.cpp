@@ -1,22 +1,25 @@
 #include "AABB.h"
 
-AABB::AABB(const Vec3& p1, const Vec3& p2) 
+template <typename Real>
+BasicAABB<Real>::BasicAABB(const BasicVec3<Real>& p1, const BasicVec3<Real>& p2) 
 {
-	x = Interval(p1.x, p2.x);
-	y = Interval(p1.y, p2.y);
-	z = Interval(p1.z, p2.z);
+	x = BasicInterval<Real>(p1.x, p2.x);
+	y = BasicInterval<Real>(p1.y, p2.y);
+	z = BasicInterval<Real>(p1.z, p2.z);
 	thicken();
 }
 
-AABB::AABB(const AABB& box1, const AABB& box2)
+template <typename Real>
+BasicAABB<Real>::BasicAABB(const BasicAABB& box1, const BasicAABB& box2)
 {
-	x = Interval(box1.x, box2.x);
-	y = Interval(box1.y, box2.y);
-	z = Interval(box1.z, box2.z);
+	x = BasicInterval<Real>(box1.x, box2.x);
+	y = BasicInterval<Real>(box1.y, box2.y);
+	z = BasicInterval<Real>(box1.z, box2.z);
 	thicken();
 }
 
-glm::vec3 AABB::getMinBounds()
+template <typename Real>
+glm::vec3 BasicAABB<Real>::getMinBounds()
 {
 	return glm::vec3(
 		x.min,
@@ -25,7 +28,8 @@ glm::vec3 AABB::getMinBounds()
 	);
 }
 
-glm::vec3 AABB::getMaxBounds()
+template <typename Real>
+glm::vec3 BasicAABB<Real>::getMaxBounds()
 {
 	return glm::vec3(
 		x.max,
@@ -34,26 +38,50 @@ glm::vec3 AABB::getMaxBounds()
 	);
 }
 
-const void AABB::thicken() 
+template <typename Real>
+const void BasicAABB<Real>::thicken() 
 {
 	x.thicken();
 	y.thicken();
 	z.thicken();
 }
 
-const Interval& AABB::axis(int i) const
+// Unlike the merging constructor, grow() does not thicken the result, so it
+// can be applied repeatedly while accumulating bounds.
+template <typename Real>
+void BasicAABB<Real>::grow(const BasicAABB& box)
+{
+	x = BasicInterval<Real>(x, box.x);
+	y = BasicInterval<Real>(y, box.y);
+	z = BasicInterval<Real>(z, box.z);
+}
+
+template <typename Real>
+Real BasicAABB<Real>::surfaceArea() const
+{
+	if (x.min > x.max || y.min > y.max || z.min > z.max) return 0;
+
+	Real dx = x.max - x.min;
+	Real dy = y.max - y.min;
+	Real dz = z.max - z.min;
+	return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+template <typename Real>
+const BasicInterval<Real>& BasicAABB<Real>::axis(int i) const
 {
 	if (i == 0) return x;
 	if (i == 1) return y;
 	else return z;
 }
 
-bool AABB::hit(const Ray& ray, Interval ray_t) const
+template <typename Real>
+bool BasicAABB<Real>::hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t) const
 {
 	for (int i = 0; i < 3; i++)
 	{
-		double t0 = (axis(i).min - ray.origin[i]) / ray.direction[i];
-		double t1 = (axis(i).max - ray.origin[i]) / ray.direction[i];
+		Real t0 = (axis(i).min - ray.origin[i]) / ray.direction[i];
+		Real t1 = (axis(i).max - ray.origin[i]) / ray.direction[i];
 		if (t0 > t1) std::swap(t0, t1);
 
 		// check whether overlaps
@@ -65,7 +93,8 @@ bool AABB::hit(const Ray& ray, Interval ray_t) const
 	return true;
 }
 
-const Interval& AABB::operator[](int axis) const 
+template <typename Real>
+const BasicInterval<Real>& BasicAABB<Real>::operator[](int axis) const 
 {
 	switch (axis) {
 	case 0:
@@ -77,4 +106,7 @@ const Interval& AABB::operator[](int axis) const
 	default:
 		throw std::out_of_range("Invalid axis index");
 	}
-}
\ No newline at end of file
+}
+
+template class BasicAABB<float>;
+template class BasicAABB<double>;
@@ -5,16 +5,19 @@
 #include <iostream>
 #include "Parser.h"
 #include "Vec3.h"
-#include "BVH.h"
-#include "Sphere.h"
-#include "Triangle.h"
+#include "BVHBuilder.h"
+#include "LBVH.h"
+#include "SBVH.h"
+#include "WideBVH.h"
 #include "Utils.h"
 #include "GPUStructs.h"
+#include "SceneCache.h"
 #include <vector>
 
 parser::Scene scene;
 
-App::App()
+App::App(const AppSettings& settings)
+    : m_Settings(settings), m_AnimationExtent(0.0f), m_SceneCache(settings.cacheDirectory)
 {
     s_WindowState = WindowState(1000, 750, "OpenGL Ray Tracer");
     Init();
@@ -105,6 +108,15 @@ void App::Init()
 
     // SSBO setup
     m_SSBO = std::make_unique<SSBO>();
+
+    // Worker threads for scene loading
+    m_ThreadPool = std::make_unique<ThreadPool>(m_Settings.threadCount);
+    BVHRefitOptions refitOptions;
+    refitOptions.threadPool = m_ThreadPool.get();
+    m_Refitter = BVHRefitter(refitOptions);
+    TwoLevelBVHOptions twoLevelOptions;
+    twoLevelOptions.blasOptions.threadPool = m_ThreadPool.get();
+    m_TwoLevelBVH = TwoLevelBVH(twoLevelOptions);
     
     // Quad vertices
     GLfloat quadVertices[] = {
@@ -132,57 +144,57 @@ void App::Init()
     glBindVertexArray(0);
 
     // Ray tracing shader
-    m_RayTracingShader = std::make_shared<Shader>("assets/shaders/rt.vert", "assets/shaders/rt.frag");
-}
-
-void App::Run()
-{
-    // Load scene and create bvh tree
-    std::string scenePath = "./assets/scenes/monkey.xml";
-    scene.loadFromXml(scenePath);
-    std::vector<std::shared_ptr<Hittable>> objects;
-    for (const parser::Sphere& sphere : scene.spheres)
+    std::vector<std::string> shaderDefines;
+    if (m_Settings.instancing)
+    {
+        // Both levels use the binary node layout.
+        if (m_Settings.layout != BVHLayout::Binary)
+        {
+            std::cerr << "Instancing only supports the binary BVH layout, ignoring --bvh-layout" << std::endl;
+            m_Settings.layout = BVHLayout::Binary;
+        }
+        shaderDefines.push_back("INSTANCING");
+    }
+    if (m_Settings.layout == BVHLayout::Wide)
+    {
+        shaderDefines.push_back("WIDE_BVH");
+    }
+    else if (m_Settings.layout == BVHLayout::Compact)
     {
-        objects.push_back(std::make_shared<Sphere>(sphere));
+        shaderDefines.push_back("COMPACT_BVH");
     }
-    for (const parser::Triangle& triangle : scene.triangles)
+    if (m_Settings.primitiveFormat == PrimitiveFormat::Indexed)
     {
-        objects.push_back(std::make_shared<Triangle>(triangle));
+        shaderDefines.push_back("INDEXED_PRIMITIVES");
     }
-    for (const parser::Mesh& mesh : scene.meshes)
+    else if (m_Settings.primitiveFormat == PrimitiveFormat::Edges)
     {
-        for (const parser::Face& face : mesh.faces)
+        shaderDefines.push_back("EDGE_PRIMITIVES");
+    }
+    if (m_Settings.sphereBuffer)
+    {
+        shaderDefines.push_back("SPHERE_BUFFER");
+    }
+    m_RayTracingShader = std::make_shared<Shader>("assets/shaders/rt.vert", "assets/shaders/rt.frag", shaderDefines);
+}
+
+void App::Run()
+{
+    // Load scene and create bvh tree, unless an earlier launch cached the buffers
+    uint64_t cacheKey = 0;
+    bool cacheable = !m_Settings.animate && ComputeSceneCacheKey(cacheKey);
+    if (!cacheable || !LoadSceneCache(cacheKey))
+    {
+        if (cacheable)
+        {
+            m_SceneCache.BeginStore(cacheKey);
+        }
+        LoadScene();
+        if (cacheable && m_SceneCache.EndStore())
         {
-            objects.push_back(std::make_shared<Triangle>(face, mesh.material_id));
+            std::cout << "Scene cached to " << m_SceneCache.GetPath(cacheKey) << std::endl;
         }
     }
-    std::shared_ptr<Hittable> world = std::make_shared<BVHNode>(objects, 0, objects.size() - 1);
-    std::vector<GPU::BVHNode> flatBVH;
-    std::vector<GPU::Primitive> primitives;
-    std::vector<GPU::Material> materials;
-    std::vector<GPU::Light> lights;
-    
-
-    ExtractMaterials(materials, scene);
-    ExtractLights(lights, scene);
-    FlattenBVH(world, flatBVH, primitives);
-
-    // Pass BVHnodes to SSBO
-    size_t bvhSize = flatBVH.size() * sizeof(GPU::BVHNode);
-    size_t primitivesSize = primitives.size() * sizeof(GPU::Primitive);
-    size_t materialsSize = materials.size() * sizeof(GPU::Material);
-    size_t lightsSize = lights.size() * sizeof(GPU::Light);
-    m_SSBO->CreateSSBO("BVHNodes", SSBOBindingPoints::BVHNodes, bvhSize);
-    m_SSBO->UpdateSSBO("BVHNodes", 0, bvhSize, flatBVH.data());
-
-    m_SSBO->CreateSSBO("Primitives", SSBOBindingPoints::Primitives, primitivesSize);
-    m_SSBO->UpdateSSBO("Primitives", 0, primitivesSize, primitives.data());
-
-    m_SSBO->CreateSSBO("Materials", SSBOBindingPoints::Materials, materialsSize);
-    m_SSBO->UpdateSSBO("Materials", 0, materialsSize, materials.data());
-
-    m_SSBO->CreateSSBO("Lights", SSBOBindingPoints::Lights, lightsSize);
-    m_SSBO->UpdateSSBO("Lights", 0, lightsSize, lights.data());
 
     m_UBO->CreateUBO("CameraData", UBOBindingPoints::CAMERA_DATA, 4 * sizeof(glm::vec4));
     double currentFrame = glfwGetTime();
@@ -204,9 +216,348 @@ void App::Run()
     }
 }
 
+void App::LoadScene()
+{
+    scene.load(m_Settings.scenePath, m_Settings.streamParse, m_ThreadPool.get());
+    std::vector<GPU::Material> materials;
+    std::vector<GPU::Light> lights;
+
+    ExtractMaterials(materials, scene);
+    ExtractLights(lights, scene);
+    if (m_Settings.instancing)
+    {
+        BuildTwoLevelBVH();
+        UploadTwoLevelBVH();
+    }
+    else
+    {
+        if (m_Settings.nodeOrder != NodeOrder::DepthFirst)
+        {
+            ReorderVertices(scene);
+        }
+        BuildBVH();
+        UploadBVH();
+    }
+
+    const std::vector<GPU::BVHNode>& rootLevel = m_Settings.instancing ? m_TwoLevelBVH.GetTLASNodes() : m_FlatBVH;
+    if (m_Settings.animate && !rootLevel.empty())
+    {
+        m_AnimationExtent = glm::length(rootLevel[0].maxBounds - rootLevel[0].minBounds);
+        m_RestVertices = scene.vertex_data;
+        for (int i = 0; i < m_TwoLevelBVH.GetInstanceCount(); i++)
+        {
+            m_RestTransforms.push_back(m_TwoLevelBVH.GetTransform(i));
+        }
+    }
+
+    size_t materialsSize = materials.size() * sizeof(GPU::Material);
+    size_t lightsSize = lights.size() * sizeof(GPU::Light);
+    UploadBuffer("Materials", SSBOBindingPoints::Materials, materialsSize, materials.data());
+    UploadBuffer("Lights", SSBOBindingPoints::Lights, lightsSize, lights.data());
+}
+
+bool App::ComputeSceneCacheKey(uint64_t& key) const
+{
+    if (!m_SceneCache.IsEnabled() || !HashSceneFiles(m_Settings.scenePath, key)) return false;
+
+    // Everything that changes the uploaded buffers, thread count excluded since
+    // every builder produces the same tree regardless of it.
+    const uint64_t settings[] = {
+        static_cast<uint64_t>(m_Settings.builder), static_cast<uint64_t>(m_Settings.layout),
+        static_cast<uint64_t>(m_Settings.instancing), static_cast<uint64_t>(m_Settings.nodeOrder),
+        static_cast<uint64_t>(m_Settings.layoutBlockBytes), static_cast<uint64_t>(m_Settings.primitiveFormat),
+        static_cast<uint64_t>(m_Settings.sphereBuffer),
+        sizeof(GPU::BVHNode), sizeof(GPU::Primitive), sizeof(GPU::Material), sizeof(GPU::Light)
+    };
+    key = HashBytes(settings, sizeof(settings), key);
+    return true;
+}
+
+bool App::LoadSceneCache(uint64_t key)
+{
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    if (!m_SceneCache.Load(key)) return false;
+
+    size_t totalSize = 0;
+    for (const SceneCacheBuffer& buffer : m_SceneCache.GetBuffers())
+    {
+        m_SSBO->CreateSSBO(buffer.name, buffer.bindingPoint, buffer.size);
+        m_SSBO->UpdateSSBO(buffer.name, 0, buffer.size, buffer.data);
+        totalSize += buffer.size;
+    }
+    m_SceneCache.Close();
+
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Loaded " << totalSize / 1024 << " KB of scene buffers from " << m_SceneCache.GetPath(key) << " in "
+              << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+    return true;
+}
+
+void App::UploadBuffer(const std::string& name, GLuint bindingPoint, size_t size, const void* data)
+{
+    m_SSBO->CreateSSBO(name, bindingPoint, size);
+    m_SSBO->UpdateSSBO(name, 0, size, data);
+    // Only records the buffer while a cache entry is being stored.
+    m_SceneCache.AddBuffer(name, bindingPoint, data, size);
+}
+
+void App::BuildBVH()
+{
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    const char* builderName;
+
+    std::vector<GPU::Primitive> scenePrimitives;
+    ExtractPrimitives(scenePrimitives, scene);
+
+    if (m_Settings.builder == BVHBuilderType::LBVH)
+    {
+        builderName = "LBVH";
+        LBVHBuildOptions buildOptions;
+        buildOptions.threadPool = m_ThreadPool.get();
+        BuildLBVH(scenePrimitives, m_FlatBVH, m_Primitives, buildOptions, &m_PrimitiveIndices);
+    }
+    else if (m_Settings.builder == BVHBuilderType::SBVH)
+    {
+        builderName = "SBVH";
+        int extraReferences = BuildSBVH(scenePrimitives, m_FlatBVH, m_Primitives, SBVHBuildOptions(), &m_PrimitiveIndices);
+        std::cout << "Spatial splits added " << extraReferences << " references to " << scenePrimitives.size()
+                  << " primitives" << std::endl;
+    }
+    else
+    {
+        builderName = "SAH";
+        BVHBuildOptions buildOptions;
+        buildOptions.threadPool = m_ThreadPool.get();
+        BVHBuilder(buildOptions).Build(scenePrimitives, m_FlatBVH, m_Primitives, &m_PrimitiveIndices);
+    }
+
+    auto buildEnd = std::chrono::high_resolution_clock::now();
+    std::cout << builderName << " BVH built over " << m_Primitives.size() << " primitives in "
+              << std::chrono::duration<double, std::milli>(buildEnd - buildStart).count() << " ms using "
+              << m_ThreadPool->GetThreadCount() << " thread(s), " << m_FlatBVH.size() << " nodes, SAH cost "
+              << ComputeSAHCost(m_FlatBVH) << std::endl;
+
+    if (m_Settings.nodeOrder != NodeOrder::DepthFirst)
+    {
+        if (m_Settings.cacheReport)
+        {
+            ReportCacheMisses(m_FlatBVH, m_Primitives, "Depth first");
+        }
+        CacheLayoutOptions layoutOptions;
+        layoutOptions.order = m_Settings.nodeOrder;
+        layoutOptions.blockBytes = m_Settings.layoutBlockBytes;
+        ReorderBVH(m_FlatBVH, m_Primitives, layoutOptions, &m_PrimitiveIndices);
+        if (m_Settings.cacheReport)
+        {
+            ReportCacheMisses(m_FlatBVH, m_Primitives, m_Settings.nodeOrder == NodeOrder::Treelet ? "Treelet" : "van Emde Boas");
+        }
+    }
+    else if (m_Settings.cacheReport)
+    {
+        ReportCacheMisses(m_FlatBVH, m_Primitives, "Depth first");
+    }
+
+    m_Refitter.Reset(scene, m_FlatBVH, m_PrimitiveIndices);
+}
+
+void App::ReportCacheMisses(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives, const char* label)
+{
+    CacheSimulator cache(static_cast<size_t>(m_Settings.cacheReportBytes), 64, 8);
+    CacheReport report = SimulateTraversalCache(flatBVH, primitives, cache);
+    double rays = std::max<double>(1.0, (double)report.rays);
+    std::cout << label << " layout, per ray: " << report.nodeVisits / rays << " node visits, "
+              << report.nodeMisses / rays << " node misses, " << report.primitiveVisits / rays << " primitive visits, "
+              << report.primitiveMisses / rays << " primitive misses (" << m_Settings.cacheReportBytes / 1024.0
+              << " KB, 64 B lines, 8 way LRU)" << std::endl;
+}
+
+void App::UploadBVH()
+{
+    // Separating the spheres may split leaves, so that works on a copy of the tree.
+    std::vector<GPU::BVHNode> segregatedBVH;
+    const std::vector<GPU::BVHNode>& flatBVH = m_Settings.sphereBuffer ? segregatedBVH : m_FlatBVH;
+    if (m_Settings.sphereBuffer)
+    {
+        segregatedBVH = m_FlatBVH;
+        UploadPrimitives(m_Primitives, &segregatedBVH);
+    }
+    else
+    {
+        UploadPrimitives(m_Primitives);
+    }
+
+    std::vector<GPU::WideBVHNode<4>> wideBVH;
+    std::vector<GPU::CompactBVHNode> compactBVH;
+    size_t bvhSize = flatBVH.size() * sizeof(GPU::BVHNode);
+    const void* bvhData = flatBVH.data();
+    if (m_Settings.layout == BVHLayout::Wide)
+    {
+        CollapseBVH(flatBVH, wideBVH);
+        bvhSize = wideBVH.size() * sizeof(GPU::WideBVHNode<4>);
+        bvhData = wideBVH.data();
+    }
+    else if (m_Settings.layout == BVHLayout::Compact)
+    {
+        CompactBVH(flatBVH, compactBVH);
+        bvhSize = compactBVH.size() * sizeof(GPU::CompactBVHNode);
+        bvhData = compactBVH.data();
+    }
+
+    UploadBuffer("BVHNodes", SSBOBindingPoints::BVHNodes, bvhSize, bvhData);
+}
+
+void App::UploadPrimitives(const std::vector<GPU::Primitive>& scenePrimitives, std::vector<GPU::BVHNode>* nodes)
+{
+    size_t inlineSize = scenePrimitives.size() * sizeof(GPU::Primitive);
+    size_t spheresSize = 0;
+    std::vector<GPU::Primitive> triangles;
+    if (nodes)
+    {
+        std::vector<GPU::SpherePrimitive> spheres;
+        SegregateSpheres(*nodes, scenePrimitives, triangles, spheres);
+        spheresSize = spheres.size() * sizeof(GPU::SpherePrimitive);
+        UploadBuffer("Spheres", SSBOBindingPoints::Spheres, spheresSize, spheres.data());
+    }
+    const std::vector<GPU::Primitive>& primitives = nodes ? triangles : scenePrimitives;
+
+    size_t primitivesSize;
+    if (m_Settings.primitiveFormat == PrimitiveFormat::Inline)
+    {
+        primitivesSize = primitives.size() * sizeof(GPU::Primitive);
+        UploadBuffer("Primitives", SSBOBindingPoints::Primitives, primitivesSize, primitives.data());
+    }
+    else if (m_Settings.primitiveFormat == PrimitiveFormat::Indexed)
+    {
+        std::vector<glm::vec4> vertices;
+        std::vector<GPU::IndexedPrimitive> indexed;
+        IndexPrimitives(primitives, vertices, indexed);
+        size_t verticesSize = vertices.size() * sizeof(glm::vec4);
+        primitivesSize = indexed.size() * sizeof(GPU::IndexedPrimitive) + verticesSize;
+        UploadBuffer("Vertices", SSBOBindingPoints::Vertices, verticesSize, vertices.data());
+        UploadBuffer("Primitives", SSBOBindingPoints::Primitives, indexed.size() * sizeof(GPU::IndexedPrimitive), indexed.data());
+    }
+    else
+    {
+        std::vector<GPU::EdgePrimitive> edges;
+        EdgePrimitives(primitives, edges);
+        primitivesSize = edges.size() * sizeof(GPU::EdgePrimitive);
+        UploadBuffer("Primitives", SSBOBindingPoints::Primitives, primitivesSize, edges.data());
+    }
+    if (!m_Settings.animate && (nodes || m_Settings.primitiveFormat != PrimitiveFormat::Inline))
+    {
+        std::cout << "Primitives take " << (primitivesSize + spheresSize) / 1024 << " KB on the GPU, " << inlineSize / 1024
+                  << " KB stored inline" << std::endl;
+    }
+}
+
+void App::AnimateGeometry(float time)
+{
+    if (m_Settings.instancing)
+    {
+        AnimateInstances(time);
+        return;
+    }
+
+    // Ripple every vertex up and down, out of phase along x and z.
+    for (size_t i = 0; i < m_RestVertices.size(); i++)
+    {
+        const parser::Vec3f& rest = m_RestVertices[i];
+        float phase = 2.0f * time + 4.0f * (rest.x + rest.z) / m_AnimationExtent;
+        scene.vertex_data[i].y = rest.y + 0.01f * m_AnimationExtent * std::sin(phase);
+    }
+
+    if (m_Refitter.Refit(scene, m_FlatBVH, m_Primitives) == 0) return;
+
+    if (m_Refitter.NeedsRebuild())
+    {
+        std::cout << "Refitted BVH degraded to " << m_Refitter.GetDegradation() << "x its SAH cost, rebuilding" << std::endl;
+        BuildBVH();
+        UploadBVH();
+        return;
+    }
+
+    // The other layouts and primitive formats are derived from the whole tree, so they are
+    // converted and sent again.
+    if (m_Settings.layout != BVHLayout::Binary || m_Settings.primitiveFormat != PrimitiveFormat::Inline
+        || m_Settings.sphereBuffer)
+    {
+        UploadBVH();
+        return;
+    }
+    for (const BVHRefitRange& range : m_Refitter.GetChangedPrimitives())
+    {
+        m_SSBO->UpdateSSBO("Primitives", range.first * sizeof(GPU::Primitive), range.count * sizeof(GPU::Primitive),
+                           &m_Primitives[range.first]);
+    }
+    for (const BVHRefitRange& range : m_Refitter.GetChangedNodes())
+    {
+        m_SSBO->UpdateSSBO("BVHNodes", range.first * sizeof(GPU::BVHNode), range.count * sizeof(GPU::BVHNode),
+                           &m_FlatBVH[range.first]);
+    }
+}
+
+void App::BuildTwoLevelBVH()
+{
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    m_TwoLevelBVH.Build(scene);
+    auto buildEnd = std::chrono::high_resolution_clock::now();
+
+    size_t sceneFaces = scene.spheres.size() + scene.triangles.size();
+    for (auto& mesh : scene.meshes)
+    {
+        sceneFaces += mesh.faces.size();
+    }
+    size_t bytes = m_TwoLevelBVH.GetBLASNodes().size() * sizeof(GPU::BVHNode)
+                 + m_TwoLevelBVH.GetPrimitives().size() * sizeof(GPU::Primitive)
+                 + m_TwoLevelBVH.GetTLASNodes().size() * sizeof(GPU::BVHNode)
+                 + m_TwoLevelBVH.GetInstances().size() * sizeof(GPU::Instance);
+    std::cout << "Two level BVH built in " << std::chrono::duration<double, std::milli>(buildEnd - buildStart).count()
+              << " ms: " << m_TwoLevelBVH.GetInstanceCount() << " instances of " << m_TwoLevelBVH.GetBLASCount()
+              << " unique meshes, " << m_TwoLevelBVH.GetPrimitives().size() << " of " << sceneFaces
+              << " primitives stored, " << bytes / 1024 << " KiB" << std::endl;
+}
+
+void App::UploadTwoLevelBVH()
+{
+    std::vector<GPU::BVHNode> blasNodes = m_TwoLevelBVH.GetBLASNodes();
+    UploadPrimitives(m_TwoLevelBVH.GetPrimitives(), m_Settings.sphereBuffer ? &blasNodes : nullptr);
+
+    UploadBuffer("BVHNodes", SSBOBindingPoints::BVHNodes, blasNodes.size() * sizeof(GPU::BVHNode), blasNodes.data());
+
+    UploadTLAS();
+}
+
+void App::UploadTLAS()
+{
+    const std::vector<GPU::BVHNode>& tlasNodes = m_TwoLevelBVH.GetTLASNodes();
+    const std::vector<GPU::Instance>& instances = m_TwoLevelBVH.GetInstances();
+    size_t tlasSize = tlasNodes.size() * sizeof(GPU::BVHNode);
+    size_t instancesSize = instances.size() * sizeof(GPU::Instance);
+
+    UploadBuffer("TLASNodes", SSBOBindingPoints::TLASNodes, tlasSize, tlasNodes.data());
+
+    UploadBuffer("Instances", SSBOBindingPoints::Instances, instancesSize, instances.data());
+}
+
+void App::AnimateInstances(float time)
+{
+    // Bob every instance up and down, only the top level needs rebuilding.
+    for (int i = 0; i < m_TwoLevelBVH.GetInstanceCount(); i++)
+    {
+        glm::vec3 offset(0.0f, 0.01f * m_AnimationExtent * std::sin(2.0f * time + i), 0.0f);
+        m_TwoLevelBVH.SetTransform(i, glm::translate(glm::mat4(1.0f), offset) * m_RestTransforms[i]);
+    }
+    m_TwoLevelBVH.BuildTLAS();
+    UploadTLAS();
+}
+
 void App::Update(float deltaTime)
 {
     ProcessInput();
+    if (m_Settings.animate)
+    {
+        AnimateGeometry(static_cast<float>(glfwGetTime()));
+    }
     m_Camera->Update(deltaTime);
     m_Camera->SetUniforms(*m_UBO);
     std::string title = "FPS: " + std::to_string(s_WindowState.fps);
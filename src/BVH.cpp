@@ -1,38 +1,84 @@
 #include "bvh.h"
 
-BVHNode::BVHNode(std::vector<std::shared_ptr<Hittable>>& objects, int begin, int end) 
+template <typename Real>
+BasicBVHNode<Real>::BasicBVHNode(std::vector<std::shared_ptr<Hittable>>& objects, int begin, int end, const BVHBuildOptions& options)
 {
-	int axis = rand() % 3;
-	if (begin == end)
+	std::vector<PrimitiveRef> refs(end - begin + 1);
+	for (int i = begin; i <= end; i++)
 	{
-		left = objects[begin];
-		right = objects[begin];
+		BasicAABB<Real> box = objects[i]->getAABB();
+		refs[i - begin].minBounds = box.getMinBounds();
+		refs[i - begin].maxBounds = box.getMaxBounds();
+		refs[i - begin].index = i;
 	}
-	else if (begin == end - 1)
+
+	std::vector<GPU::BVHNode> flatBVH;
+	BVHBuilder(options).Build(refs, flatBVH);
+
+	// Put the objects in leaf order, so that leaves can refer to them by range.
+	std::vector<std::shared_ptr<Hittable>> ordered(refs.size());
+	for (size_t i = 0; i < refs.size(); i++)
 	{
-		left = objects[begin];
-		right = objects[end];
+		ordered[i] = std::move(objects[refs[i].index]);
 	}
-	else
+	std::move(ordered.begin(), ordered.end(), objects.begin() + begin);
+
+	*this = BasicBVHNode(flatBVH, 0, objects, begin);
+}
+
+template <typename Real>
+BasicBVHNode<Real>::BasicBVHNode(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex,
+								 const std::vector<std::shared_ptr<Hittable>>& objects, int begin)
+{
+	const GPU::BVHNode& node = flatBVH[nodeIndex];
+	if (node.primitiveCount > 0)
 	{
-		std::sort(objects.begin() + begin, objects.begin() + end + 1,
-			[axis](const std::shared_ptr<Hittable>& a, const std::shared_ptr<Hittable> b)
-			{
-				return a->getAABB()[axis].min < b->getAABB()[axis].min;
-			}
-		);
-		int mid = (begin + end) / 2;
-		left = std::make_shared<BVHNode>(objects, begin, mid);
-		right = std::make_shared<BVHNode>(objects, mid, end);
+		auto first = objects.begin() + begin + node.primitiveOffset;
+		primitives.assign(first, first + node.primitiveCount);
+		for (const std::shared_ptr<Hittable>& primitive : primitives)
+		{
+			bounding_box.grow(primitive->getAABB());
+		}
+		return;
 	}
 
-	bounding_box = AABB(left->getAABB(), right->getAABB());
+	left = makeChild(flatBVH, node.leftChild, objects, begin);
+	right = makeChild(flatBVH, node.rightChild, objects, begin);
+	bounding_box = left->getAABB();
+	bounding_box.grow(right->getAABB());
+}
+
+// Leaves over a single object are replaced by the object itself.
+template <typename Real>
+std::shared_ptr<BasicHittable<Real>> BasicBVHNode<Real>::makeChild(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex,
+																   const std::vector<std::shared_ptr<Hittable>>& objects, int begin)
+{
+	const GPU::BVHNode& node = flatBVH[nodeIndex];
+	if (node.primitiveCount == 1)
+	{
+		return objects[begin + node.primitiveOffset];
+	}
+	return std::shared_ptr<BasicBVHNode>(new BasicBVHNode(flatBVH, nodeIndex, objects, begin));
 }
 
 
-bool BVHNode::hit(const Ray& ray, Interval ray_t, HitRecord& rec) const {
+template <typename Real>
+bool BasicBVHNode<Real>::hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec) const {
 	if (!bounding_box.hit(ray, ray_t)) return false;
-	HitRecord rec1, rec2;
+
+	if (!primitives.empty()) {
+		bool hit_any = false;
+		BasicHitRecord<Real> temp;
+		for (const std::shared_ptr<Hittable>& primitive : primitives) {
+			if (primitive->hit(ray, ray_t, temp) && (!hit_any || temp.t < rec.t)) {
+				rec = temp;
+				hit_any = true;
+			}
+		}
+		return hit_any;
+	}
+
+	BasicHitRecord<Real> rec1, rec2;
 
 	bool hit_left = left->hit(ray, ray_t, rec1);
 	bool hit_right = right->hit(ray, ray_t, rec2);
@@ -59,4 +105,9 @@ bool BVHNode::hit(const Ray& ray, Interval ray_t, HitRecord& rec) const {
 }
 
 
-AABB BVHNode::getAABB() const { return bounding_box; }
\ No newline at end of file
+template <typename Real>
+BasicAABB<Real> BasicBVHNode<Real>::getAABB() const { return bounding_box; }
+
+template class BasicBVHNode<float>;
+template class BasicBVHNode<double>;
+
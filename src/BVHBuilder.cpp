@@ -0,0 +1,418 @@
+#include "BVHBuilder.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+namespace {
+
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+
+	void grow(const glm::vec3& pmin, const glm::vec3& pmax)
+	{
+		min = glm::min(min, pmin);
+		max = glm::max(max, pmax);
+	}
+
+	void grow(const Bounds& other) { grow(other.min, other.max); }
+
+	float surfaceArea() const
+	{
+		if (min.x > max.x || min.y > max.y || min.z > max.z) return 0.0f;
+		glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+};
+
+struct Bin
+{
+	Bounds bounds;
+	int count = 0;
+};
+
+// Bounds of the references and of their centroids over a range.
+struct RangeBounds
+{
+	Bounds bounds;
+	Bounds centroids;
+
+	void grow(const RangeBounds& other)
+	{
+		bounds.grow(other.bounds);
+		centroids.grow(other.centroids);
+	}
+};
+
+glm::vec3 centroid(const PrimitiveRef& ref)
+{
+	return (ref.minBounds + ref.maxBounds) * 0.5f;
+}
+
+int binIndex(float c, float cmin, float scale, int binCount)
+{
+	int b = static_cast<int>((c - cmin) * scale);
+	return std::clamp(b, 0, binCount - 1);
+}
+
+class Builder
+{
+public:
+	Builder(const BVHBuildOptions& options, std::vector<PrimitiveRef>& refs, std::vector<GPU::BVHNode>& nodes,
+			std::vector<uint8_t>& used, const std::vector<GPU::Primitive>* input, std::vector<GPU::Primitive>* primitives)
+		: m_Options(options), m_Refs(refs), m_Nodes(nodes), m_Used(used), m_Input(input), m_Primitives(primitives)
+	{
+		m_Options.binCount = std::max(m_Options.binCount, 2);
+		m_Options.maxLeafSize = std::max(m_Options.maxLeafSize, 1);
+		m_Options.leafBlockWidth = std::max(m_Options.leafBlockWidth, 1);
+		m_Options.parallelGrainSize = std::max(m_Options.parallelGrainSize, 1);
+	}
+
+	// Builds the subtree over refs[begin, end) into the slots starting at nodeIndex.
+	void buildNode(int nodeIndex, int begin, int end)
+	{
+		RangeBounds range = computeBounds(begin, end);
+		GPU::BVHNode& node = m_Nodes[nodeIndex];
+		node.minBounds = range.bounds.min;
+		node.maxBounds = range.bounds.max;
+		m_Used[nodeIndex] = 1;
+
+		int split = end - begin == 1 ? -1 : partitionSAH(begin, end, range);
+		if (split < 0)
+		{
+			node.leftChild = -1;
+			node.rightChild = -1;
+			node.primitiveOffset = begin;
+			node.primitiveCount = end - begin;
+			if (m_Primitives != nullptr)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					(*m_Primitives)[i] = (*m_Input)[m_Refs[i].index];
+				}
+			}
+			return;
+		}
+
+		int left = nodeIndex + 1;
+		int right = nodeIndex + 2 * (split - begin);
+		node.leftChild = left;
+		node.rightChild = right;
+		node.primitiveOffset = 0;
+		node.primitiveCount = 0;
+
+		// Both halves touch disjoint references and slots, so they can be built concurrently.
+		if (m_Options.threadPool != nullptr && end - begin >= m_Options.taskGrainSize)
+		{
+			TaskGroup group(m_Options.threadPool);
+			group.Run([=] { buildNode(left, begin, split); });
+			buildNode(right, split, end);
+			group.Wait();
+		}
+		else
+		{
+			buildNode(left, begin, split);
+			buildNode(right, split, end);
+		}
+	}
+
+private:
+	bool isParallel(int count) const
+	{
+		return m_Options.threadPool != nullptr && count >= m_Options.parallelGrainSize;
+	}
+
+	int chunkCount(int begin, int end) const
+	{
+		return isParallel(end - begin) ? (end - begin + m_Options.parallelGrainSize - 1) / m_Options.parallelGrainSize : 1;
+	}
+
+	// Runs body over [begin, end) in chunks, serially or on the pool. Chunk i always
+	// covers the same references, so per-chunk results merged in order are deterministic.
+	void forEachChunk(int begin, int end, const std::function<void(int, int, int)>& body) const
+	{
+		if (!isParallel(end - begin))
+		{
+			body(0, begin, end);
+			return;
+		}
+
+		int grainSize = m_Options.parallelGrainSize;
+		m_Options.threadPool->ParallelFor(begin, end, grainSize, [&](int chunkBegin, int chunkEnd)
+			{
+				body((chunkBegin - begin) / grainSize, chunkBegin, chunkEnd);
+			}
+		);
+	}
+
+	RangeBounds computeBounds(int begin, int end) const
+	{
+		std::vector<RangeBounds> partial(chunkCount(begin, end));
+		forEachChunk(begin, end, [&](int chunk, int chunkBegin, int chunkEnd)
+			{
+				RangeBounds& result = partial[chunk];
+				for (int i = chunkBegin; i < chunkEnd; i++)
+				{
+					glm::vec3 c = centroid(m_Refs[i]);
+					result.bounds.grow(m_Refs[i].minBounds, m_Refs[i].maxBounds);
+					result.centroids.grow(c, c);
+				}
+			}
+		);
+
+		RangeBounds result;
+		for (const RangeBounds& chunk : partial)
+		{
+			result.grow(chunk);
+		}
+		return result;
+	}
+
+	std::vector<Bin> computeBins(int begin, int end, int axis, float cmin, float scale) const
+	{
+		int binCount = m_Options.binCount;
+		std::vector<std::vector<Bin>> partial(chunkCount(begin, end), std::vector<Bin>(binCount));
+		forEachChunk(begin, end, [&](int chunk, int chunkBegin, int chunkEnd)
+			{
+				for (int i = chunkBegin; i < chunkEnd; i++)
+				{
+					Bin& bin = partial[chunk][binIndex(centroid(m_Refs[i])[axis], cmin, scale, binCount)];
+					bin.bounds.grow(m_Refs[i].minBounds, m_Refs[i].maxBounds);
+					bin.count++;
+				}
+			}
+		);
+
+		std::vector<Bin> bins(binCount);
+		for (const std::vector<Bin>& chunk : partial)
+		{
+			for (int i = 0; i < binCount; i++)
+			{
+				bins[i].bounds.grow(chunk[i].bounds);
+				bins[i].count += chunk[i].count;
+			}
+		}
+		return bins;
+	}
+
+	// Stable partition of refs[begin, end), returns the number of references moved to the left.
+	// The parallel variant counts per chunk and scatters through a scratch buffer,
+	// which keeps the exact order of the serial std::stable_partition.
+	template <typename Predicate>
+	int partitionRefs(int begin, int end, Predicate isLeft)
+	{
+		if (!isParallel(end - begin))
+		{
+			auto it = std::stable_partition(m_Refs.begin() + begin, m_Refs.begin() + end, isLeft);
+			return static_cast<int>(it - m_Refs.begin()) - begin;
+		}
+
+		int chunks = chunkCount(begin, end);
+		int grainSize = m_Options.parallelGrainSize;
+		std::vector<uint8_t> side(end - begin);
+		std::vector<int> leftCount(chunks, 0);
+		forEachChunk(begin, end, [&](int chunk, int chunkBegin, int chunkEnd)
+			{
+				for (int i = chunkBegin; i < chunkEnd; i++)
+				{
+					side[i - begin] = isLeft(m_Refs[i]);
+					leftCount[chunk] += side[i - begin];
+				}
+			}
+		);
+
+		std::vector<int> leftOffset(chunks), rightOffset(chunks);
+		int totalLeft = 0;
+		for (int i = 0; i < chunks; i++)
+		{
+			leftOffset[i] = totalLeft;
+			totalLeft += leftCount[i];
+		}
+		for (int i = 0, right = totalLeft; i < chunks; i++)
+		{
+			rightOffset[i] = right;
+			right += std::min(grainSize, end - (begin + i * grainSize)) - leftCount[i];
+		}
+
+		std::vector<PrimitiveRef> scratch(end - begin);
+		forEachChunk(begin, end, [&](int chunk, int chunkBegin, int chunkEnd)
+			{
+				int l = leftOffset[chunk];
+				int r = rightOffset[chunk];
+				for (int i = chunkBegin; i < chunkEnd; i++)
+				{
+					scratch[side[i - begin] ? l++ : r++] = m_Refs[i];
+				}
+			}
+		);
+		forEachChunk(begin, end, [&](int, int chunkBegin, int chunkEnd)
+			{
+				std::copy(scratch.begin() + (chunkBegin - begin), scratch.begin() + (chunkEnd - begin), m_Refs.begin() + chunkBegin);
+			}
+		);
+		return totalLeft;
+	}
+
+	// Splits refs[begin, end) in place and returns the first reference of the
+	// right child, or -1 if the range should be a leaf.
+	int partitionSAH(int begin, int end, const RangeBounds& range)
+	{
+		// Centroid bounds decide the split axis, so the build is deterministic.
+		glm::vec3 extents = range.centroids.max - range.centroids.min;
+		int axis = 0;
+		if (extents.y > extents[axis]) axis = 1;
+		if (extents.z > extents[axis]) axis = 2;
+
+		int count = end - begin;
+		int mid = (begin + end) / 2;
+		int binCount = m_Options.binCount;
+		bool canBeLeaf = count <= m_Options.maxLeafSize;
+		float parentArea = range.bounds.surfaceArea();
+
+		// All centroids coincide, no plane can separate them.
+		if (extents[axis] <= 0.0f || parentArea <= 0.0f)
+		{
+			return canBeLeaf ? -1 : mid;
+		}
+
+		float cmin = range.centroids.min[axis];
+		float scale = binCount / extents[axis];
+		std::vector<Bin> bins = computeBins(begin, end, axis, cmin, scale);
+
+		// Sweep from the right to get the area and count on the right of every plane.
+		std::vector<float> rightArea(binCount);
+		std::vector<int> rightCount(binCount);
+		Bounds accum;
+		int accumCount = 0;
+		for (int i = binCount - 1; i > 0; i--)
+		{
+			accum.grow(bins[i].bounds);
+			accumCount += bins[i].count;
+			rightArea[i] = accum.surfaceArea();
+			rightCount[i] = accumCount;
+		}
+
+		int blockWidth = m_Options.leafBlockWidth;
+		auto blockCount = [blockWidth](int primitives) { return static_cast<float>((primitives + blockWidth - 1) / blockWidth); };
+
+		float bestCost = INFINITY;
+		int bestPlane = -1;
+		accum = Bounds();
+		accumCount = 0;
+		for (int i = 1; i < binCount; i++)
+		{
+			accum.grow(bins[i - 1].bounds);
+			accumCount += bins[i - 1].count;
+			if (accumCount == 0 || rightCount[i] == 0) continue;
+
+			float cost = m_Options.traversalCost + m_Options.leafCost *
+				(accum.surfaceArea() * blockCount(accumCount) + rightArea[i] * blockCount(rightCount[i])) / parentArea;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestPlane = i;
+			}
+		}
+
+		// Intersecting everything in place is cheaper than any split.
+		if (canBeLeaf && m_Options.leafCost * blockCount(count) <= bestCost)
+		{
+			return -1;
+		}
+
+		if (bestPlane < 0)
+		{
+			return mid;
+		}
+
+		int leftCount = partitionRefs(begin, end, [&](const PrimitiveRef& ref)
+			{
+				return binIndex(centroid(ref)[axis], cmin, scale, binCount) < bestPlane;
+			}
+		);
+		return begin + leftCount;
+	}
+
+	BVHBuildOptions m_Options;
+	std::vector<PrimitiveRef>& m_Refs;
+	std::vector<GPU::BVHNode>& m_Nodes;
+	std::vector<uint8_t>& m_Used;
+	const std::vector<GPU::Primitive>* m_Input;
+	std::vector<GPU::Primitive>* m_Primitives;
+};
+
+}
+
+BVHBuilder::BVHBuilder(const BVHBuildOptions& options)
+	: m_Options(options)
+{
+}
+
+void BVHBuilder::Build(std::vector<PrimitiveRef>& refs, std::vector<GPU::BVHNode>& flatBVH)
+{
+	Build(refs, flatBVH, nullptr, nullptr);
+}
+
+void BVHBuilder::Build(const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& flatBVH,
+					   std::vector<GPU::Primitive>& primitives, std::vector<int>* primitiveIndices)
+{
+	std::vector<PrimitiveRef> refs(input.size());
+	for (size_t i = 0; i < input.size(); i++)
+	{
+		GetPrimitiveBounds(input[i], refs[i].minBounds, refs[i].maxBounds);
+		refs[i].index = static_cast<int>(i);
+	}
+
+	primitives.resize(input.size());
+	Build(refs, flatBVH, &input, &primitives);
+
+	if (primitiveIndices != nullptr)
+	{
+		primitiveIndices->resize(refs.size());
+		for (size_t i = 0; i < refs.size(); i++)
+		{
+			(*primitiveIndices)[i] = refs[i].index;
+		}
+	}
+}
+
+void BVHBuilder::Build(std::vector<PrimitiveRef>& refs, std::vector<GPU::BVHNode>& flatBVH,
+					   const std::vector<GPU::Primitive>* input, std::vector<GPU::Primitive>* primitives)
+{
+	flatBVH.clear();
+	if (refs.empty()) return;
+
+	// Single primitive leaves are the worst case: 2n - 1 nodes.
+	size_t slotCount = 2 * refs.size() - 1;
+	flatBVH.resize(slotCount);
+	std::vector<uint8_t> used(slotCount, 0);
+
+	Builder builder(m_Options, refs, flatBVH, used, input, primitives);
+	builder.buildNode(0, 0, static_cast<int>(refs.size()));
+
+	// Squeeze out the unused slots. Nodes only move towards the front, so this works in place.
+	std::vector<int> remap(slotCount);
+	int count = 0;
+	for (size_t i = 0; i < slotCount; i++)
+	{
+		remap[i] = count;
+		count += used[i];
+	}
+	for (size_t i = 0; i < slotCount; i++)
+	{
+		if (!used[i]) continue;
+
+		GPU::BVHNode node = flatBVH[i];
+		if (node.primitiveCount == 0)
+		{
+			node.leftChild = remap[node.leftChild];
+			node.rightChild = remap[node.rightChild];
+		}
+		flatBVH[remap[i]] = node;
+	}
+	flatBVH.resize(count);
+}
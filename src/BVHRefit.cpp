@@ -0,0 +1,191 @@
+#include "BVHRefit.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include <algorithm>
+
+namespace {
+
+void forEachRange(ThreadPool* pool, int count, int grainSize, const std::function<void(int, int)>& body)
+{
+	if (pool == nullptr || count <= grainSize)
+	{
+		body(0, count);
+		return;
+	}
+	pool->ParallelFor(0, count, grainSize, body);
+}
+
+// Vertex ids of every primitive, in the order ExtractPrimitives emits them.
+void extractVertexIds(const parser::Scene& scene, std::vector<glm::ivec3>& vertexIds)
+{
+	for (auto& sphere : scene.spheres)
+	{
+		vertexIds.push_back(glm::ivec3(sphere.center_vertex_id, 0, 0));
+	}
+	for (auto& tri : scene.triangles)
+	{
+		vertexIds.push_back(glm::ivec3(tri.indices.v0_id, tri.indices.v1_id, tri.indices.v2_id));
+	}
+	for (auto& mesh : scene.meshes)
+	{
+		for (auto& face : mesh.faces)
+		{
+			vertexIds.push_back(glm::ivec3(face.v0_id, face.v1_id, face.v2_id));
+		}
+	}
+}
+
+// Turns per element flags into ranges, bridging gaps shorter than mergeGap.
+void collectRanges(const std::vector<uint8_t>& changed, int mergeGap, std::vector<BVHRefitRange>& ranges)
+{
+	ranges.clear();
+	int count = static_cast<int>(changed.size());
+	for (int i = 0; i < count; i++)
+	{
+		if (!changed[i]) continue;
+
+		if (!ranges.empty() && i - (ranges.back().first + ranges.back().count) < mergeGap)
+		{
+			ranges.back().count = i - ranges.back().first + 1;
+		}
+		else
+		{
+			ranges.push_back({ i, 1 });
+		}
+	}
+}
+
+}
+
+BVHRefitter::BVHRefitter(const BVHRefitOptions& options)
+	: m_Options(options), m_BuildCost(0.0f), m_Degradation(1.0f)
+{
+}
+
+void BVHRefitter::Reset(const parser::Scene& scene, const std::vector<GPU::BVHNode>& flatBVH,
+						const std::vector<int>& primitiveIndices)
+{
+	std::vector<glm::ivec3> sceneVertexIds;
+	extractVertexIds(scene, sceneVertexIds);
+
+	m_VertexIds.resize(primitiveIndices.size());
+	for (size_t i = 0; i < primitiveIndices.size(); i++)
+	{
+		m_VertexIds[i] = sceneVertexIds[primitiveIndices[i]];
+	}
+
+	// Children always come after their parent, so one forward pass finds every depth.
+	m_Levels.clear();
+	std::vector<int> depth(flatBVH.size(), 0);
+	for (size_t i = 0; i < flatBVH.size(); i++)
+	{
+		if (m_Levels.size() <= static_cast<size_t>(depth[i]))
+		{
+			m_Levels.resize(depth[i] + 1);
+		}
+		m_Levels[depth[i]].push_back(static_cast<int>(i));
+
+		const GPU::BVHNode& node = flatBVH[i];
+		if (node.primitiveCount == 0)
+		{
+			depth[node.leftChild] = depth[i] + 1;
+			depth[node.rightChild] = depth[i] + 1;
+		}
+	}
+
+	m_NodeChanged.assign(flatBVH.size(), 0);
+	m_PrimitiveChanged.assign(primitiveIndices.size(), 0);
+	m_ChangedNodeRanges.clear();
+	m_ChangedPrimitiveRanges.clear();
+	m_BuildCost = ComputeSAHCost(flatBVH);
+	m_Degradation = 1.0f;
+}
+
+int BVHRefitter::Refit(const parser::Scene& scene, std::vector<GPU::BVHNode>& flatBVH,
+					   std::vector<GPU::Primitive>& primitives)
+{
+	auto vertex = [&scene](int id)
+	{
+		const parser::Vec3f& v = scene.vertex_data[id - 1];
+		return glm::vec4(v.x, v.y, v.z, 0);
+	};
+
+	forEachRange(m_Options.threadPool, static_cast<int>(primitives.size()), m_Options.grainSize, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				GPU::Primitive& primitive = primitives[i];
+				const glm::ivec3& ids = m_VertexIds[i];
+				bool changed = false;
+				int vertexCount = primitive.type == 1 ? 1 : 3;
+				for (int k = 0; k < vertexCount; k++)
+				{
+					glm::vec4 v = vertex(ids[k]);
+					changed |= v != primitive.vertexData[k];
+					primitive.vertexData[k] = v;
+				}
+				m_PrimitiveChanged[i] = changed;
+			}
+		}
+	);
+
+	// Deepest level first, so both children are final when a node is refitted.
+	// A node whose inputs did not move keeps its bounds and stays unchanged.
+	for (auto level = m_Levels.rbegin(); level != m_Levels.rend(); ++level)
+	{
+		const std::vector<int>& nodes = *level;
+		forEachRange(m_Options.threadPool, static_cast<int>(nodes.size()), m_Options.grainSize, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					GPU::BVHNode& node = flatBVH[nodes[i]];
+					glm::vec3 minBounds(INFINITY), maxBounds(-INFINITY);
+					bool dirty = false;
+					if (node.primitiveCount > 0)
+					{
+						for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+						{
+							dirty |= m_PrimitiveChanged[p] != 0;
+						}
+						if (dirty)
+						{
+							for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+							{
+								glm::vec3 primitiveMin, primitiveMax;
+								GetPrimitiveBounds(primitives[p], primitiveMin, primitiveMax);
+								minBounds = glm::min(minBounds, primitiveMin);
+								maxBounds = glm::max(maxBounds, primitiveMax);
+							}
+						}
+					}
+					else
+					{
+						const GPU::BVHNode& left = flatBVH[node.leftChild];
+						const GPU::BVHNode& right = flatBVH[node.rightChild];
+						dirty = m_NodeChanged[node.leftChild] || m_NodeChanged[node.rightChild];
+						minBounds = glm::min(left.minBounds, right.minBounds);
+						maxBounds = glm::max(left.maxBounds, right.maxBounds);
+					}
+
+					bool changed = dirty && (minBounds != node.minBounds || maxBounds != node.maxBounds);
+					if (changed)
+					{
+						node.minBounds = minBounds;
+						node.maxBounds = maxBounds;
+					}
+					m_NodeChanged[nodes[i]] = changed;
+				}
+			}
+		);
+	}
+
+	collectRanges(m_PrimitiveChanged, m_Options.mergeGap, m_ChangedPrimitiveRanges);
+	collectRanges(m_NodeChanged, m_Options.mergeGap, m_ChangedNodeRanges);
+
+	int changedNodes = static_cast<int>(std::count(m_NodeChanged.begin(), m_NodeChanged.end(), 1));
+	if (changedNodes > 0 && m_BuildCost > 0.0f)
+	{
+		m_Degradation = ComputeSAHCost(flatBVH) / m_BuildCost;
+	}
+	return changedNodes;
+}
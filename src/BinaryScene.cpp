@@ -0,0 +1,295 @@
+#include "BinaryScene.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+	constexpr char kSceneMagic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+	constexpr uint32_t kSceneVersion = 1;
+	constexpr uint32_t kByteOrderMark = 0x01020304;
+	constexpr uint64_t kAlignment = 64;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint64_t fileSize;
+		uint64_t tableOffset;
+		uint32_t sectionCount;
+		uint32_t pad[7];
+	};
+
+	struct SectionEntry
+	{
+		uint32_t kind;
+		uint32_t recordSize;
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	static_assert(sizeof(FileHeader) == 64, "rtscene header must stay 64 bytes");
+	static_assert(sizeof(parser::Vec3f) == 12 && sizeof(parser::Face) == 12, "records are written as they are in memory");
+	static_assert(sizeof(parser::Triangle) == 16 && sizeof(parser::Sphere) == 12 && sizeof(parser::PointLight) == 24,
+				  "records are written as they are in memory");
+	static_assert(std::is_trivially_copyable<parser::Triangle>::value && std::is_trivially_copyable<parser::Sphere>::value,
+				  "records are written as they are in memory");
+
+	class SectionWriter
+	{
+	public:
+		explicit SectionWriter(const std::string& filepath)
+			: m_Output(filepath, std::ios::binary | std::ios::trunc), m_Position(0)
+		{
+			if (!m_Output)
+			{
+				throw std::runtime_error("Error: Cannot write " + filepath + ".");
+			}
+			FileHeader header = {};
+			write(&header, sizeof(header));
+		}
+
+		template <typename T>
+		void Add(parser::BinarySection kind, const T* records, size_t count)
+		{
+			pad();
+			m_Sections.push_back({ static_cast<uint32_t>(kind), sizeof(T), m_Position, count });
+			write(records, count * sizeof(T));
+		}
+
+		void Finish()
+		{
+			pad();
+			FileHeader header = {};
+			std::memcpy(header.magic, kSceneMagic, sizeof(kSceneMagic));
+			header.version = kSceneVersion;
+			header.byteOrder = kByteOrderMark;
+			header.tableOffset = m_Position;
+			header.sectionCount = static_cast<uint32_t>(m_Sections.size());
+			header.fileSize = m_Position + m_Sections.size() * sizeof(SectionEntry);
+			write(m_Sections.data(), m_Sections.size() * sizeof(SectionEntry));
+
+			m_Output.seekp(0);
+			m_Output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			if (!m_Output)
+			{
+				throw std::runtime_error("Error: Writing the rtscene file failed.");
+			}
+		}
+
+	private:
+		void write(const void* data, size_t size)
+		{
+			m_Output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			m_Position += size;
+		}
+
+		void pad()
+		{
+			static const char zeros[kAlignment] = {};
+			write(zeros, (kAlignment - m_Position % kAlignment) % kAlignment);
+		}
+
+		std::ofstream m_Output;
+		uint64_t m_Position;
+		std::vector<SectionEntry> m_Sections;
+	};
+}
+
+parser::BinarySceneFile::BinarySceneFile(const std::string& filepath)
+	: m_Table(nullptr), m_SectionCount(0)
+{
+	if (!m_File.Open(filepath))
+	{
+		throw std::runtime_error("Error: The rtscene file cannot be loaded.");
+	}
+
+	FileHeader header;
+	uint64_t size = m_File.GetSize();
+	if (size < sizeof(header))
+	{
+		throw std::runtime_error("Error: The rtscene file is truncated.");
+	}
+	std::memcpy(&header, m_File.GetData(), sizeof(header));
+	if (std::memcmp(header.magic, kSceneMagic, sizeof(kSceneMagic)) != 0)
+	{
+		throw std::runtime_error("Error: Not an rtscene file.");
+	}
+	if (header.version != kSceneVersion || header.byteOrder != kByteOrderMark)
+	{
+		throw std::runtime_error("Error: Unsupported rtscene version or byte order.");
+	}
+	if (header.fileSize != size || header.tableOffset > size
+		|| uint64_t(header.sectionCount) * sizeof(SectionEntry) > size - header.tableOffset)
+	{
+		throw std::runtime_error("Error: The rtscene file is truncated.");
+	}
+
+	m_Table = m_File.GetData() + header.tableOffset;
+	m_SectionCount = header.sectionCount;
+	for (uint32_t i = 0; i < m_SectionCount; i++)
+	{
+		SectionEntry entry;
+		std::memcpy(&entry, m_Table + i * sizeof(SectionEntry), sizeof(entry));
+		if (entry.offset % kAlignment != 0 || entry.offset > size
+			|| (entry.recordSize != 0 && entry.count > (size - entry.offset) / entry.recordSize))
+		{
+			throw std::runtime_error("Error: Section " + std::to_string(entry.kind) + " of the rtscene file is out of bounds.");
+		}
+	}
+}
+
+const void* parser::BinarySceneFile::find(BinarySection kind, size_t recordSize, size_t& count) const
+{
+	for (uint32_t i = 0; i < m_SectionCount; i++)
+	{
+		SectionEntry entry;
+		std::memcpy(&entry, m_Table + i * sizeof(SectionEntry), sizeof(entry));
+		if (entry.kind != static_cast<uint32_t>(kind)) continue;
+		if (entry.recordSize != recordSize)
+		{
+			throw std::runtime_error("Error: Section " + std::to_string(entry.kind) + " of the rtscene file has records of "
+									 + std::to_string(entry.recordSize) + " bytes, expected " + std::to_string(recordSize) + ".");
+		}
+		count = static_cast<size_t>(entry.count);
+		return m_File.GetData() + entry.offset;
+	}
+	count = 0;
+	return nullptr;
+}
+
+bool parser::IsBinaryScene(const std::string& filepath)
+{
+	char magic[sizeof(kSceneMagic)] = {};
+	std::ifstream file(filepath, std::ios::binary);
+	file.read(magic, sizeof(magic));
+	return file && std::memcmp(magic, kSceneMagic, sizeof(kSceneMagic)) == 0;
+}
+
+void parser::Scene::loadFromBinary(const std::string &filepath)
+{
+	BinarySceneFile file(filepath);
+	size_t count;
+
+	const BinaryGlobals* globals = file.Get<BinaryGlobals>(BinarySection::Globals, count);
+	if (count != 1)
+	{
+		throw std::runtime_error("Error: The rtscene file has no globals section.");
+	}
+	background_color = globals->background_color;
+	shadow_ray_epsilon = globals->shadow_ray_epsilon;
+	max_recursion_depth = globals->max_recursion_depth;
+	ambient_light = globals->ambient_light;
+
+	const Vec3f* vertices = file.Get<Vec3f>(BinarySection::Vertices, count);
+	vertex_data.assign(vertices, vertices + count);
+
+	size_t nameCount;
+	const char* names = file.Get<char>(BinarySection::CameraNames, nameCount);
+	const BinaryCamera* binaryCameras = file.Get<BinaryCamera>(BinarySection::Cameras, count);
+	cameras.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const BinaryCamera& source = binaryCameras[i];
+		if (source.name_offset > nameCount || source.name_length > nameCount - source.name_offset)
+		{
+			throw std::runtime_error("Error: Camera " + std::to_string(i) + " of the rtscene file has its name out of bounds.");
+		}
+		cameras[i] = { source.position, source.gaze, source.up, source.near_plane, source.near_distance,
+					   source.image_width, source.image_height, std::string(names + source.name_offset, source.name_length) };
+	}
+
+	const BinaryMaterial* binaryMaterials = file.Get<BinaryMaterial>(BinarySection::Materials, count);
+	materials.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const BinaryMaterial& source = binaryMaterials[i];
+		materials[i] = { source.is_mirror != 0, source.ambient, source.diffuse, source.specular, source.mirror, source.phong_exponent };
+	}
+
+	const PointLight* lights = file.Get<PointLight>(BinarySection::PointLights, count);
+	point_lights.assign(lights, lights + count);
+
+	size_t faceCount;
+	const Face* faces = file.Get<Face>(BinarySection::Faces, faceCount);
+	const BinaryMesh* binaryMeshes = file.Get<BinaryMesh>(BinarySection::Meshes, count);
+	meshes.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const BinaryMesh& source = binaryMeshes[i];
+		if (source.first_face > faceCount || source.face_count > faceCount - source.first_face)
+		{
+			throw std::runtime_error("Error: Mesh " + std::to_string(i) + " of the rtscene file has faces out of bounds.");
+		}
+		meshes[i].material_id = source.material_id;
+		meshes[i].faces.assign(faces + source.first_face, faces + source.first_face + source.face_count);
+	}
+
+	const Triangle* binaryTriangles = file.Get<Triangle>(BinarySection::Triangles, count);
+	triangles.assign(binaryTriangles, binaryTriangles + count);
+
+	const Sphere* binarySpheres = file.Get<Sphere>(BinarySection::Spheres, count);
+	spheres.assign(binarySpheres, binarySpheres + count);
+}
+
+void parser::Scene::saveToBinary(const std::string &filepath) const
+{
+	SectionWriter writer(filepath);
+
+	BinaryGlobals globals = { background_color, shadow_ray_epsilon, max_recursion_depth, ambient_light };
+	writer.Add(BinarySection::Globals, &globals, 1);
+	writer.Add(BinarySection::Vertices, vertex_data.data(), vertex_data.size());
+
+	std::vector<BinaryCamera> binaryCameras;
+	std::string names;
+	for (const Camera& camera : cameras)
+	{
+		binaryCameras.push_back({ camera.position, camera.gaze, camera.up, camera.near_plane, camera.near_distance,
+								  camera.image_width, camera.image_height, static_cast<uint32_t>(names.size()),
+								  static_cast<uint32_t>(camera.image_name.size()) });
+		names += camera.image_name;
+	}
+	writer.Add(BinarySection::Cameras, binaryCameras.data(), binaryCameras.size());
+	writer.Add(BinarySection::CameraNames, names.data(), names.size());
+
+	std::vector<BinaryMaterial> binaryMaterials;
+	for (const Material& material : materials)
+	{
+		binaryMaterials.push_back({ material.is_mirror ? 1 : 0, material.ambient, material.diffuse, material.specular,
+									material.mirror, material.phong_exponent });
+	}
+	writer.Add(BinarySection::Materials, binaryMaterials.data(), binaryMaterials.size());
+	writer.Add(BinarySection::PointLights, point_lights.data(), point_lights.size());
+
+	std::vector<BinaryMesh> binaryMeshes;
+	std::vector<Face> faces;
+	for (const Mesh& mesh : meshes)
+	{
+		binaryMeshes.push_back({ mesh.material_id, 0, faces.size(), mesh.faces.size() });
+		faces.insert(faces.end(), mesh.faces.begin(), mesh.faces.end());
+	}
+	writer.Add(BinarySection::Meshes, binaryMeshes.data(), binaryMeshes.size());
+	writer.Add(BinarySection::Faces, faces.data(), faces.size());
+	writer.Add(BinarySection::Triangles, triangles.data(), triangles.size());
+	writer.Add(BinarySection::Spheres, spheres.data(), spheres.size());
+
+	writer.Finish();
+}
+
+void parser::Scene::load(const std::string &filepath, bool streamXml, ThreadPool* threadPool)
+{
+	if (IsBinaryScene(filepath))
+	{
+		loadFromBinary(filepath);
+	}
+	else if (streamXml)
+	{
+		loadFromXmlStream(filepath, threadPool);
+	}
+	else
+	{
+		loadFromXml(filepath, threadPool);
+	}
+}
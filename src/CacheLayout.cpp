@@ -0,0 +1,373 @@
+#include "CacheLayout.h"
+#include "LBVH.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+float surfaceArea(const GPU::BVHNode& node)
+{
+	glm::vec3 d = node.maxBounds - node.minBounds;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// Greedy subtree clustering: a block grows from its root by always taking the
+// frontier node with the largest surface area, the one a ray that reached the
+// block is most likely to visit next. Whatever is left on the frontier when
+// the block is full roots the following blocks, depth first.
+void treeletOrder(const std::vector<GPU::BVHNode>& flatBVH, int nodesPerBlock, std::vector<int>& order)
+{
+	std::vector<int> blockRoots = { 0 };
+	std::vector<int> frontier;
+	while (!blockRoots.empty())
+	{
+		frontier.assign(1, blockRoots.back());
+		blockRoots.pop_back();
+
+		for (int size = 0; size < nodesPerBlock && !frontier.empty(); size++)
+		{
+			auto best = std::max_element(frontier.begin(), frontier.end(), [&](int a, int b)
+				{
+					return surfaceArea(flatBVH[a]) < surfaceArea(flatBVH[b]);
+				}
+			);
+			int nodeIndex = *best;
+			frontier.erase(best);
+			order.push_back(nodeIndex);
+
+			const GPU::BVHNode& node = flatBVH[nodeIndex];
+			if (node.primitiveCount == 0)
+			{
+				frontier.push_back(node.leftChild);
+				frontier.push_back(node.rightChild);
+			}
+		}
+
+		// Reversed so that the left-most remaining subtree is laid out next.
+		blockRoots.insert(blockRoots.end(), frontier.rbegin(), frontier.rend());
+	}
+}
+
+int subtreeHeight(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex, std::vector<int>& heights)
+{
+	const GPU::BVHNode& node = flatBVH[nodeIndex];
+	int height = 1;
+	if (node.primitiveCount == 0)
+	{
+		height += std::max(subtreeHeight(flatBVH, node.leftChild, heights), subtreeHeight(flatBVH, node.rightChild, heights));
+	}
+	heights[nodeIndex] = height;
+	return height;
+}
+
+void collectAtDepth(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex, int depth, std::vector<int>& nodes)
+{
+	if (depth == 0)
+	{
+		nodes.push_back(nodeIndex);
+		return;
+	}
+	const GPU::BVHNode& node = flatBVH[nodeIndex];
+	if (node.primitiveCount == 0)
+	{
+		collectAtDepth(flatBVH, node.leftChild, depth - 1, nodes);
+		collectAtDepth(flatBVH, node.rightChild, depth - 1, nodes);
+	}
+}
+
+// Lays out the top levels levels of the subtree at nodeIndex: the upper half
+// of them first, then every subtree hanging below it, each recursively.
+void vanEmdeBoasOrder(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<int>& heights, int nodeIndex,
+					  int levels, std::vector<int>& order)
+{
+	levels = std::min(levels, heights[nodeIndex]);
+	if (levels == 1)
+	{
+		order.push_back(nodeIndex);
+		return;
+	}
+
+	int topLevels = levels / 2;
+	vanEmdeBoasOrder(flatBVH, heights, nodeIndex, topLevels, order);
+
+	std::vector<int> bottomRoots;
+	collectAtDepth(flatBVH, nodeIndex, topLevels, bottomRoots);
+	for (int root : bottomRoots)
+	{
+		vanEmdeBoasOrder(flatBVH, heights, root, levels - topLevels, order);
+	}
+}
+
+}
+
+void ReorderBVH(std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::Primitive>& primitives,
+				const CacheLayoutOptions& options, std::vector<int>* primitiveIndices)
+{
+	if (flatBVH.empty()) return;
+
+	std::vector<int> order;
+	order.reserve(flatBVH.size());
+	if (options.order == NodeOrder::Treelet)
+	{
+		int nodesPerBlock = std::max(1, options.blockBytes / static_cast<int>(sizeof(GPU::BVHNode)));
+		treeletOrder(flatBVH, nodesPerBlock, order);
+	}
+	else if (options.order == NodeOrder::VanEmdeBoas)
+	{
+		std::vector<int> heights(flatBVH.size());
+		int height = subtreeHeight(flatBVH, 0, heights);
+		vanEmdeBoasOrder(flatBVH, heights, 0, height, order);
+	}
+	else
+	{
+		for (int i = 0; i < static_cast<int>(flatBVH.size()); i++)
+		{
+			order.push_back(i);
+		}
+	}
+
+	std::vector<int> newIndex(flatBVH.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		newIndex[order[i]] = static_cast<int>(i);
+	}
+
+	// Leaves take their primitives in the new node order, which keeps the
+	// primitives of a treelet together as well.
+	std::vector<GPU::BVHNode> nodes(flatBVH.size());
+	std::vector<GPU::Primitive> reordered;
+	std::vector<int> reorderedIndices;
+	std::vector<std::pair<uint64_t, int>> keys;
+	reordered.reserve(primitives.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		GPU::BVHNode node = flatBVH[order[i]];
+		if (node.primitiveCount == 0)
+		{
+			node.leftChild = newIndex[node.leftChild];
+			node.rightChild = newIndex[node.rightChild];
+			nodes[i] = node;
+			continue;
+		}
+
+		glm::vec3 extent = glm::max(node.maxBounds - node.minBounds, glm::vec3(1e-20f));
+		keys.clear();
+		for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+		{
+			glm::vec3 minBounds, maxBounds;
+			GetPrimitiveBounds(primitives[p], minBounds, maxBounds);
+			keys.emplace_back(MortonCode(((minBounds + maxBounds) * 0.5f - node.minBounds) / extent), p);
+		}
+		std::stable_sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		node.primitiveOffset = static_cast<int>(reordered.size());
+		for (const auto& key : keys)
+		{
+			reordered.push_back(primitives[key.second]);
+			if (primitiveIndices != nullptr)
+			{
+				reorderedIndices.push_back((*primitiveIndices)[key.second]);
+			}
+		}
+		nodes[i] = node;
+	}
+
+	flatBVH.swap(nodes);
+	primitives.swap(reordered);
+	if (primitiveIndices != nullptr)
+	{
+		primitiveIndices->swap(reorderedIndices);
+	}
+}
+
+void ReorderVertices(parser::Scene& scene)
+{
+	size_t count = scene.vertex_data.size();
+	if (count == 0) return;
+
+	glm::vec3 minBounds(INFINITY), maxBounds(-INFINITY);
+	for (const parser::Vec3f& v : scene.vertex_data)
+	{
+		minBounds = glm::min(minBounds, glm::vec3(v.x, v.y, v.z));
+		maxBounds = glm::max(maxBounds, glm::vec3(v.x, v.y, v.z));
+	}
+	glm::vec3 extent = glm::max(maxBounds - minBounds, glm::vec3(1e-20f));
+
+	std::vector<std::pair<uint64_t, int>> keys(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const parser::Vec3f& v = scene.vertex_data[i];
+		keys[i] = { MortonCode((glm::vec3(v.x, v.y, v.z) - minBounds) / extent, true), static_cast<int>(i) };
+	}
+	std::stable_sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	// Ids are 1 based.
+	std::vector<parser::Vec3f> vertices(count);
+	std::vector<int> newId(count + 1);
+	for (size_t i = 0; i < count; i++)
+	{
+		vertices[i] = scene.vertex_data[keys[i].second];
+		newId[keys[i].second + 1] = static_cast<int>(i) + 1;
+	}
+	scene.vertex_data.swap(vertices);
+
+	auto remap = [&newId](parser::Face& face)
+	{
+		face.v0_id = newId[face.v0_id];
+		face.v1_id = newId[face.v1_id];
+		face.v2_id = newId[face.v2_id];
+	};
+	for (parser::Mesh& mesh : scene.meshes)
+	{
+		for (parser::Face& face : mesh.faces)
+		{
+			remap(face);
+		}
+	}
+	for (parser::Triangle& triangle : scene.triangles)
+	{
+		remap(triangle.indices);
+	}
+	for (parser::Sphere& sphere : scene.spheres)
+	{
+		sphere.center_vertex_id = newId[sphere.center_vertex_id];
+	}
+}
+
+CacheSimulator::CacheSimulator(size_t cacheBytes, int lineBytes, int ways)
+	: m_LineShift(0), m_Ways(std::max(ways, 1))
+{
+	while ((1 << (m_LineShift + 1)) <= lineBytes)
+	{
+		m_LineShift++;
+	}
+	m_SetCount = std::max(1, static_cast<int>(cacheBytes >> m_LineShift) / m_Ways);
+	Reset();
+}
+
+void CacheSimulator::Reset()
+{
+	m_Tags.assign(static_cast<size_t>(m_SetCount) * m_Ways, 0);
+	m_Valid.assign(m_SetCount, 0);
+	m_Accesses = 0;
+	m_Misses = 0;
+}
+
+void CacheSimulator::Access(uint64_t address, size_t bytes)
+{
+	uint64_t firstLine = address >> m_LineShift;
+	uint64_t lastLine = (address + std::max<size_t>(bytes, 1) - 1) >> m_LineShift;
+	for (uint64_t line = firstLine; line <= lastLine; line++)
+	{
+		m_Accesses++;
+		int set = static_cast<int>(line % m_SetCount);
+		uint64_t* tags = &m_Tags[static_cast<size_t>(set) * m_Ways];
+		int valid = m_Valid[set];
+
+		int way = 0;
+		while (way < valid && tags[way] != line)
+		{
+			way++;
+		}
+		if (way == valid)
+		{
+			m_Misses++;
+			if (valid < m_Ways)
+			{
+				m_Valid[set]++;
+			}
+			way = std::min(way, m_Ways - 1);
+		}
+
+		// Move the line to the front, dropping the least recently used one on a miss.
+		std::move_backward(tags, tags + way, tags + way + 1);
+		tags[0] = line;
+	}
+}
+
+CacheReport SimulateTraversalCache(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+								   CacheSimulator& cache, int rayGridSize)
+{
+	CacheReport report = {};
+	if (flatBVH.empty()) return report;
+
+	// The arrays get page aligned addresses far apart from each other.
+	const uint64_t nodeBase = 0;
+	const uint64_t primitiveBase = uint64_t(1) << 40;
+
+	// Look mostly across the thinnest side of the scene, so flat scenes fill the view.
+	glm::vec3 extent = glm::max(flatBVH[0].maxBounds - flatBVH[0].minBounds, glm::vec3(1e-6f));
+	glm::vec3 center = (flatBVH[0].minBounds + flatBVH[0].maxBounds) * 0.5f;
+	float diagonal = glm::length(extent);
+	glm::vec3 front = -glm::normalize(glm::vec3(1.0f) / extent + glm::vec3(0.1f / glm::min(extent.x, glm::min(extent.y, extent.z))));
+	glm::vec3 right = glm::normalize(glm::cross(front, std::fabs(front.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+	glm::vec3 up = glm::cross(right, front);
+	glm::vec3 eye = center - front * diagonal;
+
+	// Rays are traced in 8x8 tiles, roughly how a GPU schedules fragments.
+	const int tileSize = 8;
+	std::vector<int> stack;
+	for (int tileY = 0; tileY < rayGridSize; tileY += tileSize)
+	{
+		for (int tileX = 0; tileX < rayGridSize; tileX += tileSize)
+		{
+			for (int y = tileY; y < std::min(tileY + tileSize, rayGridSize); y++)
+			{
+				for (int x = tileX; x < std::min(tileX + tileSize, rayGridSize); x++)
+				{
+					float u = ((x + 0.5f) / rayGridSize - 0.5f) * diagonal;
+					float v = ((y + 0.5f) / rayGridSize - 0.5f) * diagonal;
+					glm::vec3 direction = glm::normalize(center + right * u + up * v - eye);
+					glm::vec3 invDir = 1.0f / direction;
+					float closest = INFINITY;
+					report.rays++;
+
+					stack.assign(1, 0);
+					while (!stack.empty())
+					{
+						int nodeIndex = stack.back();
+						stack.pop_back();
+
+						uint64_t misses = cache.GetMisses();
+						cache.Access(nodeBase + nodeIndex * sizeof(GPU::BVHNode), sizeof(GPU::BVHNode));
+						report.nodeVisits++;
+						report.nodeMisses += cache.GetMisses() - misses;
+
+						const GPU::BVHNode& node = flatBVH[nodeIndex];
+						glm::vec3 t0 = (node.minBounds - eye) * invDir;
+						glm::vec3 t1 = (node.maxBounds - eye) * invDir;
+						glm::vec3 tSmall = glm::min(t0, t1);
+						glm::vec3 tBig = glm::max(t0, t1);
+						float tmin = std::max(std::max(tSmall.x, tSmall.y), tSmall.z);
+						float tmax = std::min(std::min(tBig.x, tBig.y), tBig.z);
+						if (!(tmax > std::max(0.0f, tmin))) continue;
+
+						if (node.primitiveCount == 0)
+						{
+							stack.push_back(node.leftChild);
+							stack.push_back(node.rightChild);
+							continue;
+						}
+
+						for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+						{
+							misses = cache.GetMisses();
+							cache.Access(primitiveBase + p * sizeof(GPU::Primitive), sizeof(GPU::Primitive));
+							report.primitiveVisits++;
+							report.primitiveMisses += cache.GetMisses() - misses;
+
+							float t;
+							if (IntersectPrimitive(primitives[p], eye, direction, t) && t < closest)
+							{
+								closest = t;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	return report;
+}
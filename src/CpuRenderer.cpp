@@ -0,0 +1,596 @@
+#include "CpuRenderer.h"
+#include "BVHBuilder.h"
+#include "RayPacket.h"
+#include "Utils.h"
+#include "WideBVH.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+	template <typename Real>
+	BasicVec3<Real> reflect(const BasicVec3<Real>& direction, const BasicVec3<Real>& normal)
+	{
+		return direction - normal * (2 * direction.dot(normal));
+	}
+
+	uint8_t toByte(double value)
+	{
+		return static_cast<uint8_t>(std::lround(std::min(255.0, std::max(0.0, value))));
+	}
+
+	// Primary rays of a camera. Pixel (i, j) is sampled at its center on the
+	// near plane, j counting rows from the top.
+	template <typename Real>
+	struct CameraRays
+	{
+		using Vec3 = BasicVec3<Real>;
+
+		explicit CameraRays(const parser::Camera& camera)
+		{
+			eye = Vec3(camera.position);
+			Vec3 gaze = Vec3(camera.gaze).normalize();
+			Vec3 w = gaze * -1.0;
+			u = Vec3(camera.up).cross(w).normalize();
+			v = w.cross(u);
+			const parser::Vec4f& plane = camera.near_plane;
+			topLeft = eye + gaze * camera.near_distance + u * plane.x + v * plane.w;
+			pixelWidth = (plane.y - plane.x) / camera.image_width;
+			pixelHeight = (plane.w - plane.z) / camera.image_height;
+		}
+
+		BasicRay<Real> Generate(int i, int j) const
+		{
+			Vec3 pixel = topLeft + u * ((i + Real(0.5)) * pixelWidth) - v * ((j + Real(0.5)) * pixelHeight);
+			return BasicRay<Real>(eye, pixel - eye);
+		}
+
+		Vec3 eye, u, v, topLeft;
+		Real pixelWidth, pixelHeight;
+	};
+
+	// Pixels covered by one packet, as square as the size allows.
+	int packetWidth(int packetSize)
+	{
+		return packetSize <= 4 ? 2 : 4;
+	}
+
+	// Leaves of up to one triangle block, costed by the blocks they test.
+	BVHBuildOptions blockBuildOptions(ThreadPool* threadPool)
+	{
+		BVHBuildOptions options;
+		options.threadPool = threadPool;
+		options.maxLeafSize = kTriangleBlockWidth;
+		options.leafBlockWidth = kTriangleBlockWidth;
+		return options;
+	}
+
+	template <typename Real>
+	glm::vec3 toGlm(const BasicVec3<Real>& v)
+	{
+		return glm::vec3(static_cast<float>(v.x), static_cast<float>(v.y), static_cast<float>(v.z));
+	}
+
+	template <int Size, typename Real>
+	void loadPacket(RayPacket<Size>& packet, const BasicRay<Real>* rays, int count)
+	{
+		for (int i = 0; i < Size; i++)
+		{
+			const BasicRay<Real>& ray = rays[i < count ? i : 0];
+			packet.originX[i] = static_cast<float>(ray.origin.x);
+			packet.originY[i] = static_cast<float>(ray.origin.y);
+			packet.originZ[i] = static_cast<float>(ray.origin.z);
+			packet.directionX[i] = static_cast<float>(ray.direction.x);
+			packet.directionY[i] = static_cast<float>(ray.direction.y);
+			packet.directionZ[i] = static_cast<float>(ray.direction.z);
+			packet.t[i] = i < count ? INFINITY : -1.0f;
+		}
+	}
+
+	// Times TracePacket over every pixel of a frame, the packets being built
+	// beforehand, and counts the pixels whose closest hit distance differs from
+	// the single ray one.
+	template <int Size>
+	double benchmarkPackets(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+							const CameraRays<float>& cameraRays, int width, int height, int iterations,
+							const std::vector<TraceResult>& reference, int& mismatches)
+	{
+		int blockWidth = packetWidth(Size);
+		int blockHeight = Size / blockWidth;
+		std::vector<RayPacket<Size>> packets;
+		std::vector<int> pixels;
+		for (int by = 0; by < height; by += blockHeight)
+		{
+			for (int bx = 0; bx < width; bx += blockWidth)
+			{
+				Ray rays[Size];
+				int count = 0;
+				for (int dy = 0; dy < blockHeight; dy++)
+				{
+					for (int dx = 0; dx < blockWidth; dx++)
+					{
+						int i = bx + dx, j = by + dy;
+						if (i >= width || j >= height) continue;
+						rays[count++] = cameraRays.Generate(i, j);
+						pixels.push_back(j * width + i);
+					}
+				}
+				packets.emplace_back();
+				loadPacket(packets.back(), rays, count);
+				pixels.resize(packets.size() * Size, -1);
+			}
+		}
+
+		std::vector<RayPacket<Size>> traced(packets.size());
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t k = 0; k < packets.size(); k++)
+			{
+				traced[k] = packets[k];
+				TracePacket(flatBVH, primitives, traced[k]);
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		mismatches = 0;
+		for (size_t k = 0; k < traced.size(); k++)
+		{
+			for (int lane = 0; lane < Size; lane++)
+			{
+				int pixel = pixels[k * Size + lane];
+				if (pixel >= 0 && traced[k].t[lane] != reference[pixel].t) mismatches++;
+			}
+		}
+		return seconds;
+	}
+
+	// Traces the same rays one at a time through the flat BVH collapsed to
+	// Width-wide nodes, and counts those whose closest hit distance differs.
+	template <int Width>
+	double benchmarkWide(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+						 const std::vector<glm::vec3>& origins, const std::vector<glm::vec3>& directions, int iterations,
+						 const std::vector<TraceResult>& reference, int& mismatches)
+	{
+		std::vector<GPU::WideBVHNode<Width>> wideBVH;
+		CollapseBVH(flatBVH, wideBVH);
+
+		TraceResult result;
+		mismatches = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t k = 0; k < origins.size(); k++)
+			{
+				TraceWideBVH(wideBVH, primitives, origins[k], directions[k], result);
+				if (iteration == 0 && result.t != reference[k].t) mismatches++;
+			}
+		}
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+template <typename Real>
+BasicCpuRenderer<Real>::BasicCpuRenderer(const CpuRenderOptions& options)
+	: m_Options(options)
+{
+	if (m_Options.packetSize > 0)
+	{
+		std::vector<GPU::Primitive> scenePrimitives;
+		ExtractPrimitives(scenePrimitives, scene);
+		if (scenePrimitives.empty()) return;
+		BVHBuilder(blockBuildOptions(m_Options.threadPool)).Build(scenePrimitives, m_FlatBVH, m_Primitives);
+		BuildLeafBlocks(m_FlatBVH, m_Primitives, m_LeafBlocks);
+		return;
+	}
+
+	BVHBuildOptions buildOptions;
+	buildOptions.threadPool = m_Options.threadPool;
+	m_Scene = BasicCpuScene<Real>(scene, buildOptions);
+}
+
+template <typename Real>
+bool BasicCpuRenderer<Real>::Hit(const Ray& ray, HitRecord& rec) const
+{
+	if (!m_FlatBVH.empty())
+	{
+		TraceResult result;
+		if (!TraceBVH(m_FlatBVH, m_LeafBlocks, m_Primitives, toGlm(ray.origin), toGlm(ray.direction), result)) return false;
+		FillHitRecord(ray, result.t, result.primitiveIndex, rec);
+		return true;
+	}
+	return m_Scene.Hit(ray, BasicInterval<Real>(0, INFINITY), rec);
+}
+
+template <typename Real>
+void BasicCpuRenderer<Real>::FillHitRecord(const Ray& ray, float t, int primitiveIndex, HitRecord& rec) const
+{
+	const GPU::Primitive& primitive = m_Primitives[primitiveIndex];
+	Vec3 v0(primitive.vertexData[0].x, primitive.vertexData[0].y, primitive.vertexData[0].z);
+	rec.t = t;
+	rec.p = ray.origin + ray.direction * rec.t;
+	rec.material_id = primitive.materialId;
+	if (primitive.type == 0)
+	{
+		Vec3 v1(primitive.vertexData[1].x, primitive.vertexData[1].y, primitive.vertexData[1].z);
+		Vec3 v2(primitive.vertexData[2].x, primitive.vertexData[2].y, primitive.vertexData[2].z);
+		rec.normal = (v1 - v0).cross(v2 - v0).normalize();
+	}
+	else
+	{
+		rec.normal = (rec.p - v0).normalize();
+	}
+}
+
+template <typename Real>
+template <int Size>
+void BasicCpuRenderer<Real>::TracePrimary(const Ray* rays, int count, HitRecord* recs, bool* hits) const
+{
+	RayPacket<Size> packet;
+	loadPacket(packet, rays, count);
+	TracePacket(m_FlatBVH, m_Primitives, packet);
+	for (int i = 0; i < count; i++)
+	{
+		hits[i] = packet.primitiveIndex[i] >= 0;
+		if (hits[i]) FillHitRecord(rays[i], packet.t[i], packet.primitiveIndex[i], recs[i]);
+	}
+}
+
+template <typename Real>
+BasicVec3<Real> BasicCpuRenderer<Real>::Shade(const Ray& ray, const HitRecord& rec, int depth, uint64_t& rayCount) const
+{
+	const parser::Material& material = scene.materials[rec.material_id - 1];
+	Vec3 normal = rec.normal;
+	Vec3 offsetPoint = rec.p + normal * scene.shadow_ray_epsilon;
+	Vec3 wo = (ray.origin - rec.p).normalize();
+	Vec3 color = Vec3(scene.ambient_light) * Vec3(material.ambient);
+
+	for (const parser::PointLight& light : scene.point_lights)
+	{
+		Vec3 wi = Vec3(light.position) - rec.p;
+		Real distance = wi.length();
+		wi = wi / distance;
+
+		HitRecord shadowRec;
+		rayCount++;
+		if (Hit(Ray(offsetPoint, wi), shadowRec) && shadowRec.t < distance) continue;
+
+		Vec3 irradiance = Vec3(light.intensity) / (distance * distance);
+		Real cosTheta = std::max(Real(0), normal.dot(wi));
+		Vec3 h = (wi + wo).normalize();
+		Real cosAlpha = std::max(Real(0), normal.dot(h));
+		color = color + Vec3(material.diffuse) * irradiance * cosTheta
+			+ Vec3(material.specular) * irradiance * std::pow(cosAlpha, static_cast<Real>(material.phong_exponent));
+	}
+
+	if (material.is_mirror && depth < scene.max_recursion_depth)
+	{
+		Ray reflected(offsetPoint, reflect(ray.direction, normal));
+		HitRecord reflectedRec;
+		rayCount++;
+		if (Hit(reflected, reflectedRec))
+		{
+			color = color + Vec3(material.mirror) * Shade(reflected, reflectedRec, depth + 1, rayCount);
+		}
+	}
+	return color;
+}
+
+template <typename Real>
+CpuRenderStats BasicCpuRenderer<Real>::Render(const parser::Camera& camera, Image& image,
+											  const std::function<void(const Image&, int)>& onPass) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	image.width = camera.image_width;
+	image.height = camera.image_height;
+	image.pixels.assign(static_cast<size_t>(image.width) * image.height * 3, 0);
+
+	CameraRays<Real> cameraRays(camera);
+	Vec3 background(scene.background_color);
+	int packetSize = m_FlatBVH.empty() ? 0 : m_Options.packetSize;
+	int blockWidth = packetSize > 0 ? packetWidth(packetSize) : 1;
+	int blockHeight = packetSize > 0 ? packetSize / blockWidth : 1;
+
+	int tileSize = std::max(1, m_Options.tileSize);
+	std::vector<Tile> tiles = OrderTiles(image.width, image.height, tileSize, m_Options.tileOrder);
+	TileScheduler scheduler(m_Options.threadPool);
+	std::atomic<uint64_t> rayCount(0);
+
+	CpuRenderStats stats;
+	stats.threads.resize(scheduler.GetThreadCount());
+
+	// The grid of every pass has to line up with the tiles, so that no pixel
+	// of a tile is left to a grid point of another one.
+	int passCount = std::max(0, m_Options.progressivePasses) + 1;
+	while (passCount > 1 && tileSize % (1 << (passCount - 1)) != 0) passCount--;
+
+	for (int pass = 0; pass < passCount; pass++)
+	{
+		int step = 1 << (passCount - 1 - pass);
+		int coarserStep = pass == 0 ? 0 : step * 2;
+
+		auto renderTile = [&](int tileIndex, int)
+		{
+			const Tile& tile = tiles[tileIndex];
+			uint64_t tileRays = 0;
+			// Blocks of neighbouring grid points, one per packet; single points without packets.
+			for (int by = tile.y0; by < tile.y1; by += blockHeight * step)
+			{
+				for (int bx = tile.x0; bx < tile.x1; bx += blockWidth * step)
+				{
+					Ray rays[16];
+					int pixelX[16];
+					int pixelY[16];
+					int count = 0;
+					for (int j = by; j < std::min(by + blockHeight * step, tile.y1); j += step)
+					{
+						for (int i = bx; i < std::min(bx + blockWidth * step, tile.x1); i += step)
+						{
+							if (coarserStep > 0 && i % coarserStep == 0 && j % coarserStep == 0) continue;
+							rays[count] = cameraRays.Generate(i, j);
+							pixelX[count] = i;
+							pixelY[count++] = j;
+						}
+					}
+					if (count == 0) continue;
+
+					HitRecord recs[16];
+					bool hits[16];
+					switch (packetSize)
+					{
+					case 0: hits[0] = Hit(rays[0], recs[0]); break;
+					case 4: TracePrimary<4>(rays, count, recs, hits); break;
+					case 8: TracePrimary<8>(rays, count, recs, hits); break;
+					default: TracePrimary<16>(rays, count, recs, hits); break;
+					}
+
+					for (int k = 0; k < count; k++)
+					{
+						tileRays++;
+						Vec3 color = hits[k] ? Shade(rays[k], recs[k], 0, tileRays) : background;
+						uint8_t rgb[3] = { toByte(color.x), toByte(color.y), toByte(color.z) };
+						for (int y = pixelY[k]; y < std::min(pixelY[k] + step, tile.y1); y++)
+						{
+							for (int x = pixelX[k]; x < std::min(pixelX[k] + step, tile.x1); x++)
+							{
+								uint8_t* out = &image.pixels[(static_cast<size_t>(y) * image.width + x) * 3];
+								out[0] = rgb[0];
+								out[1] = rgb[1];
+								out[2] = rgb[2];
+							}
+						}
+					}
+				}
+			}
+			rayCount += tileRays;
+		};
+
+		auto passStart = std::chrono::high_resolution_clock::now();
+		std::vector<TileThreadStats> passStats = scheduler.Run(static_cast<int>(tiles.size()), renderTile);
+		stats.tileSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - passStart).count();
+		for (size_t t = 0; t < passStats.size(); t++)
+		{
+			stats.threads[t].tiles += passStats[t].tiles;
+			stats.threads[t].steals += passStats[t].steals;
+			stats.threads[t].busySeconds += passStats[t].busySeconds;
+		}
+
+		if (onPass && pass + 1 < passCount) onPass(image, pass);
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	stats.rayCount = rayCount.load();
+	return stats;
+}
+
+template class BasicCpuRenderer<float>;
+template class BasicCpuRenderer<double>;
+
+namespace
+{
+	template <typename Real>
+	void renderCameras(const CpuRenderOptions& options)
+	{
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		BasicCpuRenderer<Real> renderer(options);
+		std::cout << "CPU BVH built in "
+				  << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count()
+				  << " ms" << std::endl;
+
+		if (scene.cameras.empty())
+		{
+			std::cout << "The scene has no cameras to render" << std::endl;
+		}
+		for (size_t i = 0; i < scene.cameras.size(); i++)
+		{
+			const parser::Camera& camera = scene.cameras[i];
+			std::string imageName = camera.image_name.empty() ? "camera" + std::to_string(i + 1) + ".ppm" : camera.image_name;
+
+			Image image;
+			CpuRenderStats stats = renderer.Render(camera, image, [&imageName](const Image& passImage, int pass)
+			{
+				if (WriteImage(imageName, passImage))
+				{
+					std::cout << "Wrote pass " << pass + 1 << " of " << imageName << std::endl;
+				}
+			});
+			if (!WriteImage(imageName, image))
+			{
+				std::cerr << "Could not write " << imageName << std::endl;
+				continue;
+			}
+			std::cout << "Rendered " << imageName << " (" << image.width << "x" << image.height << ") in "
+					  << stats.seconds * 1000.0 << " ms, " << stats.rayCount << " rays, "
+					  << stats.rayCount / stats.seconds / 1e6 << " Mrays/s" << std::endl;
+
+			// Time in tiles over the wall time of the passes; threads far below
+			// the others call for smaller tiles.
+			std::cout << "Thread utilization:";
+			int steals = 0;
+			for (const TileThreadStats& thread : stats.threads)
+			{
+				std::cout << " " << std::lround(100.0 * thread.busySeconds / stats.tileSeconds) << "% (" << thread.tiles << " tiles)";
+				steals += thread.steals;
+			}
+			std::cout << ", " << steals << " steals" << std::endl;
+		}
+	}
+
+	template <typename Real>
+	double timeBuild(const CpuRenderOptions& options, std::unique_ptr<BasicCpuRenderer<Real>>& renderer)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		renderer.reset(new BasicCpuRenderer<Real>(options));
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void RenderSceneCameras(const CpuRenderOptions& options)
+{
+	if (options.doublePrecision)
+	{
+		renderCameras<double>(options);
+	}
+	else
+	{
+		renderCameras<float>(options);
+	}
+}
+
+void ComparePrecision(const CpuRenderOptions& options)
+{
+	CpuRenderOptions hittableOptions = options;
+	hittableOptions.packetSize = 0;
+	std::unique_ptr<BasicCpuRenderer<float>> floatRenderer;
+	std::unique_ptr<BasicCpuRenderer<double>> doubleRenderer;
+	double floatBuild = timeBuild(hittableOptions, floatRenderer);
+	double doubleBuild = timeBuild(hittableOptions, doubleRenderer);
+	std::cout << "Triangles take " << sizeof(TriangleData<float>) << " bytes as float, " << sizeof(TriangleData<double>)
+			  << " as double; BVH built in " << floatBuild << " ms as float, " << doubleBuild << " ms as double" << std::endl;
+
+	for (size_t i = 0; i < scene.cameras.size(); i++)
+	{
+		Image floatImage, doubleImage;
+		CpuRenderStats floatStats = floatRenderer->Render(scene.cameras[i], floatImage);
+		CpuRenderStats doubleStats = doubleRenderer->Render(scene.cameras[i], doubleImage);
+
+		// Off by one levels are rounding of nearly equal colors, anything more is a different hit.
+		size_t pixelCount = floatImage.pixels.size() / 3;
+		size_t differingPixels = 0;
+		int largestDifference = 0;
+		for (size_t p = 0; p < pixelCount; p++)
+		{
+			int difference = 0;
+			for (int c = 0; c < 3; c++)
+			{
+				difference = std::max(difference, std::abs(floatImage.pixels[p * 3 + c] - doubleImage.pixels[p * 3 + c]));
+			}
+			differingPixels += difference > 1;
+			largestDifference = std::max(largestDifference, difference);
+		}
+
+		std::cout << "Camera " << i + 1 << " (" << floatImage.width << "x" << floatImage.height << "): float "
+				  << floatStats.seconds * 1000.0 << " ms, " << floatStats.rayCount / floatStats.seconds / 1e6
+				  << " Mrays/s; double " << doubleStats.seconds * 1000.0 << " ms, "
+				  << doubleStats.rayCount / doubleStats.seconds / 1e6 << " Mrays/s; float is "
+				  << doubleStats.seconds / floatStats.seconds << "x as fast" << std::endl;
+		std::cout << "  " << differingPixels << " pixels (" << 100.0 * differingPixels / std::max<size_t>(pixelCount, 1)
+				  << "%) differ by more than one level, by at most " << largestDifference << std::endl;
+	}
+}
+
+void BenchmarkPacketTracing(int iterations)
+{
+	std::vector<GPU::Primitive> scenePrimitives;
+	std::vector<GPU::BVHNode> flatBVH;
+	std::vector<GPU::Primitive> primitives;
+	ExtractPrimitives(scenePrimitives, scene);
+	if (!scenePrimitives.empty()) BVHBuilder().Build(scenePrimitives, flatBVH, primitives);
+
+	// Blocks get a tree of their own, with leaves as large as a block.
+	std::vector<GPU::BVHNode> blockBVH;
+	std::vector<GPU::Primitive> blockPrimitives;
+	LeafBlocks<kTriangleBlockWidth> leafBlocks;
+	if (!scenePrimitives.empty()) BVHBuilder(blockBuildOptions(nullptr)).Build(scenePrimitives, blockBVH, blockPrimitives);
+	BuildLeafBlocks(blockBVH, blockPrimitives, leafBlocks);
+	iterations = std::max(1, iterations);
+
+	if (scene.cameras.empty())
+	{
+		std::cout << "The scene has no cameras to trace" << std::endl;
+	}
+	for (size_t c = 0; c < scene.cameras.size(); c++)
+	{
+		const parser::Camera& camera = scene.cameras[c];
+		CameraRays<float> cameraRays(camera);
+		int width = camera.image_width, height = camera.image_height;
+		double rayCount = static_cast<double>(width) * height * iterations;
+
+		std::vector<glm::vec3> origins, directions;
+		for (int j = 0; j < height; j++)
+		{
+			for (int i = 0; i < width; i++)
+			{
+				Ray ray = cameraRays.Generate(i, j);
+				origins.push_back(toGlm(ray.origin));
+				directions.push_back(toGlm(ray.direction));
+			}
+		}
+
+		std::vector<TraceResult> reference(origins.size());
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t k = 0; k < origins.size(); k++)
+			{
+				TraceBVH(flatBVH, primitives, origins[k], directions[k], reference[k]);
+			}
+		}
+		double singleSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "Camera " << c + 1 << " (" << width << "x" << height << ")" << std::endl;
+		std::cout << "  single ray: " << rayCount / singleSeconds / 1e6 << " Mrays/s" << std::endl;
+
+		TraceResult blockResult;
+		int blockMismatches = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t k = 0; k < origins.size(); k++)
+			{
+				TraceBVH(blockBVH, leafBlocks, blockPrimitives, origins[k], directions[k], blockResult);
+				if (iteration == 0 && blockResult.t != reference[k].t) blockMismatches++;
+			}
+		}
+		double blockSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "  single ray, " << kTriangleBlockWidth << " triangle blocks: " << rayCount / blockSeconds / 1e6
+				  << " Mrays/s (" << singleSeconds / blockSeconds << "x), " << blockMismatches << " rays differ" << std::endl;
+
+		auto reportWide = [&](int width, double seconds, int mismatches)
+		{
+			std::cout << "  single ray, " << width << "-wide nodes: " << rayCount / seconds / 1e6 << " Mrays/s ("
+					  << singleSeconds / seconds << "x), " << mismatches << " rays differ" << std::endl;
+		};
+		int wideMismatches;
+		double wideSeconds = benchmarkWide<4>(flatBVH, primitives, origins, directions, iterations, reference, wideMismatches);
+		reportWide(4, wideSeconds, wideMismatches);
+		wideSeconds = benchmarkWide<8>(flatBVH, primitives, origins, directions, iterations, reference, wideMismatches);
+		reportWide(8, wideSeconds, wideMismatches);
+
+		auto report = [&](int size, double seconds, int mismatches)
+		{
+			std::cout << "  packet " << size << ": " << rayCount / seconds / 1e6 << " Mrays/s ("
+					  << singleSeconds / seconds << "x), " << mismatches << " rays differ" << std::endl;
+		};
+		int mismatches;
+		double seconds = benchmarkPackets<4>(flatBVH, primitives, cameraRays, width, height, iterations, reference, mismatches);
+		report(4, seconds, mismatches);
+		seconds = benchmarkPackets<8>(flatBVH, primitives, cameraRays, width, height, iterations, reference, mismatches);
+		report(8, seconds, mismatches);
+		seconds = benchmarkPackets<16>(flatBVH, primitives, cameraRays, width, height, iterations, reference, mismatches);
+		report(16, seconds, mismatches);
+	}
+}
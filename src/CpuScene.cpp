@@ -0,0 +1,164 @@
+#include "CpuScene.h"
+#include "Intersection.h"
+#include "Traversal.h"
+#include <algorithm>
+
+namespace {
+
+// Same decision as AABB::hit, with the reciprocal of the direction taken once per ray.
+template <typename Real>
+bool hitBox(const GPU::BVHNode& node, const Real origin[3], const Real invDirection[3], Real tMin, Real tMax)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		Real t0 = (static_cast<Real>(node.minBounds[i]) - origin[i]) * invDirection[i];
+		Real t1 = (static_cast<Real>(node.maxBounds[i]) - origin[i]) * invDirection[i];
+		if (t0 > t1) std::swap(t0, t1);
+
+		if (tMin < t0) tMin = t0;
+		if (tMax > t1) tMax = t1;
+		if (tMax <= tMin) return false;
+	}
+	return true;
+}
+
+template <typename Real>
+PrimitiveRef makeRef(BasicAABB<Real> box, int handle)
+{
+	PrimitiveRef ref;
+	ref.minBounds = box.getMinBounds();
+	ref.maxBounds = box.getMaxBounds();
+	ref.index = handle;
+	ref.pad = 0;
+	return ref;
+}
+
+}
+
+template <typename Real>
+BasicCpuScene<Real>::BasicCpuScene(const parser::Scene& scene, const BVHBuildOptions& options)
+{
+	using Vec3 = BasicVec3<Real>;
+	auto vertex = [&scene](int id) { return Vec3(scene.vertex_data[id - 1]); };
+	auto addTriangle = [&](const parser::Face& face, int materialId)
+	{
+		m_Triangles.push_back({ { vertex(face.v0_id), vertex(face.v1_id), vertex(face.v2_id) }, materialId });
+	};
+
+	m_Spheres.reserve(scene.spheres.size());
+	for (const parser::Sphere& sphere : scene.spheres)
+	{
+		m_Spheres.push_back({ vertex(sphere.center_vertex_id), static_cast<Real>(sphere.radius), sphere.material_id });
+	}
+	for (const parser::Triangle& triangle : scene.triangles)
+	{
+		addTriangle(triangle.indices, triangle.material_id);
+	}
+	for (const parser::Mesh& mesh : scene.meshes)
+	{
+		for (const parser::Face& face : mesh.faces)
+		{
+			addTriangle(face, mesh.material_id);
+		}
+	}
+
+	// Bounds as the Hittable classes compute them, thickened by AABB.
+	std::vector<PrimitiveRef> refs;
+	refs.reserve(m_Spheres.size() + m_Triangles.size());
+	for (size_t i = 0; i < m_Spheres.size(); i++)
+	{
+		const SphereData<Real>& sphere = m_Spheres[i];
+		Vec3 extent(sphere.radius, sphere.radius, sphere.radius);
+		refs.push_back(makeRef(BasicAABB<Real>(sphere.center - extent, sphere.center + extent),
+							   static_cast<int>(i << 1) | SphereType));
+	}
+	for (size_t i = 0; i < m_Triangles.size(); i++)
+	{
+		const Vec3* v = m_Triangles[i].vertices;
+		Vec3 min(std::min({ v[0].x, v[1].x, v[2].x }), std::min({ v[0].y, v[1].y, v[2].y }), std::min({ v[0].z, v[1].z, v[2].z }));
+		Vec3 max(std::max({ v[0].x, v[1].x, v[2].x }), std::max({ v[0].y, v[1].y, v[2].y }), std::max({ v[0].z, v[1].z, v[2].z }));
+		refs.push_back(makeRef(BasicAABB<Real>(min, max), static_cast<int>(i << 1) | TriangleType));
+	}
+	if (refs.empty()) return;
+
+	BVHBuilder(options).Build(refs, m_Nodes);
+	m_Handles.resize(refs.size());
+	for (size_t i = 0; i < refs.size(); i++)
+	{
+		m_Handles[i] = refs[i].index;
+	}
+}
+
+template <typename Real>
+bool BasicCpuScene<Real>::Hit(const BasicRay<Real>& ray, BasicInterval<Real> ray_t, BasicHitRecord<Real>& rec) const
+{
+	if (m_Nodes.empty()) return false;
+
+	const Real origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	const Real direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+	const Real invDirection[3] = { 1 / direction[0], 1 / direction[1], 1 / direction[2] };
+
+	// Once something is hit only boxes entered before it are worth visiting.
+	// BVHNode::hit lets the right child win ties and the first primitive
+	// within a leaf, and the leaves are in primitive order, so of equally
+	// near hits the one in the leaf with the highest offset is kept.
+	Real tMax = ray_t.max;
+	int closestLeaf = -1;
+	BasicHitRecord<Real> temp;
+
+	TraversalStack<int> stack;
+	stack.Push(0);
+	while (!stack.Empty())
+	{
+		const GPU::BVHNode& node = m_Nodes[stack.Pop()];
+		if (!hitBox(node, origin, invDirection, ray_t.min, tMax)) continue;
+
+		if (node.primitiveCount > 0)
+		{
+			for (int i = node.primitiveOffset; i < node.primitiveOffset + node.primitiveCount; i++)
+			{
+				int handle = m_Handles[i];
+				bool hit;
+				if ((handle & 1) == SphereType)
+				{
+					const SphereData<Real>& sphere = m_Spheres[handle >> 1];
+					hit = HitSphere(sphere.center, sphere.radius, sphere.materialId, ray, temp);
+				}
+				else
+				{
+					const TriangleData<Real>& triangle = m_Triangles[handle >> 1];
+					hit = HitTriangle(triangle.vertices, triangle.materialId, ray, ray_t, temp);
+				}
+
+				if (hit && (closestLeaf < 0 || temp.t < rec.t || (temp.t == rec.t && node.primitiveOffset > closestLeaf)))
+				{
+					rec = temp;
+					closestLeaf = node.primitiveOffset;
+					tMax = std::min(tMax, rec.t);
+				}
+			}
+			continue;
+		}
+
+		bool leftFirst = LeftChildIsNear(m_Nodes[node.leftChild], m_Nodes[node.rightChild], direction);
+		stack.Push(leftFirst ? node.rightChild : node.leftChild);
+		stack.Push(leftFirst ? node.leftChild : node.rightChild);
+	}
+	return closestLeaf >= 0;
+}
+
+template <typename Real>
+BasicAABB<Real> BasicCpuScene<Real>::GetBounds() const
+{
+	BasicAABB<Real> bounds;
+	if (m_Nodes.empty()) return bounds;
+
+	const GPU::BVHNode& root = m_Nodes[0];
+	bounds.x = BasicInterval<Real>(root.minBounds.x, root.maxBounds.x);
+	bounds.y = BasicInterval<Real>(root.minBounds.y, root.maxBounds.y);
+	bounds.z = BasicInterval<Real>(root.minBounds.z, root.maxBounds.z);
+	return bounds;
+}
+
+template class BasicCpuScene<float>;
+template class BasicCpuScene<double>;
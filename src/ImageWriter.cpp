@@ -0,0 +1,127 @@
+#include "ImageWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+namespace
+{
+	// Largest payload of a stored deflate block.
+	constexpr size_t kStoredBlockSize = 65535;
+
+	uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+	{
+		static const std::vector<uint32_t> table = []
+		{
+			std::vector<uint32_t> values(256);
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t value = i;
+				for (int bit = 0; bit < 8; bit++)
+				{
+					value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+				}
+				values[i] = value;
+			}
+			return values;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void appendBigEndian(std::vector<uint8_t>& output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value >> 24));
+		output.push_back(static_cast<uint8_t>(value >> 16));
+		output.push_back(static_cast<uint8_t>(value >> 8));
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	void writeChunk(std::ofstream& output, const char type[4], const std::vector<uint8_t>& data)
+	{
+		std::vector<uint8_t> chunk;
+		chunk.reserve(data.size() + 12);
+		appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+		output.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+	}
+}
+
+bool WritePPM(const std::string& filepath, const Image& image)
+{
+	std::ofstream output(filepath, std::ios::binary | std::ios::trunc);
+	output << "P6\n" << image.width << " " << image.height << "\n255\n";
+	output.write(reinterpret_cast<const char*>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+	return static_cast<bool>(output);
+}
+
+bool WritePNG(const std::string& filepath, const Image& image)
+{
+	std::ofstream output(filepath, std::ios::binary | std::ios::trunc);
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	output.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<uint8_t> header;
+	appendBigEndian(header, static_cast<uint32_t>(image.width));
+	appendBigEndian(header, static_cast<uint32_t>(image.height));
+	header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit RGB, no interlacing
+	writeChunk(output, "IHDR", header);
+
+	// Every row starts with filter type 0.
+	size_t rowSize = static_cast<size_t>(image.width) * 3;
+	std::vector<uint8_t> scanlines;
+	scanlines.reserve((rowSize + 1) * image.height);
+	for (int y = 0; y < image.height; y++)
+	{
+		scanlines.push_back(0);
+		auto row = image.pixels.begin() + y * rowSize;
+		scanlines.insert(scanlines.end(), row, row + rowSize);
+	}
+
+	// zlib stream of stored blocks, followed by the Adler-32 of the scanlines.
+	std::vector<uint8_t> data = { 0x78, 0x01 };
+	data.reserve(scanlines.size() + scanlines.size() / kStoredBlockSize * 5 + 16);
+	for (size_t offset = 0; offset < scanlines.size() || offset == 0; offset += kStoredBlockSize)
+	{
+		size_t size = std::min(kStoredBlockSize, scanlines.size() - offset);
+		bool last = offset + size == scanlines.size();
+		data.push_back(last ? 1 : 0);
+		data.push_back(static_cast<uint8_t>(size));
+		data.push_back(static_cast<uint8_t>(size >> 8));
+		data.push_back(static_cast<uint8_t>(~size));
+		data.push_back(static_cast<uint8_t>(~size >> 8));
+		data.insert(data.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+		if (last) break;
+	}
+	// The sums are reduced every 5552 bytes, the most that cannot overflow 32 bits.
+	uint32_t a = 1, b = 0;
+	for (size_t offset = 0; offset < scanlines.size(); offset += 5552)
+	{
+		size_t end = std::min(offset + 5552, scanlines.size());
+		for (size_t i = offset; i < end; i++)
+		{
+			a += scanlines[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	appendBigEndian(data, (b << 16) | a);
+	writeChunk(output, "IDAT", data);
+	writeChunk(output, "IEND", {});
+	return static_cast<bool>(output);
+}
+
+bool WriteImage(const std::string& filepath, const Image& image)
+{
+	std::string extension = filepath.size() >= 4 ? filepath.substr(filepath.size() - 4) : std::string();
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+				   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == ".png" ? WritePNG(filepath, image) : WritePPM(filepath, image);
+}
@@ -1,13 +1,20 @@
 #include "Interval.h"
 
 
-const void Interval::thicken() { min = min - 0.0001f; max = max + 0.0001f; }
+template <typename Real>
+const void BasicInterval<Real>::thicken() { min = min - 0.0001f; max = max + 0.0001f; }
 
-inline Interval Interval::merge(const Interval& _other) const { return Interval(std::min(min, _other.min), std::min(max, _other.max)); }
+template <typename Real>
+BasicInterval<Real> BasicInterval<Real>::merge(const BasicInterval& _other) const { return BasicInterval(std::min(min, _other.min), std::min(max, _other.max)); }
 
-inline bool Interval::overlap(const Interval& _other) const { return (min <= _other.max && _other.min <= max); }
+template <typename Real>
+bool BasicInterval<Real>::overlap(const BasicInterval& _other) const { return (min <= _other.max && _other.min <= max); }
 
-inline bool Interval::consists(const double& point) const { return (min <= point && max >= point); }
+template <typename Real>
+bool BasicInterval<Real>::consists(const Real& point) const { return (min <= point && max >= point); }
 
-inline double Interval::getLength() const { return max - min; }
+template <typename Real>
+Real BasicInterval<Real>::getLength() const { return max - min; }
 
+template class BasicInterval<float>;
+template class BasicInterval<double>;
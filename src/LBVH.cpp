@@ -0,0 +1,281 @@
+#include "LBVH.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+struct MortonPrimitive
+{
+	uint64_t code;
+	int index;
+};
+
+// Spreads the low 10 bits of v so that there are two zero bits between each.
+uint64_t expandBits10(uint64_t v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x30000ff;
+	v = (v | (v << 8)) & 0x300f00f;
+	v = (v | (v << 4)) & 0x30c30c3;
+	v = (v | (v << 2)) & 0x9249249;
+	return v;
+}
+
+// Same as expandBits10 for the low 21 bits.
+uint64_t expandBits21(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | (v << 32)) & 0x1f00000000ffffull;
+	v = (v | (v << 16)) & 0x1f0000ff0000ffull;
+	v = (v | (v << 8)) & 0x100f00f00f00f00full;
+	v = (v | (v << 4)) & 0x10c30c30c30c30c3ull;
+	v = (v | (v << 2)) & 0x1249249249249249ull;
+	return v;
+}
+
+void forEachChunk(ThreadPool* pool, int count, int grainSize, const std::function<void(int, int, int)>& body)
+{
+	if (pool == nullptr || count <= grainSize)
+	{
+		body(0, 0, count);
+		return;
+	}
+	pool->ParallelFor(0, count, grainSize, [&](int begin, int end) { body(begin / grainSize, begin, end); });
+}
+
+// Least significant digit radix sort on 8-bit digits. Every chunk builds its own
+// histogram, the offsets are laid out digit-major and chunk-minor, and every
+// chunk then scatters its keys in order, which keeps the sort stable.
+void radixSort(std::vector<MortonPrimitive>& keys, int keyBits, ThreadPool* pool, int grainSize)
+{
+	int count = static_cast<int>(keys.size());
+	int chunks = (pool == nullptr || count <= grainSize) ? 1 : (count + grainSize - 1) / grainSize;
+	std::vector<MortonPrimitive> scratch(keys.size());
+	std::vector<int> histograms(chunks * 256);
+
+	for (int shift = 0; shift < keyBits; shift += 8)
+	{
+		std::fill(histograms.begin(), histograms.end(), 0);
+		forEachChunk(pool, count, grainSize, [&](int chunk, int begin, int end)
+			{
+				int* histogram = &histograms[chunk * 256];
+				for (int i = begin; i < end; i++)
+				{
+					histogram[(keys[i].code >> shift) & 0xff]++;
+				}
+			}
+		);
+
+		int offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			for (int chunk = 0; chunk < chunks; chunk++)
+			{
+				int n = histograms[chunk * 256 + digit];
+				histograms[chunk * 256 + digit] = offset;
+				offset += n;
+			}
+		}
+
+		forEachChunk(pool, count, grainSize, [&](int chunk, int begin, int end)
+			{
+				int* offsets = &histograms[chunk * 256];
+				for (int i = begin; i < end; i++)
+				{
+					scratch[offsets[(keys[i].code >> shift) & 0xff]++] = keys[i];
+				}
+			}
+		);
+		keys.swap(scratch);
+	}
+}
+
+struct Emitter
+{
+	const std::vector<MortonPrimitive>& keys;
+	const std::vector<glm::vec3>& minBounds;
+	const std::vector<glm::vec3>& maxBounds;
+	std::vector<GPU::BVHNode>& nodes;
+	ThreadPool* pool;
+	int grainSize;
+	int maxLeafSize;
+
+	// First index in [begin, end) whose code differs from keys[begin] in the
+	// highest bit that differs over the range; the middle if all codes match.
+	int findSplit(int begin, int end) const
+	{
+		uint64_t first = keys[begin].code;
+		uint64_t last = keys[end - 1].code;
+		if (first == last) return (begin + end) / 2;
+
+		uint64_t highestBit = uint64_t(1) << (63 - countLeadingZeros(first ^ last));
+		int lo = begin + 1, hi = end - 1;
+		while (lo < hi)
+		{
+			int mid = (lo + hi) / 2;
+			if (keys[mid].code & highestBit) hi = mid;
+			else lo = mid + 1;
+		}
+		return lo;
+	}
+
+	static int countLeadingZeros(uint64_t v)
+	{
+		int n = 0;
+		for (uint64_t bit = uint64_t(1) << 63; bit && !(v & bit); bit >>= 1) n++;
+		return n;
+	}
+
+	bool isLeaf(int begin, int end) const
+	{
+		return end - begin <= maxLeafSize;
+	}
+
+	// Number of nodes in the subtree over [begin, end). Splits only depend on
+	// the sorted codes, so this is known before anything is emitted.
+	int countNodes(int begin, int end) const
+	{
+		if (isLeaf(begin, end)) return 1;
+		int split = findSplit(begin, end);
+		return 1 + countNodes(begin, split) + countNodes(split, end);
+	}
+
+	// Writes the subtree over [begin, end) in depth first order starting at
+	// nodeIndex and returns the number of nodes written. Large ranges count
+	// their left subtree first, so that both halves can be emitted in parallel.
+	int emit(int nodeIndex, int begin, int end)
+	{
+		GPU::BVHNode& node = nodes[nodeIndex];
+		if (isLeaf(begin, end))
+		{
+			node.leftChild = -1;
+			node.rightChild = -1;
+			node.primitiveOffset = begin;
+			node.primitiveCount = end - begin;
+			node.minBounds = minBounds[keys[begin].index];
+			node.maxBounds = maxBounds[keys[begin].index];
+			for (int i = begin + 1; i < end; i++)
+			{
+				node.minBounds = glm::min(node.minBounds, minBounds[keys[i].index]);
+				node.maxBounds = glm::max(node.maxBounds, maxBounds[keys[i].index]);
+			}
+			return 1;
+		}
+
+		int split = findSplit(begin, end);
+		int left = nodeIndex + 1;
+		int right;
+		int rightCount;
+
+		if (pool != nullptr && end - begin >= grainSize)
+		{
+			right = left + countNodes(begin, split);
+			TaskGroup group(pool);
+			group.Run([=] { emit(left, begin, split); });
+			rightCount = emit(right, split, end);
+			group.Wait();
+		}
+		else
+		{
+			right = left + emit(left, begin, split);
+			rightCount = emit(right, split, end);
+		}
+
+		node.leftChild = left;
+		node.rightChild = right;
+		node.primitiveOffset = 0;
+		node.primitiveCount = 0;
+		node.minBounds = glm::min(nodes[left].minBounds, nodes[right].minBounds);
+		node.maxBounds = glm::max(nodes[left].maxBounds, nodes[right].maxBounds);
+		return right - nodeIndex + rightCount;
+	}
+};
+
+}
+
+void BuildLBVH(const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& flatBVH,
+			   std::vector<GPU::Primitive>& primitives, const LBVHBuildOptions& options,
+			   std::vector<int>* primitiveIndices)
+{
+	flatBVH.clear();
+	primitives.clear();
+	int count = static_cast<int>(input.size());
+	if (count == 0) return;
+
+	std::vector<glm::vec3> minBounds(count), maxBounds(count);
+	int chunks = (options.threadPool == nullptr || count <= options.grainSize) ? 1 : (count + options.grainSize - 1) / options.grainSize;
+	std::vector<glm::vec3> chunkMin(chunks, glm::vec3(INFINITY)), chunkMax(chunks, glm::vec3(-INFINITY));
+	forEachChunk(options.threadPool, count, options.grainSize, [&](int chunk, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				GetPrimitiveBounds(input[i], minBounds[i], maxBounds[i]);
+				glm::vec3 c = (minBounds[i] + maxBounds[i]) * 0.5f;
+				chunkMin[chunk] = glm::min(chunkMin[chunk], c);
+				chunkMax[chunk] = glm::max(chunkMax[chunk], c);
+			}
+		}
+	);
+
+	glm::vec3 centroidMin = chunkMin[0], centroidMax = chunkMax[0];
+	for (int i = 1; i < chunks; i++)
+	{
+		centroidMin = glm::min(centroidMin, chunkMin[i]);
+		centroidMax = glm::max(centroidMax, chunkMax[i]);
+	}
+	glm::vec3 extent = glm::max(centroidMax - centroidMin, glm::vec3(1e-20f));
+
+	std::vector<MortonPrimitive> keys(count);
+	forEachChunk(options.threadPool, count, options.grainSize, [&](int, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				glm::vec3 c = (minBounds[i] + maxBounds[i]) * 0.5f;
+				keys[i].code = MortonCode((c - centroidMin) / extent, options.use64BitCodes);
+				keys[i].index = i;
+			}
+		}
+	);
+
+	radixSort(keys, options.use64BitCodes ? 63 : 30, options.threadPool, options.grainSize);
+
+	primitives.resize(count);
+	if (primitiveIndices != nullptr)
+	{
+		primitiveIndices->resize(count);
+	}
+	forEachChunk(options.threadPool, count, options.grainSize, [&](int, int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				primitives[i] = input[keys[i].index];
+				if (primitiveIndices != nullptr)
+				{
+					(*primitiveIndices)[i] = keys[i].index;
+				}
+			}
+		}
+	);
+
+	// Single primitive leaves are the worst case: 2n - 1 nodes.
+	flatBVH.resize(2 * count - 1);
+	Emitter emitter{ keys, minBounds, maxBounds, flatBVH, options.threadPool, options.grainSize, std::max(options.maxLeafSize, 1) };
+	flatBVH.resize(emitter.emit(0, 0, count));
+}
+
+uint64_t MortonCode(const glm::vec3& p, bool use64BitCodes)
+{
+	int bits = use64BitCodes ? 21 : 10;
+	float scale = static_cast<float>((1 << bits) - 1);
+	uint64_t x = static_cast<uint64_t>(std::clamp(p.x * scale, 0.0f, scale));
+	uint64_t y = static_cast<uint64_t>(std::clamp(p.y * scale, 0.0f, scale));
+	uint64_t z = static_cast<uint64_t>(std::clamp(p.z * scale, 0.0f, scale));
+	if (use64BitCodes)
+	{
+		return (expandBits21(x) << 2) | (expandBits21(y) << 1) | expandBits21(z);
+	}
+	return (expandBits10(x) << 2) | (expandBits10(y) << 1) | expandBits10(z);
+}
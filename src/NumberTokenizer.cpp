@@ -0,0 +1,96 @@
+#include "NumberTokenizer.h"
+#include <charconv>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NUMBER_TOKENIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline bool isWhitespace(char c)
+{
+	return static_cast<unsigned char>(c) <= ' ';
+}
+
+}
+
+size_t CountTokens(const char* begin, const char* end)
+{
+	if (begin == nullptr || begin >= end) return 0;
+
+	size_t count = 0;
+	bool previousWhitespace = true;
+	const char* cursor = begin;
+
+#ifdef NUMBER_TOKENIZER_SSE2
+	// A token starts at every non whitespace byte whose predecessor is
+	// whitespace. Bytes are compared unsigned through the sign bit flip.
+	const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+	const __m128i space = _mm_set1_epi8(static_cast<char>(' ' ^ 0x80));
+	for (; end - cursor >= 16; cursor += 16)
+	{
+		__m128i bytes = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor)), bias);
+		unsigned int nonWhitespace = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, space)));
+		unsigned int whitespaceBefore = ~(nonWhitespace << 1 | (previousWhitespace ? 0u : 1u)) & 0xffffu;
+		unsigned int starts = nonWhitespace & whitespaceBefore;
+		while (starts)
+		{
+			starts &= starts - 1;
+			count++;
+		}
+		previousWhitespace = (nonWhitespace & 0x8000u) == 0;
+	}
+#endif
+
+	for (; cursor < end; cursor++)
+	{
+		bool whitespace = isWhitespace(*cursor);
+		if (!whitespace && previousWhitespace) count++;
+		previousWhitespace = whitespace;
+	}
+	return count;
+}
+
+NumberTokenizer::NumberTokenizer(const char* text)
+	: m_Cursor(text), m_End(text ? text + std::strlen(text) : nullptr)
+{
+}
+
+NumberTokenizer::NumberTokenizer(const char* begin, const char* end)
+	: m_Cursor(begin), m_End(end)
+{
+}
+
+const char* NumberTokenizer::skipWhitespace()
+{
+	while (m_Cursor < m_End && isWhitespace(*m_Cursor)) m_Cursor++;
+	// from_chars does not take the leading plus that strtod accepts.
+	if (m_Cursor < m_End && *m_Cursor == '+') m_Cursor++;
+	return m_Cursor;
+}
+
+bool NumberTokenizer::Next(float& value)
+{
+	if (skipWhitespace() >= m_End) return false;
+	std::from_chars_result result = std::from_chars(m_Cursor, m_End, value);
+	if (result.ec != std::errc()) return false;
+	m_Cursor = result.ptr;
+	return true;
+}
+
+bool NumberTokenizer::Next(int& value)
+{
+	if (skipWhitespace() >= m_End) return false;
+	std::from_chars_result result = std::from_chars(m_Cursor, m_End, value);
+	if (result.ec != std::errc()) return false;
+	m_Cursor = result.ptr;
+	return true;
+}
+
+bool NumberTokenizer::AtEnd()
+{
+	while (m_Cursor < m_End && isWhitespace(*m_Cursor)) m_Cursor++;
+	return m_Cursor >= m_End;
+}
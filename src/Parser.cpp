@@ -1,12 +1,109 @@
 #include "parser.h"
+#include "NumberTokenizer.h"
+#include "PlyLoader.h"
+#include "ThreadPool.h"
 #include "tinyxml2/tinyxml2.h"
-#include <sstream>
+#include <algorithm>
+#include <exception>
+#include <functional>
 #include <stdexcept>
 
-void parser::Scene::loadFromXml(const std::string &filepath)
+namespace
+{
+    // Triangles and spheres are a few numbers each, so they are parsed in batches.
+    const size_t kSmallObjectsPerTask = 256;
+
+    // Runs the tasks on the pool, or in order without one, then rethrows the
+    // error of the first task that failed, the same one a serial load reports.
+    void runTasks(const std::vector<std::function<void()>>& tasks, ThreadPool* threadPool)
+    {
+        std::vector<std::exception_ptr> errors(tasks.size());
+        {
+            TaskGroup group(threadPool);
+            for (size_t i = 0; i < tasks.size(); i++)
+            {
+                group.Run([&tasks, &errors, i]
+                {
+                    try
+                    {
+                        tasks[i]();
+                    }
+                    catch (...)
+                    {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+        }
+        for (const std::exception_ptr& error : errors)
+        {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+
+    // Reads count numbers from the text of element, or from fallback when the
+    // element is missing.
+    template <typename T>
+    void readNumbers(const tinyxml2::XMLElement* element, T* values, int count, const char* fallback = nullptr)
+    {
+        NumberTokenizer tokenizer(element ? element->GetText() : fallback);
+        for (int i = 0; i < count; i++)
+        {
+            if (!tokenizer.Next(values[i]))
+            {
+                throw std::runtime_error(std::string("Error: Expected ") + std::to_string(count) + " numbers in "
+                    + (element ? element->Name() : fallback ? "a default value" : "a missing element") + ".");
+            }
+        }
+    }
+
+    // Text of element without surrounding whitespace, empty when it is missing.
+    std::string readText(const tinyxml2::XMLElement* element)
+    {
+        const char* text = element ? element->GetText() : nullptr;
+        if (!text) return std::string();
+
+        std::string value(text);
+        size_t first = value.find_first_not_of(" \t\r\n");
+        size_t last = value.find_last_not_of(" \t\r\n");
+        return first == std::string::npos ? std::string() : value.substr(first, last - first + 1);
+    }
+
+    parser::Vec3f readVec3f(const tinyxml2::XMLElement* element)
+    {
+        float values[3];
+        readNumbers(element, values, 3);
+        return { values[0], values[1], values[2] };
+    }
+
+    // Reads a whole list of whitespace separated triples. The tokens are
+    // counted first so that the output grows only once.
+    template <typename Triple, typename T>
+    void readTriples(const tinyxml2::XMLElement* element, std::vector<Triple>& output)
+    {
+        const char* text = element ? element->GetText() : nullptr;
+        NumberTokenizer tokenizer(text);
+        output.reserve(output.size() + tokenizer.CountRemaining() / 3);
+
+        T values[3];
+        while (tokenizer.Next(values[0]))
+        {
+            if (!tokenizer.Next(values[1]) || !tokenizer.Next(values[2]))
+            {
+                throw std::runtime_error(std::string("Error: Malformed triple in ") + element->Name() + ".");
+            }
+            output.push_back({ values[0], values[1], values[2] });
+        }
+        if (!tokenizer.AtEnd())
+        {
+            throw std::runtime_error(std::string("Error: Malformed number in ") + element->Name() + ".");
+        }
+    }
+}
+
+void parser::Scene::loadFromXml(const std::string &filepath, ThreadPool* threadPool)
 {
     tinyxml2::XMLDocument file;
-    std::stringstream stream;
 
     auto res = file.LoadFile(filepath.c_str());
     if (res)
@@ -22,89 +119,50 @@ void parser::Scene::loadFromXml(const std::string &filepath)
 
     //Get BackgroundColor
     auto element = root->FirstChildElement("BackgroundColor");
-    if (element)
-    {
-        stream << element->GetText() << std::endl;
-    }
-    else
-    {
-        stream << "0 0 0" << std::endl;
-    }
-    stream >> background_color.x >> background_color.y >> background_color.z;
+    int color[3];
+    readNumbers(element, color, 3, "0 0 0");
+    background_color = { color[0], color[1], color[2] };
 
     //Get ShadowRayEpsilon
     element = root->FirstChildElement("ShadowRayEpsilon");
-    if (element)
-    {
-        stream << element->GetText() << std::endl;
-    }
-    else
-    {
-        stream << "0.001" << std::endl;
-    }
-    stream >> shadow_ray_epsilon;
+    readNumbers(element, &shadow_ray_epsilon, 1, "0.001");
 
     //Get MaxRecursionDepth
     element = root->FirstChildElement("MaxRecursionDepth");
-    if (element)
-    {
-        stream << element->GetText() << std::endl;
-    }
-    else
+    readNumbers(element, &max_recursion_depth, 1, "0");
+
+    //Get Cameras
+    element = root->FirstChildElement("Cameras");
+    element = element ? element->FirstChildElement("Camera") : nullptr;
+    Camera camera;
+    while (element)
     {
-        stream << "0" << std::endl;
+        camera.position = readVec3f(element->FirstChildElement("Position"));
+        camera.gaze = readVec3f(element->FirstChildElement("Gaze"));
+        camera.up = readVec3f(element->FirstChildElement("Up"));
+        float nearPlane[4];
+        readNumbers(element->FirstChildElement("NearPlane"), nearPlane, 4);
+        camera.near_plane = { nearPlane[0], nearPlane[1], nearPlane[2], nearPlane[3] };
+        readNumbers(element->FirstChildElement("NearDistance"), &camera.near_distance, 1);
+        int resolution[2];
+        readNumbers(element->FirstChildElement("ImageResolution"), resolution, 2);
+        camera.image_width = resolution[0];
+        camera.image_height = resolution[1];
+        camera.image_name = readText(element->FirstChildElement("ImageName"));
+
+        cameras.push_back(camera);
+        element = element->NextSiblingElement("Camera");
     }
-    stream >> max_recursion_depth;
-
-    ////Get Cameras
-    //element = root->FirstChildElement("Cameras");
-    //element = element->FirstChildElement("Camera");
-    //Camera camera;
-    //while (element)
-    //{
-    //    auto child = element->FirstChildElement("Position");
-    //    stream << child->GetText() << std::endl;
-    //    child = element->FirstChildElement("Gaze");
-    //    stream << child->GetText() << std::endl;
-    //    child = element->FirstChildElement("Up");
-    //    stream << child->GetText() << std::endl;
-    //    child = element->FirstChildElement("NearPlane");
-    //    stream << child->GetText() << std::endl;
-    //    child = element->FirstChildElement("NearDistance");
-    //    stream << child->GetText() << std::endl;
-    //    child = element->FirstChildElement("ImageResolution");
-    //    stream << child->GetText() << std::endl;
-    //    child = element->FirstChildElement("ImageName");
-    //    stream << child->GetText() << std::endl;
-
-    //    stream >> camera.position.x >> camera.position.y >> camera.position.z;
-    //    stream >> camera.gaze.x >> camera.gaze.y >> camera.gaze.z;
-    //    stream >> camera.up.x >> camera.up.y >> camera.up.z;
-    //    stream >> camera.near_plane.x >> camera.near_plane.y >> camera.near_plane.z >> camera.near_plane.w;
-    //    stream >> camera.near_distance;
-    //    stream >> camera.image_width >> camera.image_height;
-    //    stream >> camera.image_name;
-
-    //    cameras.push_back(camera);
-    //    element = element->NextSiblingElement("Camera");
-    //}
 
     //Get Lights
     element = root->FirstChildElement("Lights");
-    auto child = element->FirstChildElement("AmbientLight");
-    stream << child->GetText() << std::endl;
-    stream >> ambient_light.x >> ambient_light.y >> ambient_light.z;
+    ambient_light = readVec3f(element->FirstChildElement("AmbientLight"));
     element = element->FirstChildElement("PointLight");
     PointLight point_light;
     while (element)
     {
-        child = element->FirstChildElement("Position");
-        stream << child->GetText() << std::endl;
-        child = element->FirstChildElement("Intensity");
-        stream << child->GetText() << std::endl;
-
-        stream >> point_light.position.x >> point_light.position.y >> point_light.position.z;
-        stream >> point_light.intensity.x >> point_light.intensity.y >> point_light.intensity.z;
+        point_light.position = readVec3f(element->FirstChildElement("Position"));
+        point_light.intensity = readVec3f(element->FirstChildElement("Intensity"));
 
         point_lights.push_back(point_light);
         element = element->NextSiblingElement("PointLight");
@@ -118,101 +176,94 @@ void parser::Scene::loadFromXml(const std::string &filepath)
     {
         material.is_mirror = (element->Attribute("type", "mirror") != NULL);
 
-        child = element->FirstChildElement("AmbientReflectance");
-        stream << child->GetText() << std::endl;
-        child = element->FirstChildElement("DiffuseReflectance");
-        stream << child->GetText() << std::endl;
-        child = element->FirstChildElement("SpecularReflectance");
-        stream << child->GetText() << std::endl;
-        child = element->FirstChildElement("MirrorReflectance");
-        stream << child->GetText() << std::endl;
-        child = element->FirstChildElement("PhongExponent");
-        stream << child->GetText() << std::endl;
-
-        stream >> material.ambient.x >> material.ambient.y >> material.ambient.z;
-        stream >> material.diffuse.x >> material.diffuse.y >> material.diffuse.z;
-        stream >> material.specular.x >> material.specular.y >> material.specular.z;
-        stream >> material.mirror.x >> material.mirror.y >> material.mirror.z;
-        stream >> material.phong_exponent;
+        material.ambient = readVec3f(element->FirstChildElement("AmbientReflectance"));
+        material.diffuse = readVec3f(element->FirstChildElement("DiffuseReflectance"));
+        material.specular = readVec3f(element->FirstChildElement("SpecularReflectance"));
+        material.mirror = readVec3f(element->FirstChildElement("MirrorReflectance"));
+        readNumbers(element->FirstChildElement("PhongExponent"), &material.phong_exponent, 1);
 
         materials.push_back(material);
         element = element->NextSiblingElement("Material");
     }
 
+    // VertexData, meshes, triangles and spheres are independent of each
+    // other, so they are parsed as separate tasks. Every task writes its own
+    // slot of the output, which keeps the order the same at any thread count.
+    std::vector<std::function<void()>> tasks;
+
     //Get VertexData
     element = root->FirstChildElement("VertexData");
-    stream << element->GetText() << std::endl;
-    Vec3f vertex;
-    while (!(stream >> vertex.x).eof())
-    {
-        stream >> vertex.y >> vertex.z;
-        vertex_data.push_back(vertex);
-    }
-    stream.clear();
+    tasks.push_back([this, element] { readTriples<Vec3f, float>(element, vertex_data); });
 
     //Get Meshes
-    element = root->FirstChildElement("Objects");
-    element = element->FirstChildElement("Mesh");
-    Mesh mesh;
-    while (element)
+    auto objects = root->FirstChildElement("Objects");
+    std::vector<PlyReference> plyReferences;
+    for (element = objects->FirstChildElement("Mesh"); element; element = element->NextSiblingElement("Mesh"))
     {
-        child = element->FirstChildElement("Material");
-        stream << child->GetText() << std::endl;
-        stream >> mesh.material_id;
-
-        child = element->FirstChildElement("Faces");
-        stream << child->GetText() << std::endl;
-        Face face;
-        while (!(stream >> face.v0_id).eof())
+        size_t index = meshes.size();
+        meshes.emplace_back();
+        auto faces = element->FirstChildElement("Faces");
+        const char* plyFile = faces ? faces->Attribute("plyFile") : nullptr;
+        if (plyFile)
         {
-            stream >> face.v1_id >> face.v2_id;
-            mesh.faces.push_back(face);
+            plyReferences.push_back({ index, ResolveScenePath(filepath, plyFile) });
         }
-        stream.clear();
-
-        meshes.push_back(mesh);
-        mesh.faces.clear();
-        element = element->NextSiblingElement("Mesh");
+        tasks.push_back([this, element, faces, plyFile, index]
+        {
+            Mesh& mesh = meshes[index];
+            readNumbers(element->FirstChildElement("Material"), &mesh.material_id, 1);
+            if (!plyFile)
+            {
+                readTriples<Face, int>(faces, mesh.faces);
+            }
+        });
     }
-    stream.clear();
 
     //Get Triangles
-    element = root->FirstChildElement("Objects");
-    element = element->FirstChildElement("Triangle");
-    Triangle triangle;
-    while (element)
+    std::vector<const tinyxml2::XMLElement*> triangleElements;
+    for (element = objects->FirstChildElement("Triangle"); element; element = element->NextSiblingElement("Triangle"))
     {
-        child = element->FirstChildElement("Material");
-        stream << child->GetText() << std::endl;
-        stream >> triangle.material_id;
-
-        child = element->FirstChildElement("Indices");
-        stream << child->GetText() << std::endl;
-        stream >> triangle.indices.v0_id >> triangle.indices.v1_id >> triangle.indices.v2_id;
-
-        triangles.push_back(triangle);
-        element = element->NextSiblingElement("Triangle");
+        triangleElements.push_back(element);
+    }
+    triangles.resize(triangleElements.size());
+    for (size_t begin = 0; begin < triangleElements.size(); begin += kSmallObjectsPerTask)
+    {
+        size_t end = std::min(begin + kSmallObjectsPerTask, triangleElements.size());
+        tasks.push_back([this, &triangleElements, begin, end]
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                readNumbers(triangleElements[i]->FirstChildElement("Material"), &triangles[i].material_id, 1);
+                int indices[3];
+                readNumbers(triangleElements[i]->FirstChildElement("Indices"), indices, 3);
+                triangles[i].indices = { indices[0], indices[1], indices[2] };
+            }
+        });
     }
 
     //Get Spheres
-    element = root->FirstChildElement("Objects");
-    element = element->FirstChildElement("Sphere");
-    Sphere sphere;
-    while (element)
+    std::vector<const tinyxml2::XMLElement*> sphereElements;
+    for (element = objects->FirstChildElement("Sphere"); element; element = element->NextSiblingElement("Sphere"))
     {
-        child = element->FirstChildElement("Material");
-        stream << child->GetText() << std::endl;
-        stream >> sphere.material_id;
-
-        child = element->FirstChildElement("Center");
-        stream << child->GetText() << std::endl;
-        stream >> sphere.center_vertex_id;
+        sphereElements.push_back(element);
+    }
+    spheres.resize(sphereElements.size());
+    for (size_t begin = 0; begin < sphereElements.size(); begin += kSmallObjectsPerTask)
+    {
+        size_t end = std::min(begin + kSmallObjectsPerTask, sphereElements.size());
+        tasks.push_back([this, &sphereElements, begin, end]
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                readNumbers(sphereElements[i]->FirstChildElement("Material"), &spheres[i].material_id, 1);
+                readNumbers(sphereElements[i]->FirstChildElement("Center"), &spheres[i].center_vertex_id, 1);
+                readNumbers(sphereElements[i]->FirstChildElement("Radius"), &spheres[i].radius, 1);
+            }
+        });
+    }
 
-        child = element->FirstChildElement("Radius");
-        stream << child->GetText() << std::endl;
-        stream >> sphere.radius;
+    runTasks(tasks, threadPool);
 
-        spheres.push_back(sphere);
-        element = element->NextSiblingElement("Sphere");
-    }
+    // PLY vertices go after the inline ones, so this waits for VertexData.
+    LoadPlyMeshes(*this, plyReferences, threadPool);
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "parser.h"
+#include "NumberTokenizer.h"
+#include "PlyLoader.h"
+#include "XmlStreamReader.h"
+#include <stdexcept>
+
+namespace
+{
+    template <typename T>
+    void parseNumbers(const std::string& text, const std::string& name, T* values, int count)
+    {
+        NumberTokenizer tokenizer(text.data(), text.data() + text.size());
+        for (int i = 0; i < count; i++)
+        {
+            if (!tokenizer.Next(values[i]))
+            {
+                throw std::runtime_error("Error: Expected " + std::to_string(count) + " numbers in " + name + ".");
+            }
+        }
+    }
+
+    parser::Vec3f parseVec3f(const std::string& text, const std::string& name)
+    {
+        float values[3];
+        parseNumbers(text, name, values, 3);
+        return { values[0], values[1], values[2] };
+    }
+
+    // Parses a list of triples that arrives in pieces. Pieces never split a
+    // number, but a triple may span two of them.
+    template <typename Triple, typename T>
+    class TripleStream
+    {
+    public:
+        TripleStream() : m_Count(0) {}
+
+        void Append(const char* begin, const char* end, std::vector<Triple>& output, const std::string& name)
+        {
+            NumberTokenizer tokenizer(begin, end);
+            while (tokenizer.Next(m_Values[m_Count]))
+            {
+                if (++m_Count == 3)
+                {
+                    output.push_back({ m_Values[0], m_Values[1], m_Values[2] });
+                    m_Count = 0;
+                }
+            }
+            if (!tokenizer.AtEnd())
+            {
+                throw std::runtime_error("Error: Malformed number in " + name + ".");
+            }
+        }
+
+        void Finish(const std::string& name)
+        {
+            if (m_Count != 0)
+            {
+                throw std::runtime_error("Error: Malformed triple in " + name + ".");
+            }
+        }
+
+    private:
+        T m_Values[3];
+        int m_Count;
+    };
+}
+
+// Same schema as loadFromXml, read in one pass through a small window of the
+// file. VertexData and Faces are parsed piece by piece straight into the
+// scene arrays, every other element is short and parsed when it closes.
+void parser::Scene::loadFromXmlStream(const std::string &filepath, ThreadPool* threadPool)
+{
+    XmlStreamReader reader(filepath);
+    if (!reader.IsOpen())
+    {
+        throw std::runtime_error("Error: The xml file cannot be loaded.");
+    }
+
+    background_color = { 0, 0, 0 };
+    shadow_ray_epsilon = 0.001f;
+    max_recursion_depth = 0;
+
+    std::vector<std::string> path; // open elements, the root first
+    std::string text;              // text of the innermost short element
+    TripleStream<Vec3f, float> vertexStream;
+    TripleStream<Face, int> faceStream;
+    Camera camera;
+    PointLight point_light = {};
+    Material material = {};
+    Mesh mesh;
+    Triangle triangle = {};
+    Sphere sphere = {};
+    std::vector<PlyReference> plyReferences;
+
+    for (XmlStreamReader::Event event = reader.Next(); event != XmlStreamReader::Event::EndOfFile; event = reader.Next())
+    {
+        const std::string& name = reader.GetName();
+        size_t depth = path.size();
+        const std::string parent = depth >= 1 ? path.back() : std::string();
+
+        if (event == XmlStreamReader::Event::StartElement)
+        {
+            if (depth == 2 && parent == "Cameras" && name == "Camera")
+            {
+                camera = Camera();
+            }
+            else if (depth == 2 && parent == "Lights" && name == "PointLight")
+            {
+                point_light = {};
+            }
+            else if (depth == 2 && parent == "Materials" && name == "Material")
+            {
+                const char* type = reader.GetAttribute("type");
+                material = {};
+                material.is_mirror = type && std::string(type) == "mirror";
+            }
+            else if (depth == 2 && parent == "Objects" && name == "Mesh")
+            {
+                mesh = Mesh();
+            }
+            else if (depth == 3 && parent == "Mesh" && name == "Faces" && reader.GetAttribute("plyFile"))
+            {
+                plyReferences.push_back({ meshes.size(), ResolveScenePath(filepath, reader.GetAttribute("plyFile")) });
+            }
+            else if (depth == 2 && parent == "Objects" && name == "Triangle")
+            {
+                triangle = {};
+            }
+            else if (depth == 2 && parent == "Objects" && name == "Sphere")
+            {
+                sphere = {};
+            }
+            path.push_back(name);
+            text.clear();
+            continue;
+        }
+
+        if (event == XmlStreamReader::Event::Text)
+        {
+            if (depth == 2 && parent == "VertexData")
+            {
+                vertexStream.Append(reader.GetTextBegin(), reader.GetTextEnd(), vertex_data, parent);
+            }
+            else if (depth == 4 && parent == "Faces" && path[2] == "Mesh")
+            {
+                faceStream.Append(reader.GetTextBegin(), reader.GetTextEnd(), mesh.faces, parent);
+            }
+            else
+            {
+                text.append(reader.GetTextBegin(), reader.GetTextEnd());
+            }
+            continue;
+        }
+
+        // End of the element on top of path.
+        if (depth == 0 || parent != name)
+        {
+            throw std::runtime_error("Error: Unexpected closing tag " + name + " in xml file.");
+        }
+        path.pop_back();
+        const std::string owner = depth >= 2 ? path.back() : std::string();
+
+        if (depth == 2)
+        {
+            if (name == "BackgroundColor")
+            {
+                int color[3];
+                parseNumbers(text, name, color, 3);
+                background_color = { color[0], color[1], color[2] };
+            }
+            else if (name == "ShadowRayEpsilon")
+            {
+                parseNumbers(text, name, &shadow_ray_epsilon, 1);
+            }
+            else if (name == "MaxRecursionDepth")
+            {
+                parseNumbers(text, name, &max_recursion_depth, 1);
+            }
+            else if (name == "VertexData")
+            {
+                vertexStream.Finish(name);
+            }
+        }
+        else if (depth == 3)
+        {
+            if (owner == "Cameras" && name == "Camera") cameras.push_back(camera);
+            else if (owner == "Lights" && name == "AmbientLight") ambient_light = parseVec3f(text, name);
+            else if (owner == "Lights" && name == "PointLight") point_lights.push_back(point_light);
+            else if (owner == "Materials" && name == "Material") materials.push_back(material);
+            else if (owner == "Objects" && name == "Mesh") meshes.push_back(std::move(mesh));
+            else if (owner == "Objects" && name == "Triangle") triangles.push_back(triangle);
+            else if (owner == "Objects" && name == "Sphere") spheres.push_back(sphere);
+        }
+        else if (depth == 4)
+        {
+            if (owner == "Camera")
+            {
+                if (name == "Position") camera.position = parseVec3f(text, name);
+                else if (name == "Gaze") camera.gaze = parseVec3f(text, name);
+                else if (name == "Up") camera.up = parseVec3f(text, name);
+                else if (name == "NearPlane")
+                {
+                    float nearPlane[4];
+                    parseNumbers(text, name, nearPlane, 4);
+                    camera.near_plane = { nearPlane[0], nearPlane[1], nearPlane[2], nearPlane[3] };
+                }
+                else if (name == "NearDistance") parseNumbers(text, name, &camera.near_distance, 1);
+                else if (name == "ImageResolution")
+                {
+                    int resolution[2];
+                    parseNumbers(text, name, resolution, 2);
+                    camera.image_width = resolution[0];
+                    camera.image_height = resolution[1];
+                }
+                else if (name == "ImageName")
+                {
+                    size_t first = text.find_first_not_of(" \t\r\n");
+                    size_t last = text.find_last_not_of(" \t\r\n");
+                    camera.image_name = first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+                }
+            }
+            else if (owner == "PointLight")
+            {
+                if (name == "Position") point_light.position = parseVec3f(text, name);
+                else if (name == "Intensity") point_light.intensity = parseVec3f(text, name);
+            }
+            else if (owner == "Material" && path[1] == "Materials")
+            {
+                if (name == "AmbientReflectance") material.ambient = parseVec3f(text, name);
+                else if (name == "DiffuseReflectance") material.diffuse = parseVec3f(text, name);
+                else if (name == "SpecularReflectance") material.specular = parseVec3f(text, name);
+                else if (name == "MirrorReflectance") material.mirror = parseVec3f(text, name);
+                else if (name == "PhongExponent") parseNumbers(text, name, &material.phong_exponent, 1);
+            }
+            else if (owner == "Mesh")
+            {
+                if (name == "Material") parseNumbers(text, name, &mesh.material_id, 1);
+                else if (name == "Faces") faceStream.Finish(name);
+            }
+            else if (owner == "Triangle")
+            {
+                if (name == "Material") parseNumbers(text, name, &triangle.material_id, 1);
+                else if (name == "Indices")
+                {
+                    int indices[3];
+                    parseNumbers(text, name, indices, 3);
+                    triangle.indices = { indices[0], indices[1], indices[2] };
+                }
+            }
+            else if (owner == "Sphere")
+            {
+                if (name == "Material") parseNumbers(text, name, &sphere.material_id, 1);
+                else if (name == "Center") parseNumbers(text, name, &sphere.center_vertex_id, 1);
+                else if (name == "Radius") parseNumbers(text, name, &sphere.radius, 1);
+            }
+        }
+        text.clear();
+    }
+
+    if (!path.empty())
+    {
+        throw std::runtime_error("Error: Element " + path.back() + " is not closed in xml file.");
+    }
+    LoadPlyMeshes(*this, plyReferences, threadPool);
+}
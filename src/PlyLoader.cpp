@@ -0,0 +1,388 @@
+#include "PlyLoader.h"
+#include "MappedFile.h"
+#include "NumberTokenizer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+enum class PlyFormat { Ascii, BinaryLittleEndian, BinaryBigEndian };
+
+struct PlyProperty
+{
+	std::string name;
+	PlyType type;
+	bool isList;
+	PlyType countType;
+};
+
+struct PlyElement
+{
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+};
+
+PlyType parseType(const std::string& name, const std::string& filepath)
+{
+	if (name == "char" || name == "int8") return PlyType::Int8;
+	if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+	if (name == "short" || name == "int16") return PlyType::Int16;
+	if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+	if (name == "int" || name == "int32") return PlyType::Int32;
+	if (name == "uint" || name == "uint32") return PlyType::UInt32;
+	if (name == "float" || name == "float32") return PlyType::Float32;
+	if (name == "double" || name == "float64") return PlyType::Float64;
+	throw std::runtime_error("Error: Unknown property type " + name + " in " + filepath + ".");
+}
+
+size_t typeSize(PlyType type)
+{
+	switch (type)
+	{
+	case PlyType::Int8: case PlyType::UInt8: return 1;
+	case PlyType::Int16: case PlyType::UInt16: return 2;
+	case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+	default: return 8;
+	}
+}
+
+bool isFloat(PlyType type)
+{
+	return type == PlyType::Float32 || type == PlyType::Float64;
+}
+
+bool hostIsLittleEndian()
+{
+	const uint16_t probe = 1;
+	uint8_t first;
+	std::memcpy(&first, &probe, 1);
+	return first == 1;
+}
+
+// Sequential reader over the body of a binary file.
+class BinaryCursor
+{
+public:
+	BinaryCursor(const uint8_t* begin, const uint8_t* end, bool swap, const std::string& filepath)
+		: m_Cursor(begin), m_End(end), m_Swap(swap), m_Filepath(filepath) {}
+
+	const uint8_t* Take(size_t size)
+	{
+		if (static_cast<size_t>(m_End - m_Cursor) < size)
+		{
+			throw std::runtime_error("Error: " + m_Filepath + " is truncated.");
+		}
+		const uint8_t* data = m_Cursor;
+		m_Cursor += size;
+		return data;
+	}
+
+	double Read(PlyType type)
+	{
+		size_t size = typeSize(type);
+		uint8_t bytes[8];
+		std::memcpy(bytes, Take(size), size);
+		if (m_Swap)
+		{
+			for (size_t i = 0; i < size / 2; i++) std::swap(bytes[i], bytes[size - 1 - i]);
+		}
+		switch (type)
+		{
+		case PlyType::Int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+		case PlyType::UInt8: return bytes[0];
+		case PlyType::Int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+		case PlyType::UInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+		case PlyType::Int32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+		case PlyType::UInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+		case PlyType::Float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+		default: { double v; std::memcpy(&v, bytes, 8); return v; }
+		}
+	}
+
+	bool CanCopy() const { return !m_Swap; }
+
+private:
+	const uint8_t* m_Cursor;
+	const uint8_t* m_End;
+	bool m_Swap;
+	const std::string& m_Filepath;
+};
+
+// Reader over the body of an ascii file, integers and floats are told apart
+// by the property type so that large indices keep their precision.
+class AsciiCursor
+{
+public:
+	AsciiCursor(const uint8_t* begin, const uint8_t* end, const std::string& filepath)
+		: m_Tokenizer(reinterpret_cast<const char*>(begin), reinterpret_cast<const char*>(end)), m_Filepath(filepath) {}
+
+	double Read(PlyType type)
+	{
+		if (isFloat(type))
+		{
+			float value;
+			if (m_Tokenizer.Next(value)) return value;
+		}
+		else
+		{
+			int value;
+			if (m_Tokenizer.Next(value)) return value;
+		}
+		throw std::runtime_error("Error: Malformed or missing value in " + m_Filepath + ".");
+	}
+
+private:
+	NumberTokenizer m_Tokenizer;
+	const std::string& m_Filepath;
+};
+
+void appendFan(const std::vector<int>& polygon, std::vector<parser::Face>& faces)
+{
+	for (size_t i = 2; i < polygon.size(); i++)
+	{
+		faces.push_back({ polygon[0], polygon[i - 1], polygon[i] });
+	}
+}
+
+template <typename Cursor>
+void readBody(Cursor& cursor, const std::vector<PlyElement>& elements, PlyMesh& mesh)
+{
+	std::vector<int> polygon;
+	for (const PlyElement& element : elements)
+	{
+		bool isVertex = element.name == "vertex";
+		bool isFace = element.name == "face";
+		if (isVertex) mesh.vertices.reserve(element.count);
+		if (isFace) mesh.faces.reserve(element.count);
+
+		for (size_t item = 0; item < element.count; item++)
+		{
+			float position[3] = { 0.0f, 0.0f, 0.0f };
+			for (const PlyProperty& property : element.properties)
+			{
+				if (property.isList)
+				{
+					size_t count = static_cast<size_t>(cursor.Read(property.countType));
+					bool indices = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+					polygon.clear();
+					for (size_t i = 0; i < count; i++)
+					{
+						double value = cursor.Read(property.type);
+						if (indices) polygon.push_back(static_cast<int>(value));
+					}
+					if (indices) appendFan(polygon, mesh.faces);
+					continue;
+				}
+
+				double value = cursor.Read(property.type);
+				if (isVertex && property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z')
+				{
+					position[property.name[0] - 'x'] = static_cast<float>(value);
+				}
+			}
+			if (isVertex) mesh.vertices.push_back({ position[0], position[1], position[2] });
+		}
+	}
+}
+
+// Binary files whose vertices are just float x, y, z and whose faces are just
+// a uchar count followed by int indices are by far the most common; their
+// vertices are copied in one go and their faces without going through double.
+// Returns false without reading anything for any other layout.
+bool readCommonBinaryBody(BinaryCursor& cursor, const std::vector<PlyElement>& elements, PlyMesh& mesh)
+{
+	if (!cursor.CanCopy() || elements.size() != 2) return false;
+
+	const PlyElement& vertex = elements[0];
+	const PlyElement& face = elements[1];
+	if (vertex.name != "vertex" || vertex.properties.size() != 3 || face.name != "face" || face.properties.size() != 1)
+	{
+		return false;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		const PlyProperty& property = vertex.properties[i];
+		if (property.isList || property.type != PlyType::Float32 || property.name != std::string(1, char('x' + i))) return false;
+	}
+	const PlyProperty& indices = face.properties[0];
+	if (!indices.isList || indices.countType != PlyType::UInt8
+		|| (indices.type != PlyType::Int32 && indices.type != PlyType::UInt32)
+		|| (indices.name != "vertex_indices" && indices.name != "vertex_index"))
+	{
+		return false;
+	}
+
+	const uint8_t* vertexData = cursor.Take(vertex.count * sizeof(parser::Vec3f));
+	mesh.vertices.resize(vertex.count);
+	std::memcpy(mesh.vertices.data(), vertexData, vertex.count * sizeof(parser::Vec3f));
+
+	mesh.faces.reserve(face.count);
+	std::vector<int> polygon;
+	for (size_t i = 0; i < face.count; i++)
+	{
+		uint8_t count = *cursor.Take(1);
+		polygon.resize(count);
+		std::memcpy(polygon.data(), cursor.Take(count * sizeof(int)), count * sizeof(int));
+		appendFan(polygon, mesh.faces);
+	}
+	return true;
+}
+
+}
+
+void LoadPly(const std::string& filepath, PlyMesh& mesh)
+{
+	MappedFile file(filepath);
+	if (!file.IsOpen())
+	{
+		throw std::runtime_error("Error: The ply file " + filepath + " cannot be loaded.");
+	}
+
+	const char* data = reinterpret_cast<const char*>(file.GetData());
+	const char* end = data + file.GetSize();
+	const char* marker = "end_header";
+	const char* headerEnd = std::search(data, end, marker, marker + std::strlen(marker));
+	if (file.GetSize() < 3 || std::strncmp(data, "ply", 3) != 0 || headerEnd == end)
+	{
+		throw std::runtime_error("Error: " + filepath + " is not a ply file.");
+	}
+	const char* body = std::find(headerEnd, end, '\n');
+	body = body == end ? end : body + 1;
+
+	PlyFormat format = PlyFormat::Ascii;
+	std::vector<PlyElement> elements;
+	std::istringstream header(std::string(data, headerEnd));
+	std::string line;
+	while (std::getline(header, line))
+	{
+		std::istringstream words(line);
+		std::string keyword;
+		words >> keyword;
+		if (keyword == "format")
+		{
+			std::string name;
+			words >> name;
+			if (name == "ascii") format = PlyFormat::Ascii;
+			else if (name == "binary_little_endian") format = PlyFormat::BinaryLittleEndian;
+			else if (name == "binary_big_endian") format = PlyFormat::BinaryBigEndian;
+			else throw std::runtime_error("Error: Unknown ply format " + name + " in " + filepath + ".");
+		}
+		else if (keyword == "element")
+		{
+			PlyElement element;
+			words >> element.name >> element.count;
+			elements.push_back(element);
+		}
+		else if (keyword == "property" && !elements.empty())
+		{
+			PlyProperty property;
+			std::string type;
+			words >> type;
+			property.isList = type == "list";
+			if (property.isList)
+			{
+				std::string countType;
+				words >> countType >> type;
+				property.countType = parseType(countType, filepath);
+			}
+			property.type = parseType(type, filepath);
+			words >> property.name;
+			elements.back().properties.push_back(property);
+		}
+	}
+
+	const uint8_t* bodyBegin = reinterpret_cast<const uint8_t*>(body);
+	const uint8_t* bodyEnd = reinterpret_cast<const uint8_t*>(end);
+	mesh.vertices.clear();
+	mesh.faces.clear();
+	if (format == PlyFormat::Ascii)
+	{
+		AsciiCursor cursor(bodyBegin, bodyEnd, filepath);
+		readBody(cursor, elements, mesh);
+	}
+	else
+	{
+		bool swap = (format == PlyFormat::BinaryLittleEndian) != hostIsLittleEndian();
+		BinaryCursor cursor(bodyBegin, bodyEnd, swap, filepath);
+		if (!readCommonBinaryBody(cursor, elements, mesh))
+		{
+			readBody(cursor, elements, mesh);
+		}
+	}
+
+	for (const parser::Face& face : mesh.faces)
+	{
+		int vertexCount = static_cast<int>(mesh.vertices.size());
+		if (face.v0_id < 0 || face.v1_id < 0 || face.v2_id < 0
+			|| face.v0_id >= vertexCount || face.v1_id >= vertexCount || face.v2_id >= vertexCount)
+		{
+			throw std::runtime_error("Error: Face index out of range in " + filepath + ".");
+		}
+	}
+}
+
+void LoadPlyMeshes(parser::Scene& scene, const std::vector<PlyReference>& references, ThreadPool* threadPool)
+{
+	std::vector<PlyMesh> plyMeshes(references.size());
+	std::vector<std::string> errors(references.size());
+	auto load = [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			// Exceptions must not leave a pool task, they are thrown again below.
+			try
+			{
+				LoadPly(references[i].filepath, plyMeshes[i]);
+			}
+			catch (const std::exception& exception)
+			{
+				errors[i] = exception.what();
+			}
+		}
+	};
+	if (threadPool && references.size() > 1)
+	{
+		threadPool->ParallelFor(0, static_cast<int>(references.size()), 1, load);
+	}
+	else
+	{
+		load(0, static_cast<int>(references.size()));
+	}
+
+	size_t vertexCount = scene.vertex_data.size();
+	for (size_t i = 0; i < references.size(); i++)
+	{
+		if (!errors[i].empty()) throw std::runtime_error(errors[i]);
+		vertexCount += plyMeshes[i].vertices.size();
+	}
+	scene.vertex_data.reserve(vertexCount);
+
+	for (size_t i = 0; i < references.size(); i++)
+	{
+		PlyMesh& plyMesh = plyMeshes[i];
+		std::vector<parser::Face>& faces = scene.meshes[references[i].meshIndex].faces;
+		int base = static_cast<int>(scene.vertex_data.size()) + 1;
+		scene.vertex_data.insert(scene.vertex_data.end(), plyMesh.vertices.begin(), plyMesh.vertices.end());
+
+		faces.reserve(faces.size() + plyMesh.faces.size());
+		for (const parser::Face& face : plyMesh.faces)
+		{
+			faces.push_back({ face.v0_id + base, face.v1_id + base, face.v2_id + base });
+		}
+	}
+}
+
+std::string ResolveScenePath(const std::string& scenePath, const std::string& reference)
+{
+	std::filesystem::path path(reference);
+	if (path.is_absolute()) return reference;
+	return (std::filesystem::path(scenePath).parent_path() / path).string();
+}
@@ -0,0 +1,346 @@
+#include "RayPacket.h"
+#include "SimdLanes.h"
+#include "Traversal.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+const float kEpsilon = 0.00001f;
+
+// Widest lane type that fits in a packet of Size rays.
+template <int Size>
+using PacketLanes = Lanes<(Size < kMaxLaneWidth ? Size : kMaxLaneWidth)>;
+
+// Per lane inverse directions of a packet and the bounds of the packet as a
+// whole: the box around the origins and, on every axis the directions agree
+// in sign, the range of the inverse direction.
+template <int Size>
+struct PacketFrustum
+{
+	float invX[Size];
+	float invY[Size];
+	float invZ[Size];
+	glm::vec3 originMin;
+	glm::vec3 originMax;
+	glm::vec3 invMin;
+	glm::vec3 invMax;
+	bool positive[3];
+	bool coherent;
+};
+
+template <int Size>
+void setupFrustum(const RayPacket<Size>& packet, uint32_t activeMask, PacketFrustum<Size>& frustum)
+{
+	const float* directions[3] = { packet.directionX, packet.directionY, packet.directionZ };
+	float* inverses[3] = { frustum.invX, frustum.invY, frustum.invZ };
+	const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+
+	frustum.coherent = activeMask != 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int positiveCount = 0, negativeCount = 0, activeCount = 0;
+		frustum.originMin[axis] = frustum.invMin[axis] = INFINITY;
+		frustum.originMax[axis] = frustum.invMax[axis] = -INFINITY;
+		for (int i = 0; i < Size; i++)
+		{
+			inverses[axis][i] = 1.0f / directions[axis][i];
+			if (!(activeMask & (1u << i))) continue;
+
+			activeCount++;
+			positiveCount += directions[axis][i] > 0.0f;
+			negativeCount += directions[axis][i] < 0.0f;
+			frustum.originMin[axis] = std::min(frustum.originMin[axis], origins[axis][i]);
+			frustum.originMax[axis] = std::max(frustum.originMax[axis], origins[axis][i]);
+			frustum.invMin[axis] = std::min(frustum.invMin[axis], inverses[axis][i]);
+			frustum.invMax[axis] = std::max(frustum.invMax[axis], inverses[axis][i]);
+		}
+		// Zero components make the interval products undefined, those packets are not culled as a whole.
+		frustum.positive[axis] = positiveCount > 0;
+		frustum.coherent = frustum.coherent && (positiveCount == activeCount || negativeCount == activeCount);
+	}
+}
+
+// Interval arithmetic slab test: the entry distance of every ray is at
+// least the smallest product of the entry plane offsets and the inverse
+// directions, the exit distance at most the largest. Rounding is monotonic,
+// so the test never culls a node that one of the rays hits.
+template <int Size>
+bool frustumMisses(const PacketFrustum<Size>& frustum, const GPU::BVHNode& node)
+{
+	float entry = 0.0f;
+	float exit = INFINITY;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float nearPlane = frustum.positive[axis] ? node.minBounds[axis] : node.maxBounds[axis];
+		float farPlane = frustum.positive[axis] ? node.maxBounds[axis] : node.minBounds[axis];
+
+		float n0 = (nearPlane - frustum.originMax[axis]) * frustum.invMin[axis];
+		float n1 = (nearPlane - frustum.originMax[axis]) * frustum.invMax[axis];
+		float n2 = (nearPlane - frustum.originMin[axis]) * frustum.invMin[axis];
+		float n3 = (nearPlane - frustum.originMin[axis]) * frustum.invMax[axis];
+		entry = std::max(entry, std::min(std::min(n0, n1), std::min(n2, n3)));
+
+		float f0 = (farPlane - frustum.originMax[axis]) * frustum.invMin[axis];
+		float f1 = (farPlane - frustum.originMax[axis]) * frustum.invMax[axis];
+		float f2 = (farPlane - frustum.originMin[axis]) * frustum.invMin[axis];
+		float f3 = (farPlane - frustum.originMin[axis]) * frustum.invMax[axis];
+		exit = std::min(exit, std::max(std::max(f0, f1), std::max(f2, f3)));
+	}
+	return entry > exit;
+}
+
+// Slab test of every active lane against a node box, returns the lanes that
+// enter it before their current closest hit.
+template <int Size>
+uint32_t intersectBox(const RayPacket<Size>& packet, const PacketFrustum<Size>& frustum, const GPU::BVHNode& node,
+					  uint32_t activeMask)
+{
+	using L = PacketLanes<Size>;
+	constexpr int Width = Size < kMaxLaneWidth ? Size : kMaxLaneWidth;
+	const uint32_t laneBits = (1u << Width) - 1;
+
+	uint32_t mask = 0;
+	for (int first = 0; first < Size; first += Width)
+	{
+		if (!((activeMask >> first) & laneBits)) continue;
+
+		typename L::Float ox = L::Load(packet.originX + first), ix = L::Load(frustum.invX + first);
+		typename L::Float oy = L::Load(packet.originY + first), iy = L::Load(frustum.invY + first);
+		typename L::Float oz = L::Load(packet.originZ + first), iz = L::Load(frustum.invZ + first);
+		typename L::Float t0x = L::Mul(L::Sub(L::Set(node.minBounds.x), ox), ix);
+		typename L::Float t1x = L::Mul(L::Sub(L::Set(node.maxBounds.x), ox), ix);
+		typename L::Float t0y = L::Mul(L::Sub(L::Set(node.minBounds.y), oy), iy);
+		typename L::Float t1y = L::Mul(L::Sub(L::Set(node.maxBounds.y), oy), iy);
+		typename L::Float t0z = L::Mul(L::Sub(L::Set(node.minBounds.z), oz), iz);
+		typename L::Float t1z = L::Mul(L::Sub(L::Set(node.maxBounds.z), oz), iz);
+
+		typename L::Float tmin = L::Max(L::Max(L::Min(t0x, t1x), L::Min(t0y, t1y)), L::Max(L::Min(t0z, t1z), L::Set(0.0f)));
+		typename L::Float tmax = L::Min(L::Min(L::Max(t0x, t1x), L::Max(t0y, t1y)), L::Min(L::Max(t0z, t1z), L::Load(packet.t + first)));
+		mask |= static_cast<uint32_t>(L::MoveMask(L::LessEqual(tmin, tmax))) << first;
+	}
+	return mask & activeMask;
+}
+
+// Intersects one primitive with every active lane, the same tests as
+// IntersectPrimitive, and keeps the hits closer than the current ones.
+template <int Size>
+void intersectPrimitive(RayPacket<Size>& packet, const GPU::Primitive& primitive, int primitiveIndex, uint32_t activeMask)
+{
+	using L = PacketLanes<Size>;
+	using Float = typename L::Float;
+	using Mask = typename L::Mask;
+	constexpr int Width = Size < kMaxLaneWidth ? Size : kMaxLaneWidth;
+	const uint32_t laneBits = (1u << Width) - 1;
+
+	const glm::vec4& p0 = primitive.vertexData[0];
+	for (int first = 0; first < Size; first += Width)
+	{
+		if (!((activeMask >> first) & laneBits)) continue;
+
+		Float dx = L::Load(packet.directionX + first), dy = L::Load(packet.directionY + first), dz = L::Load(packet.directionZ + first);
+		Float sx = L::Sub(L::Load(packet.originX + first), L::Set(p0.x));
+		Float sy = L::Sub(L::Load(packet.originY + first), L::Set(p0.y));
+		Float sz = L::Sub(L::Load(packet.originZ + first), L::Set(p0.z));
+		Float tClosest = L::Load(packet.t + first);
+		Float t;
+		Mask valid;
+
+		if (primitive.type == 0)
+		{
+			glm::vec3 e1 = glm::vec3(primitive.vertexData[1]) - glm::vec3(p0);
+			glm::vec3 e2 = glm::vec3(primitive.vertexData[2]) - glm::vec3(p0);
+			Float e1x = L::Set(e1.x), e1y = L::Set(e1.y), e1z = L::Set(e1.z);
+			Float e2x = L::Set(e2.x), e2y = L::Set(e2.y), e2z = L::Set(e2.z);
+
+			// h = direction x e2, q = s x e1
+			Float hx = L::Sub(L::Mul(dy, e2z), L::Mul(e2y, dz));
+			Float hy = L::Sub(L::Mul(dz, e2x), L::Mul(e2z, dx));
+			Float hz = L::Sub(L::Mul(dx, e2y), L::Mul(e2x, dy));
+			Float a = L::Add(L::Add(L::Mul(e1x, hx), L::Mul(e1y, hy)), L::Mul(e1z, hz));
+			Float f = L::Div(L::Set(1.0f), a);
+			Float u = L::Mul(f, L::Add(L::Add(L::Mul(sx, hx), L::Mul(sy, hy)), L::Mul(sz, hz)));
+			Float qx = L::Sub(L::Mul(sy, e1z), L::Mul(e1y, sz));
+			Float qy = L::Sub(L::Mul(sz, e1x), L::Mul(e1z, sx));
+			Float qz = L::Sub(L::Mul(sx, e1y), L::Mul(e1x, sy));
+			Float v = L::Mul(f, L::Add(L::Add(L::Mul(dx, qx), L::Mul(dy, qy)), L::Mul(dz, qz)));
+			t = L::Mul(f, L::Add(L::Add(L::Mul(e2x, qx), L::Mul(e2y, qy)), L::Mul(e2z, qz)));
+
+			valid = L::Or(L::LessEqual(a, L::Set(-kEpsilon)), L::LessEqual(L::Set(kEpsilon), a));
+			valid = L::And(valid, L::And(L::LessEqual(L::Set(0.0f), u), L::LessEqual(u, L::Set(1.0f))));
+			valid = L::And(valid, L::And(L::LessEqual(L::Set(0.0f), v), L::LessEqual(L::Add(u, v), L::Set(1.0f))));
+		}
+		else
+		{
+			float radius = primitive.vertexData[1].x;
+			Float b = L::Add(L::Add(L::Mul(sx, dx), L::Mul(sy, dy)), L::Mul(sz, dz));
+			Float c = L::Sub(L::Add(L::Add(L::Mul(sx, sx), L::Mul(sy, sy)), L::Mul(sz, sz)), L::Set(radius * radius));
+			Float discriminant = L::Sub(L::Mul(b, b), c);
+			Float root = L::Sqrt(L::Max(discriminant, L::Set(0.0f)));
+			Float minusB = L::Sub(L::Set(0.0f), b);
+			t = L::Sub(minusB, root);
+			t = L::Select(L::Less(t, L::Set(kEpsilon)), L::Add(minusB, root), t);
+			valid = L::Less(L::Set(0.0f), discriminant);
+		}
+
+		valid = L::And(valid, L::And(L::Less(L::Set(kEpsilon), t), L::Less(t, tClosest)));
+		uint32_t hits = static_cast<uint32_t>(L::MoveMask(valid)) & (activeMask >> first) & laneBits;
+		if (!hits) continue;
+
+		// Only lanes active at this node take the hit, so that t and
+		// primitiveIndex always change together.
+		alignas(32) float tLanes[Width];
+		L::Store(tLanes, t);
+		for (int lane = 0; lane < Width; lane++)
+		{
+			if (!(hits & (1u << lane))) continue;
+			packet.t[first + lane] = tLanes[lane];
+			packet.primitiveIndex[first + lane] = primitiveIndex;
+		}
+	}
+}
+
+// Single ray traversal, nearer child first, with intersectLeaf(nodeIndex,
+// node) updating result for the primitives of a leaf.
+template <typename LeafFunction>
+bool traceSingle(const std::vector<GPU::BVHNode>& flatBVH, const glm::vec3& origin, const glm::vec3& direction,
+				 TraceResult& result, float tMax, LeafFunction intersectLeaf)
+{
+	result.t = tMax;
+	result.primitiveIndex = -1;
+	if (flatBVH.empty()) return false;
+
+	glm::vec3 invDirection = 1.0f / direction;
+	TraversalStack<int> stack;
+	stack.Push(0);
+
+	while (!stack.Empty())
+	{
+		int nodeIndex = stack.Pop();
+		const GPU::BVHNode& node = flatBVH[nodeIndex];
+		glm::vec3 t0 = (node.minBounds - origin) * invDirection;
+		glm::vec3 t1 = (node.maxBounds - origin) * invDirection;
+		glm::vec3 tSmall = glm::min(t0, t1);
+		glm::vec3 tBig = glm::max(t0, t1);
+		float tmin = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+		float tmax = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, result.t));
+		if (tmin > tmax) continue;
+
+		if (node.primitiveCount > 0)
+		{
+			intersectLeaf(nodeIndex, node);
+			continue;
+		}
+
+		bool leftFirst = LeftChildIsNear(flatBVH[node.leftChild], flatBVH[node.rightChild], direction);
+		stack.Push(leftFirst ? node.rightChild : node.leftChild);
+		stack.Push(leftFirst ? node.leftChild : node.rightChild);
+	}
+	return result.primitiveIndex >= 0;
+}
+
+}
+
+template <int Size>
+void TracePacket(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+				 RayPacket<Size>& packet)
+{
+	static_assert(Size == 4 || Size == 8 || Size == 16, "packets hold 4, 8 or 16 rays");
+
+	uint32_t activeMask = 0;
+	for (int i = 0; i < Size; i++)
+	{
+		packet.primitiveIndex[i] = -1;
+		if (packet.t[i] >= 0.0f) activeMask |= 1u << i;
+	}
+	if (flatBVH.empty() || !activeMask) return;
+
+	PacketFrustum<Size> frustum;
+	setupFrustum(packet, activeMask, frustum);
+	int firstLane = 0;
+	while (!(activeMask & (1u << firstLane))) firstLane++;
+	glm::vec3 direction(packet.directionX[firstLane], packet.directionY[firstLane], packet.directionZ[firstLane]);
+
+	struct StackEntry
+	{
+		int node;
+		uint32_t mask;
+	};
+	TraversalStack<StackEntry> stack;
+	stack.Push({ 0, activeMask });
+
+	while (!stack.Empty())
+	{
+		StackEntry entry = stack.Pop();
+		const GPU::BVHNode& node = flatBVH[entry.node];
+		if (frustum.coherent && frustumMisses(frustum, node)) continue;
+
+		uint32_t mask = intersectBox(packet, frustum, node, entry.mask);
+		if (!mask) continue;
+
+		if (node.primitiveCount > 0)
+		{
+			for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+			{
+				intersectPrimitive(packet, primitives[p], p, mask);
+			}
+			continue;
+		}
+
+		bool leftFirst = LeftChildIsNear(flatBVH[node.leftChild], flatBVH[node.rightChild], direction);
+		stack.Push({ leftFirst ? node.rightChild : node.leftChild, mask });
+		stack.Push({ leftFirst ? node.leftChild : node.rightChild, mask });
+	}
+}
+
+bool TraceBVH(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+			  const glm::vec3& origin, const glm::vec3& direction, TraceResult& result, float tMax)
+{
+	return traceSingle(flatBVH, origin, direction, result, tMax, [&](int, const GPU::BVHNode& node)
+	{
+		for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+		{
+			float t;
+			if (IntersectPrimitive(primitives[p], origin, direction, t) && t < result.t)
+			{
+				result.t = t;
+				result.primitiveIndex = p;
+			}
+		}
+	});
+}
+
+template <int Width>
+bool TraceBVH(const std::vector<GPU::BVHNode>& flatBVH, const LeafBlocks<Width>& leafBlocks,
+			  const std::vector<GPU::Primitive>& primitives, const glm::vec3& origin, const glm::vec3& direction,
+			  TraceResult& result, float tMax)
+{
+	return traceSingle(flatBVH, origin, direction, result, tMax, [&](int n, const GPU::BVHNode&)
+	{
+		const LeafBlockRange& range = leafBlocks.ranges[n];
+		for (int b = range.firstBlock; b < range.firstBlock + range.blockCount; b++)
+		{
+			IntersectTriangleBlock(leafBlocks.blocks[b], origin, direction, result);
+		}
+		for (int s = range.firstSphere; s < range.firstSphere + range.sphereCount; s++)
+		{
+			int p = leafBlocks.sphereIndices[s];
+			float t;
+			if (IntersectPrimitive(primitives[p], origin, direction, t) && t < result.t)
+			{
+				result.t = t;
+				result.primitiveIndex = p;
+			}
+		}
+	});
+}
+
+template void TracePacket<4>(const std::vector<GPU::BVHNode>&, const std::vector<GPU::Primitive>&, RayPacket<4>&);
+template void TracePacket<8>(const std::vector<GPU::BVHNode>&, const std::vector<GPU::Primitive>&, RayPacket<8>&);
+template void TracePacket<16>(const std::vector<GPU::BVHNode>&, const std::vector<GPU::Primitive>&, RayPacket<16>&);
+template bool TraceBVH<4>(const std::vector<GPU::BVHNode>&, const LeafBlocks<4>&, const std::vector<GPU::Primitive>&,
+						  const glm::vec3&, const glm::vec3&, TraceResult&, float);
+template bool TraceBVH<8>(const std::vector<GPU::BVHNode>&, const LeafBlocks<8>&, const std::vector<GPU::Primitive>&,
+						  const glm::vec3&, const glm::vec3&, TraceResult&, float);
@@ -0,0 +1,478 @@
+#include "SBVH.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+
+	Bounds() = default;
+	Bounds(const glm::vec3& pmin, const glm::vec3& pmax) : min(pmin), max(pmax) {}
+
+	void grow(const glm::vec3& p)
+	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void grow(const Bounds& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	bool isEmpty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	float surfaceArea() const
+	{
+		if (isEmpty()) return 0.0f;
+		glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	static Bounds intersection(const Bounds& a, const Bounds& b)
+	{
+		return Bounds(glm::max(a.min, b.min), glm::min(a.max, b.max));
+	}
+};
+
+Bounds refBounds(const PrimitiveRef& ref)
+{
+	return Bounds(ref.minBounds, ref.maxBounds);
+}
+
+float centroid(const PrimitiveRef& ref, int axis)
+{
+	return (ref.minBounds[axis] + ref.maxBounds[axis]) * 0.5f;
+}
+
+struct ObjectSplit
+{
+	float cost = INFINITY;
+	int axis = 0;
+	int plane = 0;
+	float cmin = 0.0f;
+	float scale = 0.0f;
+	Bounds left;
+	Bounds right;
+};
+
+struct SpatialSplit
+{
+	float cost = INFINITY;
+	int axis = 0;
+	float position = 0.0f;
+	Bounds left;
+	Bounds right;
+	int leftCount = 0;
+	int rightCount = 0;
+};
+
+class SBVHBuilder
+{
+public:
+	SBVHBuilder(const SBVHBuildOptions& options, const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& nodes,
+				std::vector<GPU::Primitive>& primitives, std::vector<int>* primitiveIndices)
+		: m_Options(options), m_Input(input), m_Nodes(nodes), m_Primitives(primitives), m_PrimitiveIndices(primitiveIndices)
+	{
+		m_Options.sah.binCount = std::max(m_Options.sah.binCount, 2);
+		m_Options.sah.maxLeafSize = std::max(m_Options.sah.maxLeafSize, 1);
+		m_Options.spatialBinCount = std::max(m_Options.spatialBinCount, 2);
+		m_ReferenceCount = static_cast<int>(input.size());
+		m_MaxReferences = m_ReferenceCount + static_cast<int>(m_ReferenceCount * std::max(m_Options.referenceBudget, 0.0f));
+	}
+
+	int getExtraReferences() const { return m_ReferenceCount - static_cast<int>(m_Input.size()); }
+
+	void build(std::vector<PrimitiveRef>& refs)
+	{
+		Bounds root;
+		for (const PrimitiveRef& ref : refs)
+		{
+			root.grow(refBounds(ref));
+		}
+		m_RootArea = root.surfaceArea();
+		buildNode(refs, root, 0);
+	}
+
+private:
+	// Appends the node for refs and its subtree in depth first order, returns its index.
+	int buildNode(std::vector<PrimitiveRef>& refs, const Bounds& bounds, int depth)
+	{
+		int nodeIndex = static_cast<int>(m_Nodes.size());
+		m_Nodes.emplace_back();
+		m_Nodes[nodeIndex].minBounds = bounds.min;
+		m_Nodes[nodeIndex].maxBounds = bounds.max;
+
+		int count = static_cast<int>(refs.size());
+		float parentArea = bounds.surfaceArea();
+		ObjectSplit object = findObjectSplit(refs, parentArea);
+
+		// Spatial splits only pay off where the object split children overlap noticeably.
+		SpatialSplit spatial;
+		if (depth < m_Options.maxSpatialDepth && m_ReferenceCount < m_MaxReferences && m_RootArea > 0.0f &&
+			Bounds::intersection(object.left, object.right).surfaceArea() > m_Options.splitAlpha * m_RootArea)
+		{
+			spatial = findSpatialSplit(refs, bounds, parentArea);
+		}
+
+		float bestCost = std::min(object.cost, spatial.cost);
+		if (count == 1 || (count <= m_Options.sah.maxLeafSize && m_Options.sah.leafCost * count <= bestCost))
+		{
+			makeLeaf(nodeIndex, refs);
+			return nodeIndex;
+		}
+
+		std::vector<PrimitiveRef> left, right;
+		if (spatial.cost < object.cost)
+		{
+			performSpatialSplit(refs, spatial, left, right);
+		}
+		if (left.empty() || right.empty())
+		{
+			left.clear();
+			right.clear();
+			performObjectSplit(refs, object, left, right);
+		}
+		std::vector<PrimitiveRef>().swap(refs);
+
+		Bounds leftBounds, rightBounds;
+		for (const PrimitiveRef& ref : left) leftBounds.grow(refBounds(ref));
+		for (const PrimitiveRef& ref : right) rightBounds.grow(refBounds(ref));
+
+		buildNode(left, leftBounds, depth + 1);
+		int rightIndex = buildNode(right, rightBounds, depth + 1);
+
+		GPU::BVHNode& node = m_Nodes[nodeIndex];
+		node.leftChild = nodeIndex + 1;
+		node.rightChild = rightIndex;
+		node.primitiveOffset = 0;
+		node.primitiveCount = 0;
+		return nodeIndex;
+	}
+
+	void makeLeaf(int nodeIndex, const std::vector<PrimitiveRef>& refs)
+	{
+		GPU::BVHNode& node = m_Nodes[nodeIndex];
+		node.leftChild = -1;
+		node.rightChild = -1;
+		node.primitiveOffset = static_cast<int>(m_Primitives.size());
+		node.primitiveCount = static_cast<int>(refs.size());
+		for (const PrimitiveRef& ref : refs)
+		{
+			m_Primitives.push_back(m_Input[ref.index]);
+			if (m_PrimitiveIndices != nullptr)
+			{
+				m_PrimitiveIndices->push_back(ref.index);
+			}
+		}
+	}
+
+	// Binned SAH over centroids, trying all three axes.
+	ObjectSplit findObjectSplit(const std::vector<PrimitiveRef>& refs, float parentArea) const
+	{
+		ObjectSplit best;
+		if (parentArea <= 0.0f) return best;
+
+		Bounds centroids;
+		for (const PrimitiveRef& ref : refs)
+		{
+			centroids.grow((ref.minBounds + ref.maxBounds) * 0.5f);
+		}
+
+		int binCount = m_Options.sah.binCount;
+		std::vector<Bounds> binBounds(binCount), rightBounds(binCount);
+		std::vector<int> binCounts(binCount), rightCounts(binCount);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroids.max[axis] - centroids.min[axis];
+			if (extent <= 0.0f) continue;
+
+			float cmin = centroids.min[axis];
+			float scale = binCount / extent;
+			std::fill(binBounds.begin(), binBounds.end(), Bounds());
+			std::fill(binCounts.begin(), binCounts.end(), 0);
+			for (const PrimitiveRef& ref : refs)
+			{
+				int b = std::clamp(static_cast<int>((centroid(ref, axis) - cmin) * scale), 0, binCount - 1);
+				binBounds[b].grow(refBounds(ref));
+				binCounts[b]++;
+			}
+
+			Bounds accum;
+			int accumCount = 0;
+			for (int i = binCount - 1; i > 0; i--)
+			{
+				accum.grow(binBounds[i]);
+				accumCount += binCounts[i];
+				rightBounds[i] = accum;
+				rightCounts[i] = accumCount;
+			}
+
+			accum = Bounds();
+			accumCount = 0;
+			for (int i = 1; i < binCount; i++)
+			{
+				accum.grow(binBounds[i - 1]);
+				accumCount += binCounts[i - 1];
+				if (accumCount == 0 || rightCounts[i] == 0) continue;
+
+				float cost = m_Options.sah.traversalCost + m_Options.sah.leafCost *
+					(accum.surfaceArea() * accumCount + rightBounds[i].surfaceArea() * rightCounts[i]) / parentArea;
+				if (cost < best.cost)
+				{
+					best.cost = cost;
+					best.axis = axis;
+					best.plane = i;
+					best.cmin = cmin;
+					best.scale = scale;
+					best.left = accum;
+					best.right = rightBounds[i];
+				}
+			}
+		}
+		return best;
+	}
+
+	void performObjectSplit(const std::vector<PrimitiveRef>& refs, const ObjectSplit& split,
+							std::vector<PrimitiveRef>& left, std::vector<PrimitiveRef>& right) const
+	{
+		// No plane separates the centroids, halve the list instead.
+		if (split.cost == INFINITY)
+		{
+			size_t mid = refs.size() / 2;
+			left.assign(refs.begin(), refs.begin() + mid);
+			right.assign(refs.begin() + mid, refs.end());
+			return;
+		}
+
+		int binCount = m_Options.sah.binCount;
+		for (const PrimitiveRef& ref : refs)
+		{
+			int b = std::clamp(static_cast<int>((centroid(ref, split.axis) - split.cmin) * split.scale), 0, binCount - 1);
+			(b < split.plane ? left : right).push_back(ref);
+		}
+	}
+
+	// Bins the node bounds into slabs along each axis. Every reference is
+	// chopped into the slabs it spans, entering at the first and leaving at the last.
+	SpatialSplit findSpatialSplit(const std::vector<PrimitiveRef>& refs, const Bounds& bounds, float parentArea) const
+	{
+		SpatialSplit best;
+		if (parentArea <= 0.0f) return best;
+
+		int binCount = m_Options.spatialBinCount;
+		std::vector<Bounds> binBounds(binCount), rightBounds(binCount);
+		std::vector<int> entries(binCount), exits(binCount), rightCounts(binCount);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float origin = bounds.min[axis];
+			float binSize = (bounds.max[axis] - origin) / binCount;
+			if (binSize <= 0.0f) continue;
+
+			std::fill(binBounds.begin(), binBounds.end(), Bounds());
+			std::fill(entries.begin(), entries.end(), 0);
+			std::fill(exits.begin(), exits.end(), 0);
+			for (const PrimitiveRef& ref : refs)
+			{
+				int first = std::clamp(static_cast<int>((ref.minBounds[axis] - origin) / binSize), 0, binCount - 1);
+				int last = std::clamp(static_cast<int>((ref.maxBounds[axis] - origin) / binSize), first, binCount - 1);
+
+				PrimitiveRef remaining = ref;
+				for (int b = first; b < last; b++)
+				{
+					PrimitiveRef leftPart, rightPart;
+					splitReference(remaining, axis, origin + (b + 1) * binSize, leftPart, rightPart);
+					binBounds[b].grow(refBounds(leftPart));
+					remaining = rightPart;
+				}
+				binBounds[last].grow(refBounds(remaining));
+				entries[first]++;
+				exits[last]++;
+			}
+
+			Bounds accum;
+			int accumCount = 0;
+			for (int i = binCount - 1; i > 0; i--)
+			{
+				accum.grow(binBounds[i]);
+				accumCount += exits[i];
+				rightBounds[i] = accum;
+				rightCounts[i] = accumCount;
+			}
+
+			accum = Bounds();
+			accumCount = 0;
+			for (int i = 1; i < binCount; i++)
+			{
+				accum.grow(binBounds[i - 1]);
+				accumCount += entries[i - 1];
+				if (accumCount == 0 || rightCounts[i] == 0) continue;
+
+				float cost = m_Options.sah.traversalCost + m_Options.sah.leafCost *
+					(accum.surfaceArea() * accumCount + rightBounds[i].surfaceArea() * rightCounts[i]) / parentArea;
+				if (cost < best.cost)
+				{
+					best.cost = cost;
+					best.axis = axis;
+					best.position = origin + i * binSize;
+					best.left = accum;
+					best.right = rightBounds[i];
+					best.leftCount = accumCount;
+					best.rightCount = rightCounts[i];
+				}
+			}
+		}
+		return best;
+	}
+
+	// Sends every reference to its side of the plane. One that straddles it is
+	// split in two, unless moving it whole to one side is cheaper or the
+	// reference budget is used up.
+	void performSpatialSplit(const std::vector<PrimitiveRef>& refs, const SpatialSplit& split,
+							 std::vector<PrimitiveRef>& left, std::vector<PrimitiveRef>& right)
+	{
+		int axis = split.axis;
+		Bounds leftBounds = split.left, rightBounds = split.right;
+		int leftCount = split.leftCount, rightCount = split.rightCount;
+		for (const PrimitiveRef& ref : refs)
+		{
+			if (ref.maxBounds[axis] <= split.position)
+			{
+				left.push_back(ref);
+				continue;
+			}
+			if (ref.minBounds[axis] >= split.position)
+			{
+				right.push_back(ref);
+				continue;
+			}
+
+			PrimitiveRef leftPart, rightPart;
+			splitReference(ref, axis, split.position, leftPart, rightPart);
+			if (refBounds(leftPart).isEmpty() || refBounds(rightPart).isEmpty())
+			{
+				(refBounds(leftPart).isEmpty() ? right : left).push_back(ref);
+				continue;
+			}
+
+			Bounds leftWithRef = leftBounds, rightWithRef = rightBounds;
+			leftWithRef.grow(refBounds(ref));
+			rightWithRef.grow(refBounds(ref));
+			float splitCost = leftBounds.surfaceArea() * leftCount + rightBounds.surfaceArea() * rightCount;
+			float leftCost = leftWithRef.surfaceArea() * leftCount + rightBounds.surfaceArea() * (rightCount - 1);
+			float rightCost = leftBounds.surfaceArea() * (leftCount - 1) + rightWithRef.surfaceArea() * rightCount;
+			if (m_ReferenceCount >= m_MaxReferences)
+			{
+				splitCost = INFINITY;
+			}
+
+			if (splitCost <= leftCost && splitCost <= rightCost)
+			{
+				left.push_back(leftPart);
+				right.push_back(rightPart);
+				m_ReferenceCount++;
+			}
+			else if (leftCost <= rightCost)
+			{
+				left.push_back(ref);
+				leftBounds = leftWithRef;
+				rightCount--;
+			}
+			else
+			{
+				right.push_back(ref);
+				rightBounds = rightWithRef;
+				leftCount--;
+			}
+		}
+	}
+
+	// Cuts a reference at position along axis. The pieces are bounded by the
+	// part of the primitive on each side, kept inside the reference bounds and
+	// padded the same way as GetPrimitiveBounds.
+	void splitReference(const PrimitiveRef& ref, int axis, float position, PrimitiveRef& leftPart, PrimitiveRef& rightPart) const
+	{
+		const GPU::Primitive& primitive = m_Input[ref.index];
+		Bounds left, right;
+		if (primitive.type == 1)
+		{
+			left = refBounds(ref);
+			right = refBounds(ref);
+			left.max[axis] = position;
+			right.min[axis] = position;
+		}
+		else
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				glm::vec3 v0(primitive.vertexData[i]);
+				glm::vec3 v1(primitive.vertexData[(i + 1) % 3]);
+				if (v0[axis] <= position) left.grow(v0);
+				if (v0[axis] >= position) right.grow(v0);
+				if ((v0[axis] < position && v1[axis] > position) || (v0[axis] > position && v1[axis] < position))
+				{
+					float t = (position - v0[axis]) / (v1[axis] - v0[axis]);
+					glm::vec3 p = v0 + (v1 - v0) * t;
+					p[axis] = position;
+					left.grow(p);
+					right.grow(p);
+				}
+			}
+		}
+
+		glm::vec3 pad(1e-4f);
+		Bounds padded = refBounds(ref);
+		left = left.isEmpty() ? left : Bounds::intersection(Bounds(left.min - pad, left.max + pad), padded);
+		right = right.isEmpty() ? right : Bounds::intersection(Bounds(right.min - pad, right.max + pad), padded);
+
+		leftPart = ref;
+		rightPart = ref;
+		leftPart.minBounds = left.min;
+		leftPart.maxBounds = left.max;
+		rightPart.minBounds = right.min;
+		rightPart.maxBounds = right.max;
+	}
+
+	SBVHBuildOptions m_Options;
+	const std::vector<GPU::Primitive>& m_Input;
+	std::vector<GPU::BVHNode>& m_Nodes;
+	std::vector<GPU::Primitive>& m_Primitives;
+	std::vector<int>* m_PrimitiveIndices;
+	int m_ReferenceCount;
+	int m_MaxReferences;
+	float m_RootArea = 0.0f;
+};
+
+}
+
+int BuildSBVH(const std::vector<GPU::Primitive>& input, std::vector<GPU::BVHNode>& flatBVH,
+			  std::vector<GPU::Primitive>& primitives, const SBVHBuildOptions& options,
+			  std::vector<int>* primitiveIndices)
+{
+	flatBVH.clear();
+	primitives.clear();
+	if (primitiveIndices != nullptr)
+	{
+		primitiveIndices->clear();
+	}
+	if (input.empty()) return 0;
+
+	std::vector<PrimitiveRef> refs(input.size());
+	for (size_t i = 0; i < input.size(); i++)
+	{
+		GetPrimitiveBounds(input[i], refs[i].minBounds, refs[i].maxBounds);
+		refs[i].index = static_cast<int>(i);
+	}
+
+	SBVHBuilder builder(options, input, flatBVH, primitives, primitiveIndices);
+	builder.build(refs);
+	return builder.getExtraReferences();
+}
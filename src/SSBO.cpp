@@ -14,6 +14,12 @@ SSBO::~SSBO()
 
 void SSBO::CreateSSBO(const std::string& name, GLuint bindingPoint, GLsizeiptr size)
 {
+    auto it = m_Cache.find(name);
+    if (it != m_Cache.end())
+    {
+        glDeleteBuffers(1, &it->second.first);
+    }
+
     GLuint ssbo;
     glGenBuffers(1, &ssbo);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
@@ -0,0 +1,296 @@
+#include "SceneCache.h"
+#include "PlyLoader.h"
+#include "XmlStreamReader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Bump whenever the layout of the file or of any cached GPU struct changes,
+// or when a builder starts producing different trees for the same settings.
+constexpr uint32_t kCacheVersion = 1;
+constexpr char kCacheMagic[8] = { 'R', 'T', 'C', 'A', 'C', 'H', 'E', '\0' };
+constexpr uint64_t kAlignment = 64;
+
+struct FileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t bufferCount;
+	uint64_t key;
+	uint64_t fileSize;
+	uint64_t tableOffset;
+	uint64_t pad[3];
+};
+
+struct TableEntry
+{
+	char name[48];
+	uint32_t bindingPoint;
+	uint32_t pad;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static_assert(sizeof(FileHeader) == 64, "cache header must stay 64 bytes");
+
+uint64_t alignUp(uint64_t value)
+{
+	return (value + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+void writePadding(std::ofstream& output, uint64_t& position)
+{
+	static const char zeros[kAlignment] = {};
+	uint64_t aligned = alignUp(position);
+	output.write(zeros, static_cast<std::streamsize>(aligned - position));
+	position = aligned;
+}
+
+// The predefined entities, which tinyxml2 decodes in attribute values.
+std::string decodeEntities(const std::string& value)
+{
+	static const std::pair<const char*, char> entities[] = {
+		{ "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' }
+	};
+	std::string decoded;
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		bool replaced = false;
+		for (const auto& entity : entities)
+		{
+			size_t length = std::strlen(entity.first);
+			if (value.compare(i, length, entity.first) == 0)
+			{
+				decoded += entity.second;
+				i += length - 1;
+				replaced = true;
+				break;
+			}
+		}
+		if (!replaced) decoded += value[i];
+	}
+	return decoded;
+}
+
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const uint64_t prime = 0x100000001b3ull;
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 32;
+	}
+	for (; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * prime;
+	}
+	return hash;
+}
+
+bool HashFile(const std::string& path, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.Open(path)) return false;
+	hash = HashBytes(file.GetData(), file.GetSize());
+	hash = HashBytes(&hash, sizeof(hash), file.GetSize());
+	return true;
+}
+
+bool HashSceneFiles(const std::string& scenePath, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.Open(scenePath)) return false;
+	hash = HashBytes(file.GetData(), file.GetSize());
+	hash = HashBytes(&hash, sizeof(hash), file.GetSize());
+
+	// The references the loaders follow, <Faces plyFile="..."> directly under
+	// a Mesh, found with the same reader the streaming loader uses so that
+	// quoting, spacing and comments are treated alike.
+	std::vector<std::string> plyFiles;
+	try
+	{
+		XmlStreamReader reader(scenePath);
+		if (!reader.IsOpen()) return false;
+
+		std::vector<std::string> path;
+		for (XmlStreamReader::Event event = reader.Next(); event != XmlStreamReader::Event::EndOfFile; event = reader.Next())
+		{
+			if (event == XmlStreamReader::Event::StartElement)
+			{
+				const char* plyFile = reader.GetAttribute("plyFile");
+				if (plyFile && path.size() == 3 && path[1] == "Objects" && path[2] == "Mesh" && reader.GetName() == "Faces")
+				{
+					plyFiles.push_back(decodeEntities(plyFile));
+				}
+				path.push_back(reader.GetName());
+			}
+			else if (event == XmlStreamReader::Event::EndElement && !path.empty())
+			{
+				path.pop_back();
+			}
+		}
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+
+	for (const std::string& plyFile : plyFiles)
+	{
+		uint64_t plyHash;
+		if (!HashFile(ResolveScenePath(scenePath, plyFile), plyHash)) return false;
+		hash = HashBytes(&plyHash, sizeof(plyHash), hash);
+	}
+	return true;
+}
+
+SceneCache::SceneCache(const std::string& directory)
+	: m_Directory(directory), m_OutputKey(0)
+{
+}
+
+std::string SceneCache::GetPath(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.rtcache", static_cast<unsigned long long>(key));
+	return (std::filesystem::path(m_Directory) / name).string();
+}
+
+bool SceneCache::Load(uint64_t key)
+{
+	Close();
+	if (!IsEnabled() || !m_File.Open(GetPath(key))) return false;
+
+	const uint8_t* data = m_File.GetData();
+	uint64_t size = m_File.GetSize();
+	FileHeader header;
+	if (size < sizeof(header))
+	{
+		Close();
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+
+	uint64_t tableEnd = header.tableOffset + uint64_t(header.bufferCount) * sizeof(TableEntry);
+	if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion
+		|| header.key != key || header.fileSize != size || header.tableOffset > size || tableEnd > size)
+	{
+		std::cout << "Ignoring stale scene cache " << GetPath(key) << std::endl;
+		Close();
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.bufferCount; i++)
+	{
+		TableEntry entry;
+		std::memcpy(&entry, data + header.tableOffset + i * sizeof(TableEntry), sizeof(entry));
+		if (entry.offset > size || entry.size > size - entry.offset)
+		{
+			Close();
+			return false;
+		}
+		entry.name[sizeof(entry.name) - 1] = '\0';
+		m_Buffers.push_back({ entry.name, entry.bindingPoint, data + entry.offset, static_cast<size_t>(entry.size) });
+	}
+	return true;
+}
+
+void SceneCache::Close()
+{
+	m_Buffers.clear();
+	m_File.Close();
+}
+
+bool SceneCache::BeginStore(uint64_t key)
+{
+	if (!IsEnabled()) return false;
+
+	std::error_code error;
+	std::filesystem::create_directories(m_Directory, error);
+	m_OutputKey = key;
+	m_OutputPath = GetPath(key) + ".tmp";
+	m_Output.open(m_OutputPath, std::ios::binary | std::ios::trunc);
+	m_Written.clear();
+	m_WrittenOffsets.clear();
+	if (!m_Output)
+	{
+		std::cerr << "Could not write scene cache " << m_OutputPath << std::endl;
+		return false;
+	}
+
+	// The header is rewritten with the final sizes by EndStore.
+	FileHeader header = {};
+	m_Output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	return true;
+}
+
+void SceneCache::AddBuffer(const std::string& name, uint32_t bindingPoint, const void* data, size_t size)
+{
+	if (!m_Output.is_open()) return;
+
+	uint64_t position = static_cast<uint64_t>(m_Output.tellp());
+	writePadding(m_Output, position);
+	m_Output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	m_Written.push_back({ name, bindingPoint, nullptr, size });
+	m_WrittenOffsets.push_back(position);
+}
+
+bool SceneCache::EndStore()
+{
+	if (!m_Output.is_open()) return false;
+
+	uint64_t position = static_cast<uint64_t>(m_Output.tellp());
+	writePadding(m_Output, position);
+	FileHeader header = {};
+	std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+	header.version = kCacheVersion;
+	header.bufferCount = static_cast<uint32_t>(m_Written.size());
+	header.key = m_OutputKey;
+	header.tableOffset = position;
+	header.fileSize = position + m_Written.size() * sizeof(TableEntry);
+
+	for (size_t i = 0; i < m_Written.size(); i++)
+	{
+		TableEntry entry = {};
+		std::strncpy(entry.name, m_Written[i].name.c_str(), sizeof(entry.name) - 1);
+		entry.bindingPoint = m_Written[i].bindingPoint;
+		entry.offset = m_WrittenOffsets[i];
+		entry.size = m_Written[i].size;
+		m_Output.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	}
+	m_Output.seekp(0);
+	m_Output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	bool written = static_cast<bool>(m_Output);
+	m_Output.close();
+	m_Written.clear();
+	m_WrittenOffsets.clear();
+
+	std::error_code error;
+	std::string finalPath = GetPath(m_OutputKey);
+	if (written)
+	{
+		// rename does not replace an existing file on every platform.
+		std::filesystem::remove(finalPath, error);
+		std::filesystem::rename(m_OutputPath, finalPath, error);
+		written = !error;
+	}
+	if (!written)
+	{
+		std::filesystem::remove(m_OutputPath, error);
+		std::cerr << "Could not write scene cache " << finalPath << std::endl;
+	}
+	return written;
+}
@@ -8,6 +8,11 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     Load(vertexPath, fragmentPath);
 }
 
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
+{
+    Load(vertexPath, fragmentPath, defines);
+}
+
 Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
 {
     // 1. Retrieve the vertex/fragment source code from filePath
@@ -87,7 +92,7 @@ void Shader::Use() {
     glUseProgram(this->m_Program);
 }
 
-void Shader::Load(const char* vertexPath, const char* fragmentPath)
+void Shader::Load(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
 {
     // 1. Retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -116,6 +121,8 @@ void Shader::Load(const char* vertexPath, const char* fragmentPath)
     catch (std::ifstream::failure& e) {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
     }
+    injectDefines(vertexCode, defines);
+    injectDefines(fragmentCode, defines);
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
@@ -143,6 +150,29 @@ void Shader::Load(const char* vertexPath, const char* fragmentPath)
     glDeleteShader(fragment);
 }
 
+// #define lines have to follow the #version directive, which must come first.
+void Shader::injectDefines(std::string& code, const std::vector<std::string>& defines)
+{
+    if (defines.empty()) return;
+
+    std::string block;
+    for (const std::string& define : defines)
+    {
+        block += "#define " + define + "\n";
+    }
+
+    size_t version = code.find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+    if (lineEnd == std::string::npos)
+    {
+        code.insert(0, block);
+    }
+    else
+    {
+        code.insert(lineEnd + 1, block);
+    }
+}
+
 void Shader::checkCompileErrors(GLuint shader, std::string type) {
     GLint success;
     GLchar infoLog[1024];
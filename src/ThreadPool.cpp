@@ -0,0 +1,164 @@
+#include "ThreadPool.h"
+
+namespace
+{
+    // Index of the pool queue owned by the current thread, -1 outside of workers.
+    thread_local int t_QueueIndex = -1;
+    thread_local const ThreadPool* t_Pool = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : m_NextQueue(0), m_QueuedTasks(0), m_Stop(false)
+{
+    unsigned int workerCount = threadCount > 1 ? threadCount - 1 : 0;
+    for (unsigned int i = 0; i < workerCount; i++)
+    {
+        m_Queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned int i = 0; i < workerCount; i++)
+    {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Stop = true;
+    }
+    m_WakeCondition.notify_all();
+    for (std::thread& worker : m_Workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    if (m_Workers.empty())
+    {
+        task();
+        return;
+    }
+
+    unsigned int index = (t_Pool == this && t_QueueIndex >= 0)
+        ? static_cast<unsigned int>(t_QueueIndex)
+        : m_NextQueue++ % m_Queues.size();
+    {
+        std::lock_guard<std::mutex> lock(m_Queues[index]->mutex);
+        m_Queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_QueuedTasks++;
+    }
+    m_WakeCondition.notify_one();
+}
+
+bool ThreadPool::PopTask(unsigned int index, std::function<void()>& task)
+{
+    // Own queue first, newest task: its data is most likely still in cache.
+    if (index < m_Queues.size())
+    {
+        WorkQueue& queue = *m_Queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            m_QueuedTasks--;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another queue, which is usually the largest one.
+    for (size_t i = 1; i <= m_Queues.size(); i++)
+    {
+        WorkQueue& queue = *m_Queues[(index + i) % m_Queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            m_QueuedTasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::RunPendingTask()
+{
+    if (m_QueuedTasks.load() == 0) return false;
+
+    unsigned int index = (t_Pool == this && t_QueueIndex >= 0)
+        ? static_cast<unsigned int>(t_QueueIndex)
+        : static_cast<unsigned int>(m_Queues.size());
+    std::function<void()> task;
+    if (!PopTask(index, task)) return false;
+
+    task();
+    return true;
+}
+
+void ThreadPool::WorkerLoop(unsigned int index)
+{
+    t_QueueIndex = static_cast<int>(index);
+    t_Pool = this;
+
+    while (true)
+    {
+        std::function<void()> task;
+        if (PopTask(index, task))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_WakeMutex);
+        m_WakeCondition.wait(lock, [this] { return m_Stop || m_QueuedTasks.load() > 0; });
+        if (m_Stop && m_QueuedTasks.load() == 0) return;
+    }
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& body)
+{
+    if (grainSize < 1) grainSize = 1;
+
+    TaskGroup group(this);
+    for (int chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize)
+    {
+        int chunkEnd = std::min(chunkBegin + grainSize, end);
+        group.Run([&body, chunkBegin, chunkEnd] { body(chunkBegin, chunkEnd); });
+    }
+    group.Wait();
+}
+
+void TaskGroup::Run(std::function<void()> task)
+{
+    if (m_Pool == nullptr)
+    {
+        task();
+        return;
+    }
+
+    m_Pending++;
+    m_Pool->Submit([this, task = std::move(task)]
+    {
+        task();
+        m_Pending--;
+    });
+}
+
+void TaskGroup::Wait()
+{
+    // Help with queued work instead of blocking, so nested groups cannot deadlock.
+    while (m_Pending.load() > 0)
+    {
+        if (!m_Pool->RunPendingTask())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
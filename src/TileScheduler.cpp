@@ -0,0 +1,209 @@
+#include "TileScheduler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace {
+
+// Spreads the low 16 bits of v so that there is a zero bit between each.
+uint32_t expandBits16(uint32_t v)
+{
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+// Cell of a side x side Hilbert curve at distance d along it, side a power of two.
+void hilbertCell(int side, int d, int& x, int& y)
+{
+	x = y = 0;
+	for (int s = 1; s < side; s *= 2)
+	{
+		int rx = 1 & (d / 2);
+		int ry = 1 & (d ^ rx);
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+		x += s * rx;
+		y += s * ry;
+		d /= 4;
+	}
+}
+
+}
+
+std::vector<Tile> OrderTiles(int width, int height, int tileSize, TileOrder order)
+{
+	tileSize = std::max(1, tileSize);
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+
+	// Tile coordinates in order, then turned into pixel bounds.
+	std::vector<std::pair<int, int>> cells;
+	cells.reserve(static_cast<size_t>(tilesX) * tilesY);
+	if (order == TileOrder::Hilbert)
+	{
+		// The curve over the smallest power of two square covering the
+		// frame, skipping the cells outside of it.
+		int side = 1;
+		while (side < std::max(tilesX, tilesY)) side *= 2;
+		for (int d = 0; d < side * side; d++)
+		{
+			int x, y;
+			hilbertCell(side, d, x, y);
+			if (x < tilesX && y < tilesY) cells.emplace_back(x, y);
+		}
+	}
+	else
+	{
+		for (int y = 0; y < tilesY; y++)
+		{
+			for (int x = 0; x < tilesX; x++)
+			{
+				cells.emplace_back(x, y);
+			}
+		}
+		if (order == TileOrder::Morton)
+		{
+			auto code = [](const std::pair<int, int>& cell)
+			{
+				return expandBits16(static_cast<uint32_t>(cell.first)) | (expandBits16(static_cast<uint32_t>(cell.second)) << 1);
+			};
+			std::sort(cells.begin(), cells.end(), [&code](const std::pair<int, int>& a, const std::pair<int, int>& b)
+			{
+				return code(a) < code(b);
+			});
+		}
+	}
+
+	std::vector<Tile> tiles;
+	tiles.reserve(cells.size());
+	for (const std::pair<int, int>& cell : cells)
+	{
+		int x0 = cell.first * tileSize;
+		int y0 = cell.second * tileSize;
+		tiles.push_back({ x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height) });
+	}
+	return tiles;
+}
+
+unsigned int TileScheduler::GetThreadCount() const
+{
+	return m_Pool ? m_Pool->GetThreadCount() : 1;
+}
+
+bool TileScheduler::TakeOwn(TileDeque& deque, int& tile)
+{
+	std::lock_guard<std::mutex> lock(deque.mutex);
+	if (deque.front == deque.back) return false;
+	tile = deque.front++;
+	return true;
+}
+
+bool TileScheduler::Steal(unsigned int thief, int& tile)
+{
+	while (true)
+	{
+		// The fullest deque, which may have been emptied again by the time
+		// it is locked to split.
+		unsigned int victim = thief;
+		int most = 0;
+		for (unsigned int i = 0; i < m_Deques.size(); i++)
+		{
+			TileDeque& deque = *m_Deques[i];
+			std::lock_guard<std::mutex> lock(deque.mutex);
+			if (i != thief && deque.back - deque.front > most)
+			{
+				most = deque.back - deque.front;
+				victim = i;
+			}
+		}
+		if (victim == thief) return false;
+
+		int begin, end;
+		{
+			TileDeque& deque = *m_Deques[victim];
+			std::lock_guard<std::mutex> lock(deque.mutex);
+			int count = deque.back - deque.front;
+			if (count == 0) continue;
+
+			end = deque.back;
+			begin = deque.back - (count + 1) / 2;
+			deque.back = begin;
+		}
+
+		TileDeque& own = *m_Deques[thief];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		own.front = begin + 1;
+		own.back = end;
+		tile = begin;
+		return true;
+	}
+}
+
+std::vector<TileThreadStats> TileScheduler::Run(int tileCount, const std::function<void(int, int)>& body)
+{
+	unsigned int threadCount = GetThreadCount();
+	std::vector<TileThreadStats> stats(threadCount);
+	if (tileCount <= 0) return stats;
+
+	// Contiguous, nearly equal runs of the tile list, one per deque.
+	m_Deques.clear();
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		m_Deques.push_back(std::make_unique<TileDeque>());
+		m_Deques[i]->front = static_cast<int>(static_cast<int64_t>(tileCount) * i / threadCount);
+		m_Deques[i]->back = static_cast<int>(static_cast<int64_t>(tileCount) * (i + 1) / threadCount);
+	}
+
+	// Every thread claims the next deque when its task starts; a task that
+	// starts after all the tiles are taken just finds nothing to do.
+	std::atomic<unsigned int> nextThread(0);
+	auto work = [&]()
+	{
+		unsigned int thread = nextThread++;
+		TileThreadStats& threadStats = stats[thread];
+		int tile;
+		while (true)
+		{
+			bool stolen = false;
+			if (!TakeOwn(*m_Deques[thread], tile))
+			{
+				if (!Steal(thread, tile)) break;
+				stolen = true;
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			body(tile, static_cast<int>(thread));
+			threadStats.busySeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			threadStats.tiles++;
+			if (stolen) threadStats.steals++;
+		}
+	};
+
+	if (threadCount == 1)
+	{
+		work();
+		return stats;
+	}
+
+	TaskGroup group(m_Pool);
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		group.Run(work);
+	}
+	work();
+	group.Wait();
+	return stats;
+}
@@ -0,0 +1,145 @@
+#include "TriangleBlock.h"
+#include "SimdLanes.h"
+#include <cmath>
+
+namespace {
+
+const float kEpsilon = 0.00001f;
+
+template <int Width>
+void clearBlock(TriangleBlock<Width>& block)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int slot = 0; slot < Width; slot++)
+		{
+			block.v0[axis][slot] = block.e1[axis][slot] = block.e2[axis][slot] = 0.0f;
+		}
+	}
+	for (int slot = 0; slot < Width; slot++)
+	{
+		block.primitiveIndex[slot] = -1;
+	}
+}
+
+}
+
+template <int Width>
+void BuildLeafBlocks(const std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+					 LeafBlocks<Width>& leafBlocks)
+{
+	leafBlocks.blocks.clear();
+	leafBlocks.sphereIndices.clear();
+	leafBlocks.ranges.assign(flatBVH.size(), LeafBlockRange{ 0, 0, 0, 0 });
+
+	for (size_t n = 0; n < flatBVH.size(); n++)
+	{
+		const GPU::BVHNode& node = flatBVH[n];
+		LeafBlockRange& range = leafBlocks.ranges[n];
+		range.firstBlock = static_cast<int>(leafBlocks.blocks.size());
+		range.firstSphere = static_cast<int>(leafBlocks.sphereIndices.size());
+		if (node.primitiveCount <= 0) continue;
+
+		int slot = Width;
+		for (int p = node.primitiveOffset; p < node.primitiveOffset + node.primitiveCount; p++)
+		{
+			const GPU::Primitive& primitive = primitives[p];
+			if (primitive.type != 0)
+			{
+				leafBlocks.sphereIndices.push_back(p);
+				continue;
+			}
+			if (slot == Width)
+			{
+				leafBlocks.blocks.emplace_back();
+				clearBlock(leafBlocks.blocks.back());
+				slot = 0;
+			}
+
+			TriangleBlock<Width>& block = leafBlocks.blocks.back();
+			glm::vec3 v0 = glm::vec3(primitive.vertexData[0]);
+			glm::vec3 e1 = glm::vec3(primitive.vertexData[1]) - v0;
+			glm::vec3 e2 = glm::vec3(primitive.vertexData[2]) - v0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				block.v0[axis][slot] = v0[axis];
+				block.e1[axis][slot] = e1[axis];
+				block.e2[axis][slot] = e2[axis];
+			}
+			block.primitiveIndex[slot++] = p;
+		}
+		range.blockCount = static_cast<int>(leafBlocks.blocks.size()) - range.firstBlock;
+		range.sphereCount = static_cast<int>(leafBlocks.sphereIndices.size()) - range.firstSphere;
+	}
+}
+
+template <int Width>
+bool IntersectTriangleBlock(const TriangleBlock<Width>& block, const glm::vec3& origin, const glm::vec3& direction,
+							TraceResult& result)
+{
+	constexpr int LaneWidth = Width < kMaxLaneWidth ? Width : kMaxLaneWidth;
+	constexpr int Steps = Width / LaneWidth;
+	using L = Lanes<LaneWidth>;
+	using Float = typename L::Float;
+	using Mask = typename L::Mask;
+
+	Float dx = L::Set(direction.x), dy = L::Set(direction.y), dz = L::Set(direction.z);
+	Float ox = L::Set(origin.x), oy = L::Set(origin.y), oz = L::Set(origin.z);
+	Float tLimit = L::Set(result.t);
+	Float tMiss = L::Set(INFINITY);
+	Float t[Steps];
+	Float closest = tMiss;
+
+	for (int step = 0; step < Steps; step++)
+	{
+		int first = step * LaneWidth;
+		Float e1x = L::Load(block.e1[0] + first), e1y = L::Load(block.e1[1] + first), e1z = L::Load(block.e1[2] + first);
+		Float e2x = L::Load(block.e2[0] + first), e2y = L::Load(block.e2[1] + first), e2z = L::Load(block.e2[2] + first);
+		Float sx = L::Sub(ox, L::Load(block.v0[0] + first));
+		Float sy = L::Sub(oy, L::Load(block.v0[1] + first));
+		Float sz = L::Sub(oz, L::Load(block.v0[2] + first));
+
+		// h = direction x e2, q = s x e1
+		Float hx = L::Sub(L::Mul(dy, e2z), L::Mul(e2y, dz));
+		Float hy = L::Sub(L::Mul(dz, e2x), L::Mul(e2z, dx));
+		Float hz = L::Sub(L::Mul(dx, e2y), L::Mul(e2x, dy));
+		Float a = L::Add(L::Add(L::Mul(e1x, hx), L::Mul(e1y, hy)), L::Mul(e1z, hz));
+		Float f = L::Div(L::Set(1.0f), a);
+		Float u = L::Mul(f, L::Add(L::Add(L::Mul(sx, hx), L::Mul(sy, hy)), L::Mul(sz, hz)));
+		Float qx = L::Sub(L::Mul(sy, e1z), L::Mul(e1y, sz));
+		Float qy = L::Sub(L::Mul(sz, e1x), L::Mul(e1z, sx));
+		Float qz = L::Sub(L::Mul(sx, e1y), L::Mul(e1x, sy));
+		Float v = L::Mul(f, L::Add(L::Add(L::Mul(dx, qx), L::Mul(dy, qy)), L::Mul(dz, qz)));
+		Float tStep = L::Mul(f, L::Add(L::Add(L::Mul(e2x, qx), L::Mul(e2y, qy)), L::Mul(e2z, qz)));
+
+		Mask valid = L::Or(L::LessEqual(a, L::Set(-kEpsilon)), L::LessEqual(L::Set(kEpsilon), a));
+		valid = L::And(valid, L::And(L::LessEqual(L::Set(0.0f), u), L::LessEqual(u, L::Set(1.0f))));
+		valid = L::And(valid, L::And(L::LessEqual(L::Set(0.0f), v), L::LessEqual(L::Add(u, v), L::Set(1.0f))));
+		valid = L::And(valid, L::And(L::Less(L::Set(kEpsilon), tStep), L::Less(tStep, tLimit)));
+
+		t[step] = L::Select(valid, tStep, tMiss);
+		closest = L::Min(closest, t[step]);
+	}
+
+	float tClosest = L::HorizontalMin(closest);
+	if (!(tClosest < result.t)) return false;
+
+	Float tBest = L::Set(tClosest);
+	for (int step = 0; step < Steps; step++)
+	{
+		int lanes = L::MoveMask(L::Equal(t[step], tBest));
+		for (int lane = 0; lane < LaneWidth; lane++)
+		{
+			if (!(lanes & (1 << lane))) continue;
+			result.t = tClosest;
+			result.primitiveIndex = block.primitiveIndex[step * LaneWidth + lane];
+			return true;
+		}
+	}
+	return false;
+}
+
+template void BuildLeafBlocks<4>(const std::vector<GPU::BVHNode>&, const std::vector<GPU::Primitive>&, LeafBlocks<4>&);
+template void BuildLeafBlocks<8>(const std::vector<GPU::BVHNode>&, const std::vector<GPU::Primitive>&, LeafBlocks<8>&);
+template bool IntersectTriangleBlock<4>(const TriangleBlock<4>&, const glm::vec3&, const glm::vec3&, TraceResult&);
+template bool IntersectTriangleBlock<8>(const TriangleBlock<8>&, const glm::vec3&, const glm::vec3&, TraceResult&);
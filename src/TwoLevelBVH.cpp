@@ -0,0 +1,369 @@
+#include "TwoLevelBVH.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+
+namespace {
+
+// A mesh with its vertices renumbered in order of first use, so two meshes
+// with the same faces compare equal no matter where their vertices are stored.
+struct LocalMesh
+{
+	std::vector<int> vertexIds; // scene vertex id of every local vertex
+	std::vector<int> faces;     // three local vertex indices per face
+	size_t hash = 0;
+};
+
+LocalMesh makeLocalMesh(const parser::Mesh& mesh)
+{
+	LocalMesh local;
+	std::unordered_map<int, int> remap;
+	local.faces.reserve(mesh.faces.size() * 3);
+	for (const parser::Face& face : mesh.faces)
+	{
+		for (int id : { face.v0_id, face.v1_id, face.v2_id })
+		{
+			auto it = remap.emplace(id, static_cast<int>(local.vertexIds.size())).first;
+			if (it->second == static_cast<int>(local.vertexIds.size()))
+			{
+				local.vertexIds.push_back(id);
+			}
+			local.faces.push_back(it->second);
+			local.hash = local.hash * 1000003u ^ static_cast<size_t>(it->second);
+		}
+	}
+	return local;
+}
+
+glm::vec3 vertexPosition(const parser::Scene& scene, int id)
+{
+	const parser::Vec3f& v = scene.vertex_data[id - 1];
+	return glm::vec3(v.x, v.y, v.z);
+}
+
+GPU::Primitive makeTriangle(const parser::Scene& scene, const parser::Face& face, int materialId)
+{
+	GPU::Primitive primitive;
+	primitive.type = 0;
+	primitive.materialId = materialId;
+	primitive.vertexData[0] = glm::vec4(vertexPosition(scene, face.v0_id), 0.0f);
+	primitive.vertexData[1] = glm::vec4(vertexPosition(scene, face.v1_id), 0.0f);
+	primitive.vertexData[2] = glm::vec4(vertexPosition(scene, face.v2_id), 0.0f);
+	return primitive;
+}
+
+// Least squares affine transform taking the prototype vertices onto the
+// candidate ones. Fails when the prototype is flat, when the transform is
+// singular or when any vertex misses by more than tolerance times the mesh size.
+bool fitAffine(const parser::Scene& scene, const LocalMesh& prototype, const LocalMesh& candidate,
+			   float tolerance, glm::mat4& objectToWorld)
+{
+	size_t count = prototype.vertexIds.size();
+	if (count < 4) return false;
+
+	// Normal equations A^T A x = A^T b with rows (x, y, z, 1), in double for stability.
+	double ata[4][4] = {};
+	double atb[4][3] = {};
+	glm::vec3 minBounds(INFINITY), maxBounds(-INFINITY);
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 p = vertexPosition(scene, prototype.vertexIds[i]);
+		glm::vec3 q = vertexPosition(scene, candidate.vertexIds[i]);
+		double row[4] = { p.x, p.y, p.z, 1.0 };
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++) ata[r][c] += row[r] * row[c];
+			for (int c = 0; c < 3; c++) atb[r][c] += row[r] * q[c];
+		}
+		minBounds = glm::min(minBounds, q);
+		maxBounds = glm::max(maxBounds, q);
+	}
+
+	// Gauss-Jordan with partial pivoting, solving all three columns at once.
+	for (int c = 0; c < 4; c++)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < 4; r++)
+		{
+			if (std::fabs(ata[r][c]) > std::fabs(ata[pivot][c])) pivot = r;
+		}
+		if (std::fabs(ata[pivot][c]) < 1e-12 * (std::fabs(ata[0][0]) + std::fabs(ata[1][1]) + std::fabs(ata[2][2]) + 1.0)) return false;
+		std::swap(ata[c], ata[pivot]);
+		std::swap(atb[c], atb[pivot]);
+
+		for (int r = 0; r < 4; r++)
+		{
+			if (r == c) continue;
+			double f = ata[r][c] / ata[c][c];
+			for (int k = 0; k < 4; k++) ata[r][k] -= f * ata[c][k];
+			for (int k = 0; k < 3; k++) atb[r][k] -= f * atb[c][k];
+		}
+	}
+
+	objectToWorld = glm::mat4(1.0f);
+	for (int r = 0; r < 4; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			// Row r of x is the coefficient of input component r, column k is the output component.
+			objectToWorld[r][k] = static_cast<float>(atb[r][k] / ata[r][r]);
+		}
+	}
+
+	glm::mat3 linear(objectToWorld);
+	float size = glm::length(maxBounds - minBounds);
+	if (std::fabs(glm::determinant(linear)) < 1e-12f * size * size * size) return false;
+
+	float maxError = tolerance * size;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 p = vertexPosition(scene, prototype.vertexIds[i]);
+		glm::vec3 q = vertexPosition(scene, candidate.vertexIds[i]);
+		glm::vec3 d = glm::abs(glm::vec3(objectToWorld * glm::vec4(p, 1.0f)) - q);
+		if (std::max(d.x, std::max(d.y, d.z)) > maxError) return false;
+	}
+	return true;
+}
+
+bool hitBounds(const glm::vec3& minBounds, const glm::vec3& maxBounds, const glm::vec3& origin,
+			   const glm::vec3& invDir, float tMax)
+{
+	glm::vec3 t0 = (minBounds - origin) * invDir;
+	glm::vec3 t1 = (maxBounds - origin) * invDir;
+	glm::vec3 tSmall = glm::min(t0, t1);
+	glm::vec3 tBig = glm::max(t0, t1);
+	float tmin = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, 0.0f));
+	float tmax = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, tMax));
+	return tmin <= tmax;
+}
+
+}
+
+TwoLevelBVH::TwoLevelBVH(const TwoLevelBVHOptions& options)
+	: m_Options(options)
+{
+}
+
+void TwoLevelBVH::Build(const parser::Scene& scene)
+{
+	m_BLASNodes.clear();
+	m_Primitives.clear();
+	m_BLASRoots.clear();
+	m_InstanceBLAS.clear();
+	m_InstanceMaterial.clear();
+	m_ObjectToWorld.clear();
+
+	// Find which meshes repeat an earlier one. Candidates are narrowed down by
+	// their face hash before the transform is fitted.
+	std::vector<std::vector<GPU::Primitive>> blasInputs;
+	std::vector<LocalMesh> prototypes;
+	std::unordered_multimap<size_t, int> prototypesByHash;
+	for (const parser::Mesh& mesh : scene.meshes)
+	{
+		LocalMesh local = makeLocalMesh(mesh);
+		int blas = -1;
+		glm::mat4 objectToWorld(1.0f);
+
+		auto range = prototypesByHash.equal_range(local.hash);
+		for (auto it = range.first; it != range.second && blas < 0; ++it)
+		{
+			const LocalMesh& prototype = prototypes[it->second];
+			if (prototype.faces == local.faces &&
+				fitAffine(scene, prototype, local, m_Options.instanceTolerance, objectToWorld))
+			{
+				blas = it->second;
+			}
+		}
+
+		if (blas < 0)
+		{
+			blas = static_cast<int>(prototypes.size());
+			objectToWorld = glm::mat4(1.0f);
+			std::vector<GPU::Primitive> input;
+			input.reserve(mesh.faces.size());
+			for (const parser::Face& face : mesh.faces)
+			{
+				input.push_back(makeTriangle(scene, face, mesh.material_id));
+			}
+			blasInputs.push_back(std::move(input));
+			prototypesByHash.emplace(local.hash, blas);
+			prototypes.push_back(std::move(local));
+		}
+
+		m_InstanceBLAS.push_back(blas);
+		m_InstanceMaterial.push_back(mesh.material_id);
+		m_ObjectToWorld.push_back(objectToWorld);
+	}
+
+	// Spheres and loose triangles keep their own materials.
+	std::vector<GPU::Primitive> looseInput;
+	for (const parser::Sphere& sphere : scene.spheres)
+	{
+		GPU::Primitive primitive;
+		primitive.type = 1;
+		primitive.materialId = sphere.material_id;
+		primitive.vertexData[0] = glm::vec4(vertexPosition(scene, sphere.center_vertex_id), 0.0f);
+		primitive.vertexData[1] = glm::vec4(sphere.radius, 0.0f, 0.0f, 0.0f);
+		looseInput.push_back(primitive);
+	}
+	for (const parser::Triangle& triangle : scene.triangles)
+	{
+		looseInput.push_back(makeTriangle(scene, triangle.indices, triangle.material_id));
+	}
+	if (!looseInput.empty())
+	{
+		m_InstanceBLAS.push_back(static_cast<int>(blasInputs.size()));
+		m_InstanceMaterial.push_back(0);
+		m_ObjectToWorld.push_back(glm::mat4(1.0f));
+		blasInputs.push_back(std::move(looseInput));
+	}
+
+	// Bottom level trees are independent, build them side by side and
+	// append them in a fixed order.
+	size_t blasCount = blasInputs.size();
+	std::vector<std::vector<GPU::BVHNode>> blasNodes(blasCount);
+	std::vector<std::vector<GPU::Primitive>> blasPrimitives(blasCount);
+	{
+		TaskGroup group(m_Options.blasOptions.threadPool);
+		for (size_t i = 0; i < blasCount; i++)
+		{
+			group.Run([this, i, &blasInputs, &blasNodes, &blasPrimitives]()
+				{
+					BVHBuilder(m_Options.blasOptions).Build(blasInputs[i], blasNodes[i], blasPrimitives[i]);
+				}
+			);
+		}
+		group.Wait();
+	}
+
+	for (size_t i = 0; i < blasCount; i++)
+	{
+		int nodeOffset = static_cast<int>(m_BLASNodes.size());
+		int primitiveOffset = static_cast<int>(m_Primitives.size());
+		m_BLASRoots.push_back(nodeOffset);
+		for (GPU::BVHNode node : blasNodes[i])
+		{
+			if (node.primitiveCount > 0)
+			{
+				node.primitiveOffset += primitiveOffset;
+			}
+			else
+			{
+				node.leftChild += nodeOffset;
+				node.rightChild += nodeOffset;
+			}
+			m_BLASNodes.push_back(node);
+		}
+		m_Primitives.insert(m_Primitives.end(), blasPrimitives[i].begin(), blasPrimitives[i].end());
+	}
+
+	BuildTLAS();
+}
+
+void TwoLevelBVH::SetTransform(int instance, const glm::mat4& objectToWorld)
+{
+	m_ObjectToWorld[instance] = objectToWorld;
+}
+
+void TwoLevelBVH::BuildTLAS()
+{
+	int instanceCount = GetInstanceCount();
+	std::vector<PrimitiveRef> refs(instanceCount);
+	for (int i = 0; i < instanceCount; i++)
+	{
+		// World bounds of the instance are the bounds of its transformed root box corners.
+		const GPU::BVHNode& root = m_BLASNodes[m_BLASRoots[m_InstanceBLAS[i]]];
+		refs[i].minBounds = glm::vec3(INFINITY);
+		refs[i].maxBounds = glm::vec3(-INFINITY);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 p((corner & 1) ? root.maxBounds.x : root.minBounds.x,
+						(corner & 2) ? root.maxBounds.y : root.minBounds.y,
+						(corner & 4) ? root.maxBounds.z : root.minBounds.z);
+			glm::vec3 world(m_ObjectToWorld[i] * glm::vec4(p, 1.0f));
+			refs[i].minBounds = glm::min(refs[i].minBounds, world);
+			refs[i].maxBounds = glm::max(refs[i].maxBounds, world);
+		}
+		refs[i].index = i;
+	}
+
+	BVHBuilder(m_Options.tlasOptions).Build(refs, m_TLASNodes);
+
+	m_Instances.resize(instanceCount);
+	for (int i = 0; i < instanceCount; i++)
+	{
+		int source = refs[i].index;
+		GPU::Instance& instance = m_Instances[i];
+		instance.worldToObject = glm::inverse(m_ObjectToWorld[source]);
+		instance.blasRoot = m_BLASRoots[m_InstanceBLAS[source]];
+		instance.materialId = m_InstanceMaterial[source];
+	}
+}
+
+bool TwoLevelBVH::Trace(const glm::vec3& origin, const glm::vec3& direction, TraceResult& result, int* instanceIndex) const
+{
+	result.t = INFINITY;
+	result.primitiveIndex = -1;
+	if (m_TLASNodes.empty()) return false;
+
+	glm::vec3 invDir = 1.0f / direction;
+	int stack[64];
+	int stackPointer = 0;
+	stack[stackPointer++] = 0;
+	while (stackPointer > 0)
+	{
+		const GPU::BVHNode& node = m_TLASNodes[stack[--stackPointer]];
+		if (!hitBounds(node.minBounds, node.maxBounds, origin, invDir, result.t)) continue;
+
+		if (node.primitiveCount == 0)
+		{
+			stack[stackPointer++] = node.leftChild;
+			stack[stackPointer++] = node.rightChild;
+			continue;
+		}
+
+		for (int i = node.primitiveOffset; i < node.primitiveOffset + node.primitiveCount; i++)
+		{
+			// The object space direction is normalized for IntersectPrimitive,
+			// distances along it are scale times the world space ones.
+			const GPU::Instance& instance = m_Instances[i];
+			glm::vec3 localOrigin(instance.worldToObject * glm::vec4(origin, 1.0f));
+			glm::vec3 localDirection(instance.worldToObject * glm::vec4(direction, 0.0f));
+			float scale = glm::length(localDirection);
+			localDirection = localDirection / scale;
+			glm::vec3 localInvDir = 1.0f / localDirection;
+
+			float closest = result.t * scale;
+			int blasStack[128];
+			int blasStackPointer = 0;
+			blasStack[blasStackPointer++] = instance.blasRoot;
+			while (blasStackPointer > 0)
+			{
+				const GPU::BVHNode& blasNode = m_BLASNodes[blasStack[--blasStackPointer]];
+				if (!hitBounds(blasNode.minBounds, blasNode.maxBounds, localOrigin, localInvDir, closest)) continue;
+
+				if (blasNode.primitiveCount == 0)
+				{
+					blasStack[blasStackPointer++] = blasNode.leftChild;
+					blasStack[blasStackPointer++] = blasNode.rightChild;
+					continue;
+				}
+				for (int p = blasNode.primitiveOffset; p < blasNode.primitiveOffset + blasNode.primitiveCount; p++)
+				{
+					float t;
+					if (IntersectPrimitive(m_Primitives[p], localOrigin, localDirection, t) && t < closest)
+					{
+						closest = t;
+						result.t = t / scale;
+						result.primitiveIndex = p;
+						if (instanceIndex != nullptr) *instanceIndex = i;
+					}
+				}
+			}
+		}
+	}
+	return result.primitiveIndex >= 0;
+}
@@ -2,8 +2,35 @@
 #include "Sphere.h"
 #include "Triangle.h"
 #include "Parser.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 
 
+namespace
+{
+    void AppendPrimitive(const std::shared_ptr<Hittable>& object, std::vector<GPU::Primitive>& primitives)
+    {
+        GPU::Primitive temp;
+        if (auto sphere = std::dynamic_pointer_cast<Sphere>(object)) {
+            temp.type = true;
+            temp.materialId = sphere->material_id;
+            temp.vertexData[0] = sphere->center;
+            temp.vertexData[1].x = sphere->radius;
+        }
+        else if (auto triangle = std::dynamic_pointer_cast<Triangle>(object)) {
+            temp.type = false;
+            temp.materialId = triangle->material_id;
+            temp.vertexData[0] = triangle->indices[0];
+            temp.vertexData[1] = triangle->indices[1];
+            temp.vertexData[2] = triangle->indices[2];
+        }
+        primitives.push_back(temp);
+    }
+}
+
 void FlattenBVH(std::shared_ptr<Hittable> root, std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::Primitive>& primitives)
 {
     if (root == nullptr) return;
@@ -11,59 +38,388 @@ void FlattenBVH(std::shared_ptr<Hittable> root, std::vector<GPU::BVHNode>& flatB
     GPU::BVHNode node;
     node.leftChild = -1;
     node.rightChild = -1;
-    node.primitiveIndex= -1;
+    node.primitiveOffset = static_cast<int>(primitives.size());
+    node.primitiveCount = 0;
+    node.minBounds = root->getAABB().getMinBounds();
+    node.maxBounds = root->getAABB().getMaxBounds();
 
     int currentIndex = flatBVH.size();
     flatBVH.push_back(node);
 
+    auto bvhNode = std::dynamic_pointer_cast<BVHNode>(root);
+
+    // Leaf with a range of primitives
+    if (bvhNode && !bvhNode->primitives.empty()) {
+        for (const std::shared_ptr<Hittable>& primitive : bvhNode->primitives) {
+            AppendPrimitive(primitive, primitives);
+        }
+        node.primitiveCount = static_cast<int>(bvhNode->primitives.size());
+    }
+
     // Internal Node type
-    if (auto bvhNode = std::dynamic_pointer_cast<BVHNode>(root)) {
-        node.minBounds = bvhNode->bounding_box.getMinBounds();
-        node.maxBounds = bvhNode->bounding_box.getMaxBounds();
+    else if (bvhNode) {
+        node.leftChild = flatBVH.size();
+        FlattenBVH(bvhNode->left, flatBVH, primitives);
+
+        node.rightChild = flatBVH.size();
+        FlattenBVH(bvhNode->right, flatBVH, primitives);
+    }
+
+    // Single Sphere or Triangle
+    else {
+        AppendPrimitive(root, primitives);
+        node.primitiveCount = 1;
+    }
+
+    flatBVH[currentIndex] = node;
+}
+
+void FlattenBVH(std::shared_ptr<Hittable> root, std::vector<GPU::CompactBVHNode>& compactBVH, std::vector<GPU::Primitive>& primitives)
+{
+    std::vector<GPU::BVHNode> flatBVH;
+    FlattenBVH(root, flatBVH, primitives);
+    CompactBVH(flatBVH, compactBVH);
+}
+
+namespace
+{
+    // Bit pattern of a vertex, so that -0 and 0 stay apart like the floats the shader sees.
+    struct VertexKey
+    {
+        uint32_t bits[4];
+
+        bool operator==(const VertexKey& other) const
+        {
+            return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+        }
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey& key) const
+        {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (uint32_t word : key.bits)
+            {
+                hash = (hash ^ word) * 0x100000001b3ull;
+            }
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+}
+
+void IndexPrimitives(const std::vector<GPU::Primitive>& primitives, std::vector<glm::vec4>& vertices,
+                     std::vector<GPU::IndexedPrimitive>& indexed)
+{
+    vertices.clear();
+    indexed.clear();
+    indexed.reserve(primitives.size());
+
+    std::unordered_map<VertexKey, int, VertexKeyHash> vertexIds;
+    vertexIds.reserve(primitives.size());
+    auto vertexId = [&](const glm::vec4& vertex)
+    {
+        VertexKey key;
+        std::memcpy(key.bits, &vertex, sizeof(key.bits));
+        auto inserted = vertexIds.emplace(key, static_cast<int>(vertices.size()));
+        if (inserted.second)
+        {
+            vertices.push_back(vertex);
+        }
+        return inserted.first->second;
+    };
+
+    for (const GPU::Primitive& primitive : primitives)
+    {
+        GPU::IndexedPrimitive temp;
+        temp.materialId = primitive.materialId;
+        if (primitive.type == 1)
+        {
+            const glm::vec4& center = primitive.vertexData[0];
+            temp.v0 = vertexId(glm::vec4(center.x, center.y, center.z, primitive.vertexData[1].x));
+            temp.v1 = -1;
+            temp.v2 = -1;
+        }
+        else
+        {
+            // w is zero for triangle corners, which keeps them apart from sphere centers.
+            temp.v0 = vertexId(glm::vec4(glm::vec3(primitive.vertexData[0]), 0.0f));
+            temp.v1 = vertexId(glm::vec4(glm::vec3(primitive.vertexData[1]), 0.0f));
+            temp.v2 = vertexId(glm::vec4(glm::vec3(primitive.vertexData[2]), 0.0f));
+        }
+        indexed.push_back(temp);
+    }
+}
+
+void EdgePrimitives(const std::vector<GPU::Primitive>& primitives, std::vector<GPU::EdgePrimitive>& edges)
+{
+    edges.clear();
+    edges.reserve(primitives.size());
+    for (const GPU::Primitive& primitive : primitives)
+    {
+        float materialBits;
+        std::memcpy(&materialBits, &primitive.materialId, sizeof(materialBits));
+
+        GPU::EdgePrimitive temp;
+        glm::vec3 v0(primitive.vertexData[0]);
+        temp.v0 = glm::vec4(v0, materialBits);
+        if (primitive.type == 1)
+        {
+            temp.e1 = glm::vec4(primitive.vertexData[1].x, 0.0f, 0.0f, 1.0f);
+            temp.e2 = glm::vec4(0.0f);
+        }
+        else
+        {
+            temp.e1 = glm::vec4(glm::vec3(primitive.vertexData[1]) - v0, 0.0f);
+            temp.e2 = glm::vec4(glm::vec3(primitive.vertexData[2]) - v0, 0.0f);
+        }
+        edges.push_back(temp);
+    }
+}
+
+namespace
+{
+    GPU::BVHNode MakeLeaf(const std::vector<GPU::Primitive>& primitives, int begin, int end, int primitiveOffset)
+    {
+        GPU::BVHNode leaf = {};
+        leaf.leftChild = -1;
+        leaf.rightChild = -1;
+        leaf.primitiveOffset = primitiveOffset;
+        leaf.primitiveCount = end - begin;
+        leaf.minBounds = glm::vec3(INFINITY);
+        leaf.maxBounds = glm::vec3(-INFINITY);
+        for (int i = begin; i < end; i++)
+        {
+            glm::vec3 minBounds, maxBounds;
+            GetPrimitiveBounds(primitives[i], minBounds, maxBounds);
+            leaf.minBounds = glm::min(leaf.minBounds, minBounds);
+            leaf.maxBounds = glm::max(leaf.maxBounds, maxBounds);
+        }
+        return leaf;
+    }
+}
+
+void SegregateSpheres(std::vector<GPU::BVHNode>& flatBVH, const std::vector<GPU::Primitive>& primitives,
+                      std::vector<GPU::Primitive>& triangles, std::vector<GPU::SpherePrimitive>& spheres)
+{
+    triangles.clear();
+    spheres.clear();
+    triangles.reserve(primitives.size());
+
+    // Gathers the range of every leaf into a scratch list, triangles first,
+    // so each kind ends up contiguous.
+    std::vector<GPU::Primitive> sorted;
+    size_t nodeCount = flatBVH.size();
+    for (size_t nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+    {
+        GPU::BVHNode node = flatBVH[nodeIndex];
+        if (node.primitiveCount == 0) continue;
+
+        sorted.assign(primitives.begin() + node.primitiveOffset,
+                      primitives.begin() + node.primitiveOffset + node.primitiveCount);
+        auto firstSphere = std::stable_partition(sorted.begin(), sorted.end(),
+                                                 [](const GPU::Primitive& primitive) { return primitive.type != 1; });
+        int triangleCount = static_cast<int>(firstSphere - sorted.begin());
+        int sphereCount = node.primitiveCount - triangleCount;
 
-        if (bvhNode->left) {
-            node.leftChild = flatBVH.size();
-            FlattenBVH(bvhNode->left, flatBVH, primitives);
+        int triangleOffset = static_cast<int>(triangles.size());
+        int sphereOffset = ~static_cast<int>(spheres.size());
+        triangles.insert(triangles.end(), sorted.begin(), firstSphere);
+        for (auto it = firstSphere; it != sorted.end(); ++it)
+        {
+            GPU::SpherePrimitive sphere = {};
+            sphere.centerRadius = glm::vec4(glm::vec3(it->vertexData[0]), it->vertexData[1].x);
+            sphere.materialId = it->materialId;
+            spheres.push_back(sphere);
         }
 
-        if (bvhNode->right) {
-            node.rightChild = flatBVH.size();
-            FlattenBVH(bvhNode->right, flatBVH, primitives);
+        if (sphereCount == 0)
+        {
+            flatBVH[nodeIndex].primitiveOffset = triangleOffset;
+        }
+        else if (triangleCount == 0)
+        {
+            flatBVH[nodeIndex].primitiveOffset = sphereOffset;
+        }
+        else
+        {
+            GPU::BVHNode& inner = flatBVH[nodeIndex];
+            inner.leftChild = static_cast<int>(flatBVH.size());
+            inner.rightChild = inner.leftChild + 1;
+            inner.primitiveOffset = 0;
+            inner.primitiveCount = 0;
+            flatBVH.push_back(MakeLeaf(sorted, 0, triangleCount, triangleOffset));
+            flatBVH.push_back(MakeLeaf(sorted, triangleCount, node.primitiveCount, sphereOffset));
         }
     }
-    
-    // Handle Sphere type
-    else if (auto sphere = std::dynamic_pointer_cast<Sphere>(root)) {
-        node.minBounds = sphere->bounding_box.getMinBounds();
-        node.maxBounds = sphere->bounding_box.getMaxBounds();
-        node.primitiveIndex = primitives.size();
-        
+}
+
+namespace
+{
+    void CompactNode(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex, std::vector<GPU::CompactBVHNode>& compactBVH)
+    {
+        const GPU::BVHNode& node = flatBVH[nodeIndex];
+        int currentIndex = compactBVH.size();
+
+        GPU::CompactBVHNode compact;
+        compact.minBounds = node.minBounds;
+        compact.maxBounds = node.maxBounds;
+        compactBVH.push_back(compact);
+
+        if (node.primitiveCount > 0) {
+            compactBVH[currentIndex].data = node.primitiveOffset;
+            compactBVH[currentIndex].info = node.primitiveCount << 3;
+            return;
+        }
+
+        const GPU::BVHNode& left = flatBVH[node.leftChild];
+        const GPU::BVHNode& right = flatBVH[node.rightChild];
+        glm::vec3 offset = (right.minBounds + right.maxBounds) - (left.minBounds + left.maxBounds);
+        glm::vec3 d = glm::abs(offset);
+        int axis = d.x >= d.y && d.x >= d.z ? 0 : (d.y >= d.z ? 1 : 2);
+        int firstIsPositive = offset[axis] < 0.0f;
+
+        CompactNode(flatBVH, node.leftChild, compactBVH);
+        compactBVH[currentIndex].data = compactBVH.size();
+        compactBVH[currentIndex].info = (firstIsPositive << 2) | axis;
+        CompactNode(flatBVH, node.rightChild, compactBVH);
+    }
+}
+
+void CompactBVH(const std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::CompactBVHNode>& compactBVH)
+{
+    compactBVH.clear();
+    if (flatBVH.empty()) return;
+
+    compactBVH.reserve(flatBVH.size());
+    CompactNode(flatBVH, 0, compactBVH);
+}
+
+void ExtractPrimitives(std::vector<GPU::Primitive>& primitives, parser::Scene& scene)
+{
+    auto vertex = [&scene](int id)
+    {
+        const parser::Vec3f& v = scene.vertex_data[id - 1];
+        return glm::vec4(v.x, v.y, v.z, 0);
+    };
+    auto triangle = [&](const parser::Face& face, int materialId)
+    {
         GPU::Primitive temp;
-        temp.type = true;
-        temp.materialId = sphere->material_id;
-        temp.vertexData[0] = sphere->center;
-        temp.vertexData[1].x = sphere->radius;
+        temp.type = false;
+        temp.materialId = materialId;
+        temp.vertexData[0] = vertex(face.v0_id);
+        temp.vertexData[1] = vertex(face.v1_id);
+        temp.vertexData[2] = vertex(face.v2_id);
         primitives.push_back(temp);
+    };
+
+    size_t count = scene.spheres.size() + scene.triangles.size();
+    for (auto& mesh : scene.meshes)
+    {
+        count += mesh.faces.size();
     }
-    
-    // Handle Triangle type
-    else if (auto triangle = std::dynamic_pointer_cast<Triangle>(root)) {
-        node.minBounds = triangle->bounding_box.getMinBounds();
-        node.maxBounds = triangle->bounding_box.getMaxBounds();
-        node.primitiveIndex = primitives.size();
+    primitives.reserve(primitives.size() + count);
 
+    for (auto& sphere : scene.spheres)
+    {
         GPU::Primitive temp;
-        temp.type = false;
-        temp.materialId = triangle->material_id;
-        temp.vertexData[0] = triangle->indices[0];
-        temp.vertexData[1] = triangle->indices[1];
-        temp.vertexData[2] = triangle->indices[2];
+        temp.type = true;
+        temp.materialId = sphere.material_id;
+        temp.vertexData[0] = vertex(sphere.center_vertex_id);
+        temp.vertexData[1].x = sphere.radius;
         primitives.push_back(temp);
     }
+    for (auto& tri : scene.triangles)
+    {
+        triangle(tri.indices, tri.material_id);
+    }
+    for (auto& mesh : scene.meshes)
+    {
+        for (auto& face : mesh.faces)
+        {
+            triangle(face, mesh.material_id);
+        }
+    }
+}
 
-    flatBVH[currentIndex] = node;
+void GetPrimitiveBounds(const GPU::Primitive& primitive, glm::vec3& minBounds, glm::vec3& maxBounds)
+{
+    glm::vec3 v0(primitive.vertexData[0].x, primitive.vertexData[0].y, primitive.vertexData[0].z);
+    if (primitive.type == 1)
+    {
+        glm::vec3 r(primitive.vertexData[1].x);
+        minBounds = v0 - r;
+        maxBounds = v0 + r;
+    }
+    else
+    {
+        glm::vec3 v1(primitive.vertexData[1].x, primitive.vertexData[1].y, primitive.vertexData[1].z);
+        glm::vec3 v2(primitive.vertexData[2].x, primitive.vertexData[2].y, primitive.vertexData[2].z);
+        minBounds = glm::min(v0, glm::min(v1, v2));
+        maxBounds = glm::max(v0, glm::max(v1, v2));
+    }
+    minBounds = minBounds - glm::vec3(0.0001f);
+    maxBounds = maxBounds + glm::vec3(0.0001f);
+}
+
+bool IntersectPrimitive(const GPU::Primitive& primitive, const glm::vec3& origin, const glm::vec3& direction, float& t)
+{
+    glm::vec3 v0(primitive.vertexData[0].x, primitive.vertexData[0].y, primitive.vertexData[0].z);
+
+    // triangle
+    if (primitive.type == 0)
+    {
+        glm::vec3 e1 = glm::vec3(primitive.vertexData[1].x, primitive.vertexData[1].y, primitive.vertexData[1].z) - v0;
+        glm::vec3 e2 = glm::vec3(primitive.vertexData[2].x, primitive.vertexData[2].y, primitive.vertexData[2].z) - v0;
+        glm::vec3 h = glm::cross(direction, e2);
+        float a = glm::dot(e1, h);
+        if (a > -0.00001f && a < 0.00001f) return false;
+
+        float f = 1.0f / a;
+        glm::vec3 s = origin - v0;
+        float u = f * glm::dot(s, h);
+        if (u < 0.0f || u > 1.0f) return false;
+
+        glm::vec3 q = glm::cross(s, e1);
+        float v = f * glm::dot(direction, q);
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        t = f * glm::dot(e2, q);
+        return t > 0.00001f;
+    }
+
+    // sphere
+    float radius = primitive.vertexData[1].x;
+    glm::vec3 oc = origin - v0;
+    float b = glm::dot(oc, direction);
+    float c = glm::dot(oc, oc) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant <= 0.0f) return false;
+
+    t = -b - std::sqrt(discriminant);
+    if (t < 0.00001f) t = -b + std::sqrt(discriminant);
+    return t > 0.00001f;
 }
 
+float ComputeSAHCost(const std::vector<GPU::BVHNode>& flatBVH, float traversalCost, float leafCost)
+{
+    auto area = [](const GPU::BVHNode& node)
+    {
+        glm::vec3 d = node.maxBounds - node.minBounds;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    };
+
+    if (flatBVH.empty()) return 0.0f;
+    float rootArea = area(flatBVH[0]);
+    if (rootArea <= 0.0f) return 0.0f;
+
+    double cost = 0.0;
+    for (const GPU::BVHNode& node : flatBVH)
+    {
+        cost += area(node) * (node.primitiveCount > 0 ? leafCost * node.primitiveCount : traversalCost);
+    }
+    return static_cast<float>(cost / rootArea);
+}
 
 void ExtractMaterials(std::vector<GPU::Material>& materials, parser::Scene& scene)
 {
@@ -0,0 +1,245 @@
+#include "WideBVH.h"
+#include "Utils.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIDE_BVH_SSE
+#include <immintrin.h>
+#endif
+
+namespace {
+
+float surfaceArea(const GPU::BVHNode& node)
+{
+	glm::vec3 d = node.maxBounds - node.minBounds;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+template <int Width>
+int collapseNode(const std::vector<GPU::BVHNode>& flatBVH, int nodeIndex, std::vector<GPU::WideBVHNode<Width>>& wideBVH)
+{
+	int children[Width];
+	int childCount = 0;
+	const GPU::BVHNode& node = flatBVH[nodeIndex];
+	if (node.primitiveCount > 0)
+	{
+		children[childCount++] = nodeIndex;
+	}
+	else
+	{
+		children[childCount++] = node.leftChild;
+		children[childCount++] = node.rightChild;
+	}
+
+	// Open the inner child with the largest area until the node is full.
+	while (childCount < Width)
+	{
+		int best = -1;
+		float bestArea = -1.0f;
+		for (int i = 0; i < childCount; i++)
+		{
+			const GPU::BVHNode& child = flatBVH[children[i]];
+			if (child.primitiveCount == 0 && surfaceArea(child) > bestArea)
+			{
+				bestArea = surfaceArea(child);
+				best = i;
+			}
+		}
+		if (best < 0) break;
+
+		const GPU::BVHNode& opened = flatBVH[children[best]];
+		children[best] = opened.leftChild;
+		children[childCount++] = opened.rightChild;
+	}
+
+	int wideIndex = static_cast<int>(wideBVH.size());
+	wideBVH.emplace_back();
+	for (int i = 0; i < Width; i++)
+	{
+		GPU::WideBVHNode<Width>& wide = wideBVH[wideIndex];
+		if (i >= childCount)
+		{
+			wide.minX[i] = wide.minY[i] = wide.minZ[i] = INFINITY;
+			wide.maxX[i] = wide.maxY[i] = wide.maxZ[i] = -INFINITY;
+			wide.child[i] = -1;
+			wide.count[i] = -1;
+			continue;
+		}
+
+		const GPU::BVHNode& child = flatBVH[children[i]];
+		wide.minX[i] = child.minBounds.x;
+		wide.minY[i] = child.minBounds.y;
+		wide.minZ[i] = child.minBounds.z;
+		wide.maxX[i] = child.maxBounds.x;
+		wide.maxY[i] = child.maxBounds.y;
+		wide.maxZ[i] = child.maxBounds.z;
+		if (child.primitiveCount > 0)
+		{
+			wide.child[i] = child.primitiveOffset;
+			wide.count[i] = child.primitiveCount;
+		}
+		else
+		{
+			// Recursing grows wideBVH, so the node is looked up again by index.
+			int childIndex = collapseNode<Width>(flatBVH, children[i], wideBVH);
+			wideBVH[wideIndex].child[i] = childIndex;
+			wideBVH[wideIndex].count[i] = 0;
+		}
+	}
+	return wideIndex;
+}
+
+struct TraceRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 invDirection;
+};
+
+// Slab test of the child slots [first, first + 4). Returns a bit mask of the
+// children hit before tMax and writes their entry distances to tNear.
+template <int Width>
+int intersectChildren4(const GPU::WideBVHNode<Width>& node, int first, const TraceRay& ray, float tMax, float* tNear)
+{
+#ifdef WIDE_BVH_SSE
+	__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX + first), _mm_set1_ps(ray.origin.x)), _mm_set1_ps(ray.invDirection.x));
+	__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX + first), _mm_set1_ps(ray.origin.x)), _mm_set1_ps(ray.invDirection.x));
+	__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY + first), _mm_set1_ps(ray.origin.y)), _mm_set1_ps(ray.invDirection.y));
+	__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY + first), _mm_set1_ps(ray.origin.y)), _mm_set1_ps(ray.invDirection.y));
+	__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ + first), _mm_set1_ps(ray.origin.z)), _mm_set1_ps(ray.invDirection.z));
+	__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ + first), _mm_set1_ps(ray.origin.z)), _mm_set1_ps(ray.invDirection.z));
+
+	__m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+	__m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+	__m128i valid = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(node.count + first)), _mm_set1_epi32(-1));
+
+	_mm_storeu_ps(tNear + first, tmin);
+	return _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(tmin, tmax), _mm_castsi128_ps(valid))) << first;
+#else
+	int mask = 0;
+	for (int i = first; i < first + 4; i++)
+	{
+		float t0x = (node.minX[i] - ray.origin.x) * ray.invDirection.x, t1x = (node.maxX[i] - ray.origin.x) * ray.invDirection.x;
+		float t0y = (node.minY[i] - ray.origin.y) * ray.invDirection.y, t1y = (node.maxY[i] - ray.origin.y) * ray.invDirection.y;
+		float t0z = (node.minZ[i] - ray.origin.z) * ray.invDirection.z, t1z = (node.maxZ[i] - ray.origin.z) * ray.invDirection.z;
+		float tmin = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), 0.0f));
+		float tmax = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), tMax));
+		tNear[i] = tmin;
+		if (node.count[i] >= 0 && tmin <= tmax) mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+template <int Width>
+int intersectChildren(const GPU::WideBVHNode<Width>& node, const TraceRay& ray, float tMax, float* tNear)
+{
+#ifdef __AVX__
+	if constexpr (Width == 8)
+	{
+		__m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minX), _mm256_set1_ps(ray.origin.x)), _mm256_set1_ps(ray.invDirection.x));
+		__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxX), _mm256_set1_ps(ray.origin.x)), _mm256_set1_ps(ray.invDirection.x));
+		__m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minY), _mm256_set1_ps(ray.origin.y)), _mm256_set1_ps(ray.invDirection.y));
+		__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxY), _mm256_set1_ps(ray.origin.y)), _mm256_set1_ps(ray.invDirection.y));
+		__m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minZ), _mm256_set1_ps(ray.origin.z)), _mm256_set1_ps(ray.invDirection.z));
+		__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxZ), _mm256_set1_ps(ray.origin.z)), _mm256_set1_ps(ray.invDirection.z));
+
+		__m256 tmin = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)), _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_setzero_ps()));
+		__m256 tmax = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)), _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_set1_ps(tMax)));
+		__m256 valid = _mm256_cmp_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(node.count))), _mm256_set1_ps(-1.0f), _CMP_GT_OQ);
+
+		_mm256_storeu_ps(tNear, tmin);
+		return _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ), valid));
+	}
+#endif
+	int mask = 0;
+	for (int first = 0; first < Width; first += 4)
+	{
+		mask |= intersectChildren4(node, first, ray, tMax, tNear);
+	}
+	return mask;
+}
+
+}
+
+template <int Width>
+void CollapseBVH(const std::vector<GPU::BVHNode>& flatBVH, std::vector<GPU::WideBVHNode<Width>>& wideBVH)
+{
+	static_assert(Width == 4 || Width == 8, "wide BVH nodes hold 4 or 8 children");
+
+	wideBVH.clear();
+	if (flatBVH.empty()) return;
+	wideBVH.reserve(flatBVH.size() / (Width - 1) + 1);
+	collapseNode<Width>(flatBVH, 0, wideBVH);
+}
+
+template <int Width>
+bool TraceWideBVH(const std::vector<GPU::WideBVHNode<Width>>& wideBVH, const std::vector<GPU::Primitive>& primitives,
+				  const glm::vec3& origin, const glm::vec3& direction, TraceResult& result)
+{
+	result.t = INFINITY;
+	result.primitiveIndex = -1;
+	if (wideBVH.empty()) return false;
+
+	TraceRay ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.invDirection = 1.0f / direction;
+
+	int stack[64 * Width];
+	int stackPointer = 0;
+	stack[stackPointer++] = 0;
+
+	while (stackPointer > 0)
+	{
+		const GPU::WideBVHNode<Width>& node = wideBVH[stack[--stackPointer]];
+		float tNear[Width];
+		int mask = intersectChildren(node, ray, result.t, tNear);
+
+		// Leaves are intersected right away, inner children are pushed far to
+		// near so that the nearest one is visited first.
+		int inner[Width];
+		int innerCount = 0;
+		for (int i = 0; i < Width; i++)
+		{
+			if (!(mask & (1 << i))) continue;
+
+			if (node.count[i] > 0)
+			{
+				for (int p = node.child[i]; p < node.child[i] + node.count[i]; p++)
+				{
+					float t;
+					if (IntersectPrimitive(primitives[p], origin, direction, t) && t < result.t)
+					{
+						result.t = t;
+						result.primitiveIndex = p;
+					}
+				}
+			}
+			else
+			{
+				int j = innerCount++;
+				for (; j > 0 && tNear[inner[j - 1]] < tNear[i]; j--)
+				{
+					inner[j] = inner[j - 1];
+				}
+				inner[j] = i;
+			}
+		}
+		for (int i = 0; i < innerCount; i++)
+		{
+			if (tNear[inner[i]] <= result.t)
+			{
+				stack[stackPointer++] = node.child[inner[i]];
+			}
+		}
+	}
+	return result.primitiveIndex >= 0;
+}
+
+template void CollapseBVH<4>(const std::vector<GPU::BVHNode>&, std::vector<GPU::WideBVHNode<4>>&);
+template void CollapseBVH<8>(const std::vector<GPU::BVHNode>&, std::vector<GPU::WideBVHNode<8>>&);
+template bool TraceWideBVH<4>(const std::vector<GPU::WideBVHNode<4>>&, const std::vector<GPU::Primitive>&,
+							  const glm::vec3&, const glm::vec3&, TraceResult&);
+template bool TraceWideBVH<8>(const std::vector<GPU::WideBVHNode<8>>&, const std::vector<GPU::Primitive>&,
+							  const glm::vec3&, const glm::vec3&, TraceResult&);
@@ -0,0 +1,217 @@
+#include "XmlStreamReader.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+inline bool isWhitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isBlank(const char* begin, const char* end)
+{
+	return std::all_of(begin, end, isWhitespace);
+}
+
+}
+
+XmlStreamReader::XmlStreamReader(const std::string& path, size_t windowSize)
+	: m_File(std::fopen(path.c_str(), "rb")), m_Window(std::max<size_t>(windowSize, 64)), m_Begin(0), m_End(0),
+	  m_FileDone(false), m_PendingEnd(false), m_TextBegin(nullptr), m_TextEnd(nullptr)
+{
+}
+
+XmlStreamReader::~XmlStreamReader()
+{
+	if (m_File) std::fclose(m_File);
+}
+
+const char* XmlStreamReader::GetAttribute(const char* name) const
+{
+	for (const auto& attribute : m_Attributes)
+	{
+		if (attribute.first == name) return attribute.second.c_str();
+	}
+	return nullptr;
+}
+
+// Moves the unconsumed bytes to the front of the window and reads after
+// them, doubling the window only when a single tag or token fills it.
+bool XmlStreamReader::fill()
+{
+	if (m_Begin > 0)
+	{
+		std::memmove(m_Window.data(), m_Window.data() + m_Begin, m_End - m_Begin);
+		m_End -= m_Begin;
+		m_Begin = 0;
+	}
+	if (m_End == m_Window.size())
+	{
+		m_Window.resize(m_Window.size() * 2);
+	}
+	if (m_FileDone || !m_File) return false;
+
+	size_t count = std::fread(m_Window.data() + m_End, 1, m_Window.size() - m_End, m_File);
+	if (count == 0)
+	{
+		m_FileDone = true;
+		return false;
+	}
+	m_End += count;
+	return true;
+}
+
+bool XmlStreamReader::ensure(size_t count)
+{
+	while (m_End - m_Begin < count)
+	{
+		if (!fill()) return false;
+	}
+	return true;
+}
+
+// Offset of pattern from the first unconsumed byte, reading on as needed.
+size_t XmlStreamReader::find(const char* pattern)
+{
+	size_t length = std::strlen(pattern);
+	size_t searchFrom = 0;
+	for (;;)
+	{
+		const char* begin = m_Window.data() + m_Begin;
+		const char* end = m_Window.data() + m_End;
+		const char* match = std::search(begin + searchFrom, end, pattern, pattern + length);
+		if (match != end) return static_cast<size_t>(match - begin);
+
+		size_t available = m_End - m_Begin;
+		searchFrom = available >= length ? available - length + 1 : 0;
+		if (!fill()) return std::string::npos;
+	}
+}
+
+// Reads the tag starting at the first unconsumed byte into the name and
+// attributes, leaving m_PendingEnd set for self closing elements.
+void XmlStreamReader::readTag()
+{
+	// Find the closing bracket, skipping those inside quoted attribute values.
+	size_t length = 1;
+	char quote = 0;
+	for (;; length++)
+	{
+		if (!ensure(length + 1)) throw std::runtime_error("Error: Unterminated tag in xml file.");
+		char c = m_Window[m_Begin + length];
+		if (quote)
+		{
+			if (c == quote) quote = 0;
+		}
+		else if (c == '"' || c == '\'')
+		{
+			quote = c;
+		}
+		else if (c == '>')
+		{
+			break;
+		}
+	}
+
+	const char* cursor = m_Window.data() + m_Begin + 1;
+	const char* end = m_Window.data() + m_Begin + length;
+	m_Begin += length + 1;
+	m_Attributes.clear();
+
+	bool closing = *cursor == '/';
+	if (closing) cursor++;
+	const char* nameBegin = cursor;
+	while (cursor < end && !isWhitespace(*cursor) && *cursor != '/') cursor++;
+	m_Name.assign(nameBegin, cursor);
+	if (m_Name.empty()) throw std::runtime_error("Error: Tag without a name in xml file.");
+	if (closing) return;
+
+	for (;;)
+	{
+		while (cursor < end && isWhitespace(*cursor)) cursor++;
+		if (cursor == end) return;
+		if (*cursor == '/')
+		{
+			m_PendingEnd = true;
+			return;
+		}
+
+		const char* attributeBegin = cursor;
+		while (cursor < end && *cursor != '=' && !isWhitespace(*cursor)) cursor++;
+		std::string attributeName(attributeBegin, cursor);
+		while (cursor < end && (isWhitespace(*cursor) || *cursor == '=')) cursor++;
+		if (cursor == end || (*cursor != '"' && *cursor != '\''))
+		{
+			throw std::runtime_error("Error: Attribute " + attributeName + " of " + m_Name + " has no quoted value.");
+		}
+		char valueQuote = *cursor++;
+		const char* valueBegin = cursor;
+		while (cursor < end && *cursor != valueQuote) cursor++;
+		m_Attributes.emplace_back(std::move(attributeName), std::string(valueBegin, cursor));
+		cursor++;
+	}
+}
+
+XmlStreamReader::Event XmlStreamReader::Next()
+{
+	if (m_PendingEnd)
+	{
+		m_PendingEnd = false;
+		return Event::EndElement;
+	}
+
+	for (;;)
+	{
+		if (!ensure(1)) return Event::EndOfFile;
+
+		if (m_Window[m_Begin] == '<')
+		{
+			ensure(9);
+			const char* tag = m_Window.data() + m_Begin;
+			size_t available = m_End - m_Begin;
+			const char* terminator = nullptr;
+			if (available >= 2 && tag[1] == '?') terminator = "?>";
+			else if (available >= 4 && std::memcmp(tag, "<!--", 4) == 0) terminator = "-->";
+			else if (available >= 9 && std::memcmp(tag, "<![CDATA[", 9) == 0) terminator = "]]>";
+			else if (available >= 2 && tag[1] == '!') terminator = ">";
+
+			if (terminator)
+			{
+				size_t offset = find(terminator);
+				if (offset == std::string::npos) throw std::runtime_error("Error: Unterminated markup in xml file.");
+				m_Begin += offset + std::strlen(terminator);
+				continue;
+			}
+
+			bool closing = available >= 2 && tag[1] == '/';
+			readTag();
+			return closing ? Event::EndElement : Event::StartElement;
+		}
+
+		const char* begin = m_Window.data() + m_Begin;
+		const char* end = m_Window.data() + m_End;
+		const char* tagStart = static_cast<const char*>(std::memchr(begin, '<', end - begin));
+		const char* pieceEnd = tagStart;
+		if (!pieceEnd)
+		{
+			// Cut the text at its last whitespace so that no token is split.
+			pieceEnd = end;
+			while (pieceEnd > begin && !isWhitespace(pieceEnd[-1])) pieceEnd--;
+			if (pieceEnd == begin || m_FileDone)
+			{
+				if (fill()) continue;
+				pieceEnd = end;
+			}
+		}
+
+		m_Begin += pieceEnd - begin;
+		if (!isBlank(begin, pieceEnd))
+		{
+			m_TextBegin = begin;
+			m_TextEnd = pieceEnd;
+			return Event::Text;
+		}
+	}
+}
@@ -1,7 +1,227 @@
 #include "App.h"
+#include "CpuRenderer.h"
+#include "Parser.h"
+
+namespace
+{
+    // Parses the scene a few times without opening a window and reports the
+    // best time, as megabytes of scene file per second.
+    void BenchmarkParser(const AppSettings& settings, int iterations)
+    {
+        const std::string& scenePath = settings.scenePath;
+        ThreadPool threadPool(settings.threadCount);
+        std::ifstream file(scenePath, std::ios::binary | std::ios::ate);
+        double megabytes = static_cast<double>(file.tellg()) / (1024.0 * 1024.0);
+        double bestSeconds = 0.0;
+        size_t vertexCount = 0;
+        size_t faceCount = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            parser::Scene benchmarkScene;
+            benchmarkScene.load(scenePath, settings.streamParse, &threadPool);
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            bestSeconds = i == 0 ? seconds : std::min(bestSeconds, seconds);
+
+            vertexCount = benchmarkScene.vertex_data.size();
+            faceCount = benchmarkScene.triangles.size();
+            for (const parser::Mesh& mesh : benchmarkScene.meshes) faceCount += mesh.faces.size();
+        }
+        std::cout << scenePath << ": " << megabytes << " MB, " << vertexCount << " vertices, " << faceCount
+                  << " faces parsed in " << bestSeconds * 1000.0 << " ms, " << megabytes / bestSeconds << " MB/s on "
+                  << threadPool.GetThreadCount() << " thread(s)" << std::endl;
+    }
+
+    // Writes the scene as an .rtscene file that later launches load without parsing.
+    void ConvertScene(const std::string& scenePath, const std::string& outputPath, bool streamParse)
+    {
+        parser::Scene convertedScene;
+        convertedScene.load(scenePath, streamParse);
+        convertedScene.saveToBinary(outputPath);
+        std::cout << "Converted " << scenePath << " to " << outputPath << std::endl;
+    }
+
+    // Renders the scene cameras to their image files on the CPU, without opening a window.
+    void RenderOnCpu(const AppSettings& settings, CpuRenderOptions options)
+    {
+        ThreadPool threadPool(settings.threadCount);
+        scene.load(settings.scenePath, settings.streamParse, &threadPool);
+
+        options.threadPool = &threadPool;
+        std::cout << "Rendering on " << threadPool.GetThreadCount() << " thread(s)" << std::endl;
+        RenderSceneCameras(options);
+    }
+
+    // Compares single ray and packet traversal of the primary rays of the scene cameras.
+    void BenchmarkPackets(const AppSettings& settings, int iterations)
+    {
+        ThreadPool threadPool(settings.threadCount);
+        scene.load(settings.scenePath, settings.streamParse, &threadPool);
+        BenchmarkPacketTracing(iterations);
+    }
+
+    // Renders the scene cameras in float and double precision and compares time and images.
+    void CompareCpuPrecision(const AppSettings& settings, CpuRenderOptions options)
+    {
+        ThreadPool threadPool(settings.threadCount);
+        scene.load(settings.scenePath, settings.streamParse, &threadPool);
+
+        options.threadPool = &threadPool;
+        ComparePrecision(options);
+    }
+}
 
 int main(int argc, char* argv[])
 {
-    App raytracer;
+    AppSettings settings;
+    int parseBenchmarkIterations = 0;
+    std::string convertPath;
+    bool renderCpu = false;
+    CpuRenderOptions cpuOptions;
+    int packetBenchmarkIterations = 0;
+    bool comparePrecision = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            settings.threadCount = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--builder" && i + 1 < argc)
+        {
+            std::string builder = argv[++i];
+            settings.builder = builder == "lbvh" ? BVHBuilderType::LBVH
+                : builder == "sbvh" ? BVHBuilderType::SBVH : BVHBuilderType::SAH;
+        }
+        else if (arg == "--bvh-layout" && i + 1 < argc)
+        {
+            std::string layout = argv[++i];
+            settings.layout = layout == "wide" ? BVHLayout::Wide
+                : layout == "compact" ? BVHLayout::Compact : BVHLayout::Binary;
+        }
+        else if (arg == "--instancing")
+        {
+            settings.instancing = true;
+        }
+        else if (arg == "--animate")
+        {
+            settings.animate = true;
+        }
+        else if (arg == "--primitive-format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            settings.primitiveFormat = format == "indexed" ? PrimitiveFormat::Indexed
+                : format == "edges" ? PrimitiveFormat::Edges : PrimitiveFormat::Inline;
+        }
+        else if (arg == "--sphere-buffer")
+        {
+            settings.sphereBuffer = true;
+        }
+        else if (arg == "--node-order" && i + 1 < argc)
+        {
+            std::string order = argv[++i];
+            settings.nodeOrder = order == "treelet" ? NodeOrder::Treelet
+                : order == "veb" ? NodeOrder::VanEmdeBoas : NodeOrder::DepthFirst;
+        }
+        else if (arg == "--block-bytes" && i + 1 < argc)
+        {
+            settings.layoutBlockBytes = std::max(64, std::atoi(argv[++i]));
+        }
+        else if (arg == "--scene-cache" && i + 1 < argc)
+        {
+            settings.cacheDirectory = argv[++i];
+        }
+        else if (arg == "--stream-parse")
+        {
+            settings.streamParse = true;
+        }
+        else if (arg == "--convert" && i + 1 < argc)
+        {
+            convertPath = argv[++i];
+        }
+        else if (arg == "--benchmark-parse" && i + 1 < argc)
+        {
+            parseBenchmarkIterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--render-cpu")
+        {
+            renderCpu = true;
+        }
+        else if (arg == "--tile-size" && i + 1 < argc)
+        {
+            cpuOptions.tileSize = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--tile-order" && i + 1 < argc)
+        {
+            std::string order = argv[++i];
+            cpuOptions.tileOrder = order == "scanline" ? TileOrder::Scanline
+                : order == "morton" ? TileOrder::Morton : TileOrder::Hilbert;
+        }
+        else if (arg == "--progressive" && i + 1 < argc)
+        {
+            cpuOptions.progressivePasses = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--packet-size" && i + 1 < argc)
+        {
+            int size = std::atoi(argv[++i]);
+            cpuOptions.packetSize = size <= 0 ? 0 : size <= 4 ? 4 : size <= 8 ? 8 : 16;
+        }
+        else if (arg == "--benchmark-packets" && i + 1 < argc)
+        {
+            packetBenchmarkIterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--double-precision")
+        {
+            cpuOptions.doublePrecision = true;
+        }
+        else if (arg == "--compare-precision")
+        {
+            comparePrecision = true;
+        }
+        else if (arg == "--cache-report")
+        {
+            settings.cacheReport = true;
+        }
+        else if (arg == "--cache-report-bytes" && i + 1 < argc)
+        {
+            settings.cacheReport = true;
+            settings.cacheReportBytes = std::max(64, std::atoi(argv[++i]));
+        }
+        else
+        {
+            settings.scenePath = arg;
+        }
+    }
+
+    if (!convertPath.empty())
+    {
+        ConvertScene(settings.scenePath, convertPath, settings.streamParse);
+        return 0;
+    }
+    if (parseBenchmarkIterations > 0)
+    {
+        BenchmarkParser(settings, parseBenchmarkIterations);
+        return 0;
+    }
+
+    if (packetBenchmarkIterations > 0)
+    {
+        BenchmarkPackets(settings, packetBenchmarkIterations);
+        return 0;
+    }
+
+    if (comparePrecision)
+    {
+        CompareCpuPrecision(settings, cpuOptions);
+        return 0;
+    }
+
+    if (renderCpu)
+    {
+        RenderOnCpu(settings, cpuOptions);
+        return 0;
+    }
+
+    App raytracer(settings);
     raytracer.Run();
 }